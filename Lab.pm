@@ -4,8 +4,11 @@ use strict;
 use PDL;
 use PDL::Image2D;
 
+# compiled hists_* functions, see Lab-Hists/
+my $NATIVE = eval { require Lab::Hists; 1 };
+
 require Exporter;
-use vars qw( @ISA @EXPORT @EXPORT_OK $BGDIR $EVTDIR $TESTFILE $ANALDIR $TYPE %NBINS %BGFILES );
+use vars qw( @ISA @EXPORT @EXPORT_OK $BGDIR $EVTDIR $TESTFILE $ANALDIR $TYPE %NBINS %BGFILES $CUBEDIR $MKCUBE );
 
 use MyRDB qw( rdb_cols );
 
@@ -33,6 +36,11 @@ $EVTDIR = '/data/legs/rpete/data/hrcs_lab/evt1';
 $ANALDIR = '/data/legs/rpete/data/hrcs_lab/analysis';
 $TESTFILE = '/data/legs/rpete/cal/hrcs_gain/hrcs_lab.rdb';
 
+# cube files of src_hists() and bg_hists(), see stored_hists(); undef
+# to always read the BIN files instead
+$CUBEDIR = $ANALDIR.'/cubes';
+$MKCUBE = 'mkcube';
+
 # which binfile type to read/write
 # samp, spimean, spimed or pha
 $TYPE = 'samp';
@@ -269,14 +277,47 @@ sub bradto2d {
 }
 
 sub three_by_three {
-  my $hists = shift;
-  return $hists->xchg(0,2)->conv2d(ones($hists->type,3,3),{Boundary=>'Truncate'})->xchg(0,2)->sever;
+  return hists_box(shift, 3, 3);
+}
+
+#
+# each histogram replaced by the sum of those in the $wx by $wy box of
+# subtaps around it
+#
+sub hists_box {
+  my ($hists, $wx, $wy) = @_;
+
+  if ($NATIVE) {
+    my $boxed = $hists->copy;
+    Lab::Hists::box_filter_native($boxed, $wx, $wy);
+    return $boxed;
+  }
+
+  # the exchanged cube is (ny, nx, nbins), so the kernel is wy by wx
+  return $hists->xchg(0,2)->conv2d(ones($hists->type,$wy,$wx),{Boundary=>'Truncate'})->xchg(0,2)->sever;
+}
+
+#
+# zero, in place, the histograms outside $mask, e.g., active_mask_src()
+#
+sub hists_mask {
+  my ($hists, $mask) = @_;
+
+  return Lab::Hists::hists_mask_native($hists, $mask) if $NATIVE;
+
+  my $i = whichND(!$mask);
+  (my $tmp = hists_indexND($hists, $i)) .= 0 if $i->nelem;
 }
 
 
 sub bg_hists {
   my $file = @_ ? shift : $BGFILES{$TYPE};
 
+  (my $name = $file) =~ s!.*/!!;
+  $name =~ s/\.bin$//;
+  my $stored = stored_hists($name, 'subtap', $file);
+  return $stored if defined $stored;
+
   my $hists = zero_hists();
   add_to_hists($hists, $file);
 
@@ -286,14 +327,23 @@ sub bg_hists {
 sub src_hists {
   my $anode = shift;
   my $yfilter = @_ ? shift : 1; # filter on rawy by default
-
-  my $hists = zero_hists();
+  my $dir = @_ ? shift : $Lab::ANALDIR;
 
   my ($MCP, $HRC_file) = (Lab::test_data($anode))[2,4];
 
+  my @sources = map {
+    [ "$dir/$HRC_file->[$_]_$TYPE.bin",
+      ($yfilter ? (rawy_limits_mcp($MCP->[$_])) : ()) ]
+  } 0..$#{$HRC_file};
+  my $stored = stored_hists("${anode}_$TYPE".($yfilter ? '' : '_nofilter'),
+			    'subtap', @sources);
+  return $stored if defined $stored;
+
+  my $hists = zero_hists();
+
   for (0..$#{$HRC_file}) {
     my $hrcfile = $HRC_file->[$_];
-    my $file = "$Lab::ANALDIR/${hrcfile}_$TYPE.bin";
+    my $file = "$dir/${hrcfile}_$TYPE.bin";
     add_to_hists($hists, $file,
 		 ($yfilter ? (rawy_limits_mcp($MCP->[$_])) : ()),
 		 );
@@ -320,6 +370,96 @@ sub add_to_hists {
   }
 }
 
+#
+# Histograms of the BIN files @sources, each a file name or [ file,
+# rawy_lo, rawy_hi ] as for add_to_hists, at $level of the cube file
+# $name.cube in $CUBEDIR. mkcube makes the cube first if it is missing
+# or any source has changed since it was made, otherwise it is just
+# read. Returns undef if there is no $CUBEDIR or the cube cannot be
+# made, e.g., mkcube is not installed, in which case the caller reads
+# the BIN files itself.
+#
+sub stored_hists {
+  my ($name, $level, @sources) = @_;
+
+  defined $CUBEDIR or return;
+  -d $CUBEDIR or mkdir $CUBEDIR or return;
+
+  my $cube = "$CUBEDIR/$name.cube";
+  my @args = ('--update', "--type=$TYPE", $cube);
+  for (@sources) {
+    my ($file, @rawy) = ref $_ ? @$_ : ($_);
+    push @args, (@rawy ? '--rawy='.join(':', @rawy) : '--rawy=all'), $file;
+  }
+
+  # mkcube missing is not an error
+  my $status = do { no warnings 'exec'; system $MKCUBE, @args };
+  $status == 0 or return;
+
+  return read_cube($cube, $level);
+}
+
+#
+# histograms of a cube file written by mkcube, at any of its levels
+#
+# my $hists = Lab::read_cube($file);          # subtaps, as zero_hists
+# my $taps = Lab::read_cube($file, 'tap');    # (nbins, 16, 192)
+# my $chips = Lab::read_cube($file, 'chip');  # (nbins, 1, 3)
+# my ($det, $tag) = Lab::read_cube($file, 'detector');
+#
+# the tag lists the options and BIN files the cube was made from
+#
+my %CUBE_LEVELS = ( subtap => 0, tap => 1, chip => 2, detector => 3 );
+
+sub read_cube {
+  my $file = shift;
+  my $level = @_ ? shift : 'subtap';
+  exists $CUBE_LEVELS{$level} or die "invalid cube level '$level'";
+  $level = $CUBE_LEVELS{$level};
+
+  open my $fh, '<', $file or die "error opening $file: $!";
+  binmode $fh;
+  my $buf = do { local $/; <$fh> };
+  close $fh;
+
+  my $magic = "hrcs_gain cube 1\n";
+  substr($buf, 0, length $magic) eq $magic or die "$file is not a cube file";
+  my $pos = length $magic;
+
+  my $len = unpack 'L', substr($buf, $pos, 4);
+  my $tag = substr($buf, $pos+4, $len);
+  $pos += 4 + $len;
+
+  my ($order, $nlevels) = unpack 'L2', substr($buf, $pos, 8);
+  $order == 0x01020304 or die "$file was written on a host of other byte order";
+  $pos += 8;
+
+  for my $l (0..$nlevels-1) {
+    my ($nbins, $nx, $ny) = unpack 'L3', substr($buf, $pos, 12);
+    $pos += 12;
+
+    my ($hists, $flat);
+    if ($l == $level) {
+      $hists = zeroes(float, $nbins, $nx, $ny);
+      $flat = $hists->clump(1,2);
+    }
+
+    for my $h (0..$nx*$ny-1) {
+      my $width = unpack 'C', substr($buf, $pos++, 1);
+      next unless $width;
+      my $fmt = { 8 => 'C*', 16 => 'S*', 32 => 'L*' }->{$width}
+	or die "corrupt cube file $file";
+      my $n = $nbins * $width / 8;
+      if ($l == $level) {
+	(my $tmp = $flat->slice(",($h)")) .= pdl(unpack $fmt, substr($buf, $pos, $n));
+      }
+      $pos += $n;
+    }
+    return wantarray ? ($hists, $tag) : $hists if $l == $level;
+  }
+  die "truncated cube file $file";
+}
+
 #
 # images of PHA stats
 #
@@ -335,6 +475,11 @@ sub hists_stats {
 
   my ($nz, $nx, $ny) = $hists->dims;
 
+  if ($NATIVE) {
+    my $s = Lab::Hists::hists_stats_native($hists, sequence(double, $nz))->float;
+    return map { $s->slice("($_)")->copy } 0..6;
+  }
+
   my $xvals = sequence($hists->type, $nz);
 
   my $mean = zeroes(float, $nx, $ny);
@@ -364,8 +509,41 @@ sub hists_stats {
   return ($mean, $prms, $median, $min, $max, $adev, $rms);
 }
 
+#
+# The compiled versions of hists_prob, hists_mean, hists_prms,
+# hists_rms, hists_adev and hists_subtract work on whole (nbins, nx, ny)
+# cubes in one pass, without PDL's cube-size temporaries. Results have
+# the type PDL would have given.
+#
+sub _native_cube {
+  my $hists = shift;
+  return $NATIVE && $hists->ndims == 3;
+}
+
+sub _native_stat {
+  my ($func, $hists, $xvals) = @_;
+  my $type = (zeroes($hists->type, 1) * zeroes($xvals->type, 1))->type;
+  return $func->($hists, $xvals)->convert($type);
+}
+
+#
+# $src -= $w * $bg, in place
+#
+sub hists_subtract {
+  my ($src, $bg, $w) = @_;
+
+  return Lab::Hists::hists_subtract_native($src, $bg->convert($src->type), $w)
+    if _native_cube($src);
+
+  $src -= $bg * $w;
+}
+
 sub hists_prob {
   my $hists = shift;
+
+  return Lab::Hists::hists_prob_native($hists)->convert($hists->type)
+    if _native_cube($hists);
+
   my $n = $hists->getdim(0);
   return $hists / $hists->sumover->dummy(0);
 }
@@ -374,6 +552,9 @@ sub hists_mean {
   my $hists = shift;
   my $xvals = @_ ? shift : sequence($hists->type, $hists->getdim(0));
 
+  return _native_stat(\&Lab::Hists::hists_mean_native, $hists, $xvals)
+    if _native_cube($hists);
+
   return ($hists * $xvals)->sumover / $hists->sumover;
 
   my $prob = hists_prob($hists);
@@ -384,6 +565,9 @@ sub hists_mean {
 sub hists_prms {
   my $hists = shift;
   my $xvals = @_ ? shift : sequence($hists->type, $hists->getdim(0));
+
+  return _native_stat(\&Lab::Hists::hists_prms_native, $hists, $xvals)
+    if _native_cube($hists);
   my $exp_x = hists_mean($hists, $xvals);
   my $prms = sqrt(
 		  ($hists * ( $xvals - $exp_x->dummy(0) )**2 )->sumover
@@ -395,6 +579,9 @@ sub hists_prms {
 sub hists_rms {
   my ($hists, $xvals) = @_;
 
+  return _native_stat(\&Lab::Hists::hists_rms_native, $hists, $xvals)
+    if _native_cube($hists);
+
   my $exp_x2 = ( $xvals * $xvals * hists_prob($hists) )->sumover;
   my $exp_x = hists_mean($hists, $xvals);
   return sqrt($exp_x2 - $exp_x * $exp_x);
@@ -404,6 +591,9 @@ sub hists_median {
   my $hists = shift;
   my ($nz, $nx, $ny) = $hists->dims;
 
+  return Lab::Hists::hists_median_native($hists, sequence(double, $nz))->float
+    if $NATIVE;
+
   my $xvals = sequence(long, $nz);
 
   my $median = zeroes(float, $nx, $ny);
@@ -427,6 +617,31 @@ sub hists_median {
   return $median;
 }
 
+#
+# The histograms of at least $mincnts counts summed by their median,
+# rounded to the nearest bin, as fit_hists2.pl and fractions.pl group
+# subtaps. Returns references to the number of histograms and to the
+# summed histogram (long) for each median bin.
+#
+sub median_stacks {
+  my ($hists, $mincnts) = @_;
+  my $nz = $hists->getdim(0);
+
+  my $flat = $hists->long->clump(1,2);
+  my $sum = $flat->sumover;
+  my $median = rint(hists_median($flat->dummy(2)))->long->flat;
+
+  my @n = (0)x$nz;
+  my @stacks = map { zeroes(long, $nz) } 1..$nz;
+  for my $i (which(($sum >= $mincnts) & ($sum > 0))->list) {
+    my $m = $median->at($i);
+    $n[$m]++;
+    $stacks[$m] += $flat->slice(",($i)");
+  }
+
+  return \(@n, @stacks);
+}
+
 # For background-subtracted data containing negative counts. Adapted
 # from the hist_stats function in genstats.pl.
 sub hist_median_float {
@@ -446,20 +661,110 @@ sub hist_median_float {
   return $median;
 }
 
-# FIXME does not agree with hists_stats above since rld pads with zeroes
+#
+# Quantiles $f of every histogram in $hists, interpolated from the
+# cumulative distributions as hist_median_float does, so they suit
+# background-subtracted counts. They are taken in the order given and
+# the first which cannot be interpolated, and all after it, are 0, as
+# in genstats.pl. Returns a piddle of dims ($f->nelem, nx, ny).
+#
+sub hists_quantiles {
+  my ($hists, $xvals, $f) = @_;
+  $f = pdl($f);
+
+  return Lab::Hists::hists_quantiles_native($hists, $xvals, $f) if $NATIVE;
+
+  my ($flat, $q) = _hists_flat($hists, $f);
+  for my $j (0..$flat->getdim(1)-1) {
+    my $y = $flat->slice(",($j)");
+    my $y_sum = $y->sum;
+    next unless $y_sum;
+    eval {
+      my $cumu_bounds = zeroes($xvals->nelem);
+      (my $tmp = $cumu_bounds->slice('0:-2')) .= ($xvals->slice('0:-2') + $xvals->slice('1:-1'))/2;
+      $cumu_bounds->set(-1, $xvals->at(-1)+($xvals->at(-1)-$xvals->at(-2))/2);
+      my $cumu = $y->cumusumover / $y_sum;
+      $q->set($_, $j, interpol($f->at($_), $cumu, $cumu_bounds)) for 0..$f->nelem-1;
+    };
+  }
+
+  return $q->reshape($f->nelem, ($hists->dims)[1..$hists->ndims-1]);
+}
+
+#
+# $hists->rld($xvals)->pct($f) for every histogram in $hists and every
+# fraction in $f, e.g., the fractions.pl percentiles. Returns a piddle
+# of dims ($f->nelem, nx, ny).
+#
+sub hists_pct {
+  my ($hists, $xvals, $f) = @_;
+  $f = pdl($f);
+
+  return Lab::Hists::hists_pct_native($hists, $xvals, $f) if $NATIVE;
+
+  my ($flat, $q) = _hists_flat($hists, $f);
+  for my $j (0..$flat->getdim(1)-1) {
+    my $y = $flat->slice(",($j)");
+    next unless $y->sum > 0;
+    my $vals = $y->rld($xvals);
+    $q->set($_, $j, $vals->pct($f->at($_))) for 0..$f->nelem-1;
+  }
+
+  return $q->reshape($f->nelem, ($hists->dims)[1..$hists->ndims-1]);
+}
+
+# the histograms of a cube along dimension 1, and room for their
+# quantiles $f
+sub _hists_flat {
+  my ($hists, $f) = @_;
+  my $flat = $hists->ndims > 1 ?
+    $hists->clump(1..$hists->ndims-1) : $hists->dummy(1);
+  return $flat, zeroes(double, $f->nelem, $flat->getdim(1));
+}
+
+#
+# move negative counts of each histogram into the next bin, in place
+#
+sub shift_negs {
+  my $hists = shift;
+
+  return Lab::Hists::shift_negs($hists) if $NATIVE;
+
+  my $flat = $hists->ndims > 1 ?
+    $hists->clump(1..$hists->ndims-1) : $hists->dummy(1);
+  my $n = $flat->getdim(0);
+  for my $j (0..$flat->getdim(1)-1) {
+    for my $i (0..$n-2) {
+      my $v = $flat->at($i, $j);
+      next unless $v < 0;
+      $flat->set($i+1, $j, $flat->at($i+1, $j) + $v);
+      $flat->set($i, $j, 0);
+    }
+  }
+}
+
+# FIXME without Lab::Hists these do not agree with hists_stats above
+# since rld pads with zeroes
 sub hists_min {
   my ($hists, $xvals) = @_;
+  return Lab::Hists::hists_stats_native($hists, $xvals)->slice('(3)')->sever
+    if $NATIVE;
   return $hists->rld($xvals)->minimum;
 }
 
 sub hists_max {
   my ($hists, $xvals) = @_;
+  return Lab::Hists::hists_stats_native($hists, $xvals)->slice('(4)')->sever
+    if $NATIVE;
   return $hists->rld($xvals)->maximum;
 }
 
 sub hists_adev {
   my ($hists, $xvals) = @_;
 
+  return _native_stat(\&Lab::Hists::hists_adev_native, $hists, $xvals)
+    if _native_cube($hists);
+
   my $n = $hists->getdim(0);
 
   my $prob = hists_prob($hists);
@@ -504,6 +809,8 @@ sub trim {
 }
 
 sub hists_trim {
+  return Lab::Hists::hists_trim_native(@_) if $NATIVE;
+
   my $hists = (shift)->copy;
   my $f = shift;
 
@@ -0,0 +1,357 @@
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cpputil/ss_cast.hh>
+#include "evtfile.hh"
+#include "subtap.hh"
+#include "stats.hh"
+#include "adaptive.hh"
+#include "thread_pool.hh"
+
+using std::cout;
+using std::cerr;
+using std::vector;
+using std::string;
+
+namespace {
+
+  namespace opts {
+    int subtaps = lab::subtaps;
+    long mincnts = 150;
+    long maxwiden = 1;
+    double trim = 0.05;
+    int threads = 0;
+    string map;
+
+    const char* version_string = "0.1";
+    int help = 0;
+    int version = 0;
+    option lopts[] = {
+      { "help",    no_argument, &help, 1 },
+      { "version", no_argument, &version, 1 },
+      { "subtaps", required_argument, 0, 's' },
+      { "mincnts", required_argument, 0, 'm' },
+      { "maxwiden", required_argument, 0, 'w' },
+      { "threads", required_argument, 0, 't' },
+      { "map",     required_argument, 0, 'M' },
+      { 0, 0, 0, 0 }
+    };
+  }
+
+  // statistics of the events of one region, as genstats reports them
+  // for a subtap without background subtraction
+  struct region_stats {
+    lab::col_stats st[lab::ndata_cols];
+  };
+
+  void region_events(const lab::subtap_grid& grid, const lab::partition& part,
+		     const lab::subtap_region& r, vector<std::size_t>& evt);
+  void compute_stats(const lab::events& src, const vector<std::size_t>& evt,
+		     region_stats& s);
+  string fmt(double d, int prec);
+  string fmt(double d);
+
+  int help();
+  int version();
+}
+
+int main(int argc, char** argv) {
+
+  int c;
+  while ((c=getopt_long_only(argc, argv, "", opts::lopts, 0))!=-1) {
+    switch (c) {
+    // a flag was set/unset on our behalf, nothing more to do
+    case 0:
+      break;
+    case 's':
+      opts::subtaps = util::ss_cast<int>(optarg);
+      break;
+    case 'm':
+      opts::mincnts = util::ss_cast<long>(optarg);
+      break;
+    case 'w':
+      opts::maxwiden = util::ss_cast<long>(optarg);
+      break;
+    case 't':
+      opts::threads = util::ss_cast<int>(optarg);
+      break;
+    case 'M':
+      opts::map = optarg;
+      break;
+    // problem occurred
+    case '?':
+    case ':':
+      cerr << "Try `--help' for more information.\n";
+      return EXIT_FAILURE;
+    // didn't handle all of our specified options
+    default:
+      cerr << "programmer error, unhandled option = "; cerr.put(c); cerr << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opts::help) return help();
+  if (opts::version) return version();
+
+  if (argc-optind != 2) {
+    cerr << "Usage: " << argv[0] << " [options] evtfile rdbfile\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    lab::subtap_grid grid(opts::subtaps);
+
+    lab::events src;
+    lab::read_events(argv[optind], src);
+
+    lab::partition part;
+    lab::partition_events(grid, src.packed, part);
+
+    vector<lab::subtap_region> regions;
+    vector<std::size_t> member;
+    lab::adaptive_regions(grid, lab::count_table(grid, part), opts::mincnts,
+			  opts::maxwiden, regions, member);
+
+    vector<region_stats> stats(regions.size());
+    lab::thread_pool pool(opts::threads);
+    lab::parallel_for(pool, regions.size(), [&](std::size_t i) {
+	vector<std::size_t> evt;
+	region_events(grid, part, regions[i], evt);
+	compute_stats(src, evt, stats[i]);
+      });
+
+    std::ofstream rdb(argv[optind+1]);
+    if (!rdb)
+      throw std::runtime_error(string("could not open ") + argv[optind+1]);
+
+    const string trim = util::ss_cast<string>(opts::trim * 100);
+    const char* prefix[lab::ndata_cols] = { "p", "s", "spimean", "spimed" };
+    vector<string> cols, types;
+    const char* cols1[] = { "region", "rawy_range", "rawx_range", "nsubtaps", "n" };
+    cols.assign(cols1, cols1+5);
+    for (int c=0; c<lab::ndata_cols; ++c) {
+      cols.push_back(string(prefix[c]) + "tmean" + trim);
+      cols.push_back(string(prefix[c]) + "rms");
+      cols.push_back(string(prefix[c]) + "med");
+    }
+    for (int c=0; c<lab::ndata_cols; ++c)
+      cols.push_back(string(prefix[c]) + "iqr");
+    types.assign(cols.size(), "N");
+    types[1] = types[2] = "S";
+
+    for (vector<string>::size_type i=0; i<cols.size(); ++i)
+      rdb << cols[i] << (i+1<cols.size() ? '\t' : '\n');
+    for (vector<string>::size_type i=0; i<types.size(); ++i)
+      rdb << types[i] << (i+1<types.size() ? '\t' : '\n');
+
+    for (vector<lab::subtap_region>::size_type i=0; i<regions.size(); ++i) {
+      const lab::subtap_region& r = regions[i];
+      long y1, y2, x1, x2, c1, c2;
+      grid.range(r.gy1, y1, c2);
+      grid.range(r.gy2, c1, y2);
+      grid.range(r.gx1, x1, c2);
+      grid.range(r.gx2, c1, x2);
+
+      rdb << i << '\t' << y1 << ':' << y2 << '\t' << x1 << ':' << x2 << '\t'
+	  << (r.gx2-r.gx1+1) * (r.gy2-r.gy1+1) << '\t' << r.n;
+      for (int c=0; c<lab::ndata_cols; ++c) {
+	const lab::col_stats& s = stats[i].st[c];
+	rdb << '\t' << fmt(s.tmean, 1) << '\t' << fmt(s.rms, 1) << '\t'
+	    << (c == lab::pha_col ? fmt(s.median) : fmt(s.median, 1));
+      }
+      for (int c=0; c<lab::ndata_cols; ++c)
+	rdb << '\t' << fmt(stats[i].st[c].iqr, 1);
+      rdb << '\n';
+    }
+
+    rdb.close();
+    if (!rdb)
+      throw std::runtime_error(string("error writing ") + argv[optind+1]);
+
+    // the region of every subtap, in genstats.pl's order
+    if (!opts::map.empty()) {
+      std::ofstream out(opts::map.c_str());
+      if (!out)
+	throw std::runtime_error("could not open " + opts::map);
+      const long nsub = grid.subtaps();
+      out << "crsv\tvsub\tcrsu\tusub\tregion\nN\tN\tN\tN\tN\n";
+      for (std::size_t gy=0; gy<grid.ny(); ++gy)
+	for (std::size_t gx=0; gx<grid.nx(); ++gx)
+	  out << gy/nsub << '\t' << gy%nsub << '\t' << gx/nsub << '\t' << gx%nsub
+	      << '\t' << member[gy * grid.nx() + gx] << '\n';
+      out.close();
+      if (!out)
+	throw std::runtime_error("error writing " + opts::map);
+    }
+  }
+  catch (std::exception& e) {
+    cerr << argv[0] << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+
+} // main
+
+namespace {
+
+  // events of the region, in file order
+  void region_events(const lab::subtap_grid& grid, const lab::partition& part,
+		     const lab::subtap_region& r, vector<std::size_t>& evt)
+  {
+    evt.clear();
+    for (std::size_t s : lab::subtap_window(grid, r.gx1, r.gx2, r.gy1, r.gy2))
+      evt.insert(evt.end(), part.order.begin() + part.offset[s],
+		 part.order.begin() + part.offset[s+1]);
+    std::sort(evt.begin(), evt.end());
+  }
+
+  void compute_stats(const lab::events& src, const vector<std::size_t>& evt,
+		     region_stats& s)
+  {
+    vector<double> vals(evt.size());
+    for (int c=0; c<lab::ndata_cols; ++c) {
+      for (vector<std::size_t>::size_type j=0; j<evt.size(); ++j)
+	vals[j] = src.value(c, evt[j]);
+      lab::data_stats(vals, opts::trim, s.st[c]);
+    }
+  }
+
+  string fmt(double d, int prec)
+  {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.*f", prec, d);
+    return buf;
+  }
+
+  // as Perl would stringify a number
+  string fmt(double d)
+  {
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "%.15g", d);
+    return buf;
+  }
+
+  int version() {
+    cout << opts::version_string << '\n';
+    return 0;
+  }
+
+  int help() {
+    const char* help_text = "\
+=head1 NAME\n\
+\n\
+adaptbin - adaptive spatial binning of an event list by counts\n\
+\n\
+=head1 SYNOPSIS\n\
+\n\
+adaptbin [options] evtfile rdbfile\n\
+\n\
+=head1 DESCRIPTION\n\
+\n\
+Divides the detector into regions of at least I<--mincnts> events\n\
+each and writes the statistics of every region to I<rdbfile>. Where\n\
+F<genstats.pl>'s subtap extension widens a subtap with few events to\n\
+a fixed 3x1 or 3x3 neighborhood, here the regions follow the counts:\n\
+each tap is split in four, or in two, for as long as every part\n\
+keeps I<--mincnts> events, down to single subtaps where the counts\n\
+allow, so with a large I<--subtaps> one run gives the finest gain map\n\
+the data support. A tap with too few events takes in its neighboring\n\
+taps instead (see I<--maxwiden>). Counts in any\n\
+block of subtaps come from a summed-area table, so binning takes\n\
+O(N log N) in the number of subtaps.\n\
+\n\
+Output columns are the region number, its rawy and rawx ranges, the\n\
+number of subtaps and events in it, and the F<genstats.pl> statistics\n\
+(trimmed mean, rms, median and IQR of PHA, SAMP, SPIMEAN and SPIMED)\n\
+of its events. Coordinates are zero-based, as in F<genstats.pl>\n\
+output.\n\
+\n\
+=head1 OPTIONS\n\
+\n\
+=over 4\n\
+\n\
+=item --help\n\
+\n\
+Print this help text and exit.\n\
+\n\
+=item --version\n\
+\n\
+Print the program version and exit.\n\
+\n\
+=item --subtaps=i\n\
+\n\
+Number of subtaps along each axis of a tap, i.e., the finest\n\
+resolution of the binning. The default is 3.\n\
+\n\
+=item --mincnts=i\n\
+\n\
+Minimum number of events in a region. The default, 150, is the count\n\
+at which F<genstats.pl> stops extending a subtap.\n\
+\n\
+=item --maxwiden=i\n\
+\n\
+A tap with fewer than I<--mincnts> events is given the events of the\n\
+taps around it, a ring at a time, up to this many taps on each side.\n\
+The default, 1, gives at most the 3x3 taps around it, which is as far\n\
+as F<genstats.pl>'s subtap extension reaches at the tap level. Regions\n\
+which still fall short are reported with their counts as they are.\n\
+\n\
+=item --map=s\n\
+\n\
+Also write an RDB file listing, for every subtap (crsv, vsub, crsu,\n\
+usub), the region it belongs to.\n\
+\n\
+=item --threads=i\n\
+\n\
+Number of threads computing region statistics. The default is one\n\
+per processor core.\n\
+\n\
+=back\n\
+\n\
+=head1 AUTHOR\n\
+\n\
+Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt>\n\
+\n\
+=head1 SEE ALSO\n\
+\n\
+genstats, genstats.pl\n\
+\n\
+=cut\n\
+";
+
+    const char* pager = std::getenv("PAGER");
+    if (!pager) pager = "more";
+
+    FILE* pd = popen((std::string("pod2text -c | ")+pager).c_str(), "w");
+    if (!pd) {
+      std::perror("error starting pod2text");
+      return EXIT_FAILURE;
+    }
+
+    int n = 0;
+    int len = std::strlen(help_text);
+    while (n < len) {
+      int written = std::fwrite(help_text, 1, len-n, pd);
+      if (!written) {
+	std::perror("error writing help");
+	return EXIT_FAILURE;
+      }
+      n+=written;
+    }
+
+    if (pclose(pd) == -1) {
+      std::perror("error writing help");
+      return EXIT_FAILURE;
+    }
+
+    return 0;
+  }
+
+}
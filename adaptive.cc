@@ -0,0 +1,129 @@
+#include <algorithm>
+#include "adaptive.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::vector;
+
+  count_table::count_table(const subtap_grid& grid, const partition& p)
+    : nx(grid.nx()), ny(grid.ny()), sum((nx+1) * (ny+1), 0)
+  {
+    const size_t w = nx + 1;
+    for (size_t gy=0; gy<ny; ++gy) {
+      long row = 0;
+      for (size_t gx=0; gx<nx; ++gx) {
+	row += p.count(grid.slot(gx, gy));
+	sum[(gy+1)*w + gx+1] = sum[gy*w + gx+1] + row;
+      }
+    }
+  }
+
+  namespace {
+
+    // split tap as finely as counts allow, appending the parts to regions
+    void split(const count_table& counts, long mincnts, const subtap_region& tap,
+	       vector<subtap_region>& regions)
+    {
+      vector<subtap_region> todo(1, tap);
+
+      while (!todo.empty()) {
+	const subtap_region r = todo.back();
+	todo.pop_back();
+
+	// candidate splits: in four, then in two along the longer axis,
+	// then along the other
+	const bool xs = r.gx2 > r.gx1, ys = r.gy2 > r.gy1;
+	const long cx = (r.gx1 + r.gx2 + 1) / 2, cy = (r.gy1 + r.gy2 + 1) / 2;
+	const bool xfirst = r.gx2 - r.gx1 >= r.gy2 - r.gy1;
+
+	subtap_region part[4];
+	int nparts = 0;
+	for (int attempt=0; attempt<3 && !nparts; ++attempt) {
+	  bool splitx, splity;
+	  if (attempt == 0)
+	    splitx = splity = xs && ys;
+	  else {
+	    splitx = (attempt == 1) == xfirst && xs;
+	    splity = (attempt == 1) != xfirst && ys;
+	  }
+	  if (!splitx && !splity)
+	    continue;
+
+	  const long xe[3] = { r.gx1, splitx ? cx : r.gx2+1, r.gx2+1 };
+	  const long ye[3] = { r.gy1, splity ? cy : r.gy2+1, r.gy2+1 };
+	  int n = 0;
+	  bool ok = true;
+	  for (int j=0; j<2 && ok; ++j)
+	    for (int i=0; i<2 && ok; ++i) {
+	      if (xe[i] == xe[i+1] || ye[j] == ye[j+1])
+		continue;
+	      subtap_region& p = part[n++];
+	      p.gx1 = xe[i];
+	      p.gx2 = xe[i+1]-1;
+	      p.gy1 = ye[j];
+	      p.gy2 = ye[j+1]-1;
+	      p.n = counts.count(p.gx1, p.gx2, p.gy1, p.gy2);
+	      ok = p.n >= mincnts;
+	    }
+	  if (ok)
+	    nparts = n;
+	}
+
+	if (nparts)
+	  todo.insert(todo.end(), part, part+nparts);
+	else
+	  regions.push_back(r);
+      }
+    }
+
+  }
+
+  void adaptive_regions(const subtap_grid& grid, const count_table& counts,
+			long mincnts, long maxwiden,
+			vector<subtap_region>& regions, vector<size_t>& member)
+  {
+    const long nsub = grid.subtaps();
+    const long ntx = grid.nx() / nsub, nty = grid.ny() / nsub;
+
+    regions.clear();
+    member.assign(grid.size(), 0);
+
+    for (long ty=0; ty<nty; ++ty)
+      for (long tx=0; tx<ntx; ++tx) {
+	subtap_region tap = { tx*nsub, (tx+1)*nsub-1, ty*nsub, (ty+1)*nsub-1, 0 };
+	tap.n = counts.count(tap.gx1, tap.gx2, tap.gy1, tap.gy2);
+
+	const size_t first = regions.size();
+	if (tap.n >= mincnts)
+	  split(counts, mincnts, tap, regions);
+
+	// widen a sparse tap a ring of taps at a time
+	else {
+	  subtap_region r = tap;
+	  for (long k=1; r.n < mincnts && k <= maxwiden; ++k) {
+	    r.gx1 = std::max(tx-k, 0L) * nsub;
+	    r.gx2 = (std::min(tx+k, ntx-1) + 1) * nsub - 1;
+	    r.gy1 = std::max(ty-k, 0L) * nsub;
+	    r.gy2 = (std::min(ty+k, nty-1) + 1) * nsub - 1;
+	    r.n = counts.count(r.gx1, r.gx2, r.gy1, r.gy2);
+	  }
+	  regions.push_back(r);
+
+	  // only the tap's own subtaps are members
+	  for (long gy=tap.gy1; gy<=tap.gy2; ++gy)
+	    for (long gx=tap.gx1; gx<=tap.gx2; ++gx)
+	      member[gy * grid.nx() + gx] = first;
+	  continue;
+	}
+
+	for (size_t i=first; i<regions.size(); ++i) {
+	  const subtap_region& r = regions[i];
+	  for (long gy=r.gy1; gy<=r.gy2; ++gy)
+	    for (long gx=r.gx1; gx<=r.gx2; ++gx)
+	      member[gy * grid.nx() + gx] = i;
+	}
+      }
+  }
+
+} // namespace lab
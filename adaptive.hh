@@ -0,0 +1,55 @@
+#ifndef ADAPTIVE_HH
+#define ADAPTIVE_HH
+
+#include <cstddef>
+#include <vector>
+#include "subtap.hh"
+
+namespace lab {
+
+  // Summed-area table of the events in each subtap of a partition,
+  // giving the count in any rectangle of subtaps in constant time.
+  class count_table {
+  private:
+    std::size_t nx, ny;
+    std::vector<long> sum;          // [(gy+1) * (nx+1) + gx+1], inclusive
+
+  public:
+
+    count_table(const subtap_grid& grid, const partition& p);
+
+    // events in subtaps [gx1, gx2] x [gy1, gy2], which must be on the grid
+    long count(long gx1, long gx2, long gy1, long gy2) const
+    {
+      const std::size_t w = nx + 1;
+      return sum[(gy2+1)*w + gx2+1] - sum[gy1*w + gx2+1]
+	- sum[(gy2+1)*w + gx1] + sum[gy1*w + gx1];
+    }
+  };
+
+  // a rectangle of subtaps [gx1, gx2] x [gy1, gy2] and its events
+  struct subtap_region {
+    long gx1, gx2, gy1, gy2;
+    long n;
+  };
+
+  // Adaptive binning of the grid into regions of at least mincnts
+  // events. A tap with mincnts events is split in four, or failing
+  // that in two along either axis, for as long as every part keeps
+  // mincnts events, down to single subtaps where the counts allow. A
+  // tap with fewer events is, as with genstats.pl's subtap extension,
+  // given the smallest square of whole taps centered on it which has
+  // mincnts events, up to maxwiden taps on each side; such regions
+  // overlap their neighbors. Only those which reach that limit can
+  // have fewer than mincnts events.
+  //
+  // member[gy * nx + gx] is set to the index in regions of the region
+  // assigned to subtap (gx, gy).
+  void adaptive_regions(const subtap_grid& grid, const count_table& counts,
+			long mincnts, long maxwiden,
+			std::vector<subtap_region>& regions,
+			std::vector<std::size_t>& member);
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef ARENA_HH
+#define ARENA_HH
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+namespace lab {
+
+  // Scratch memory for one unit of work (e.g., a subtap) at a time:
+  // alloc() hands out pieces of a single block and reset() takes them
+  // all back at once. Requests which do not fit are satisfied from
+  // the heap, and the next reset() grows the block to the high water
+  // mark, so that once the largest unit has been seen no further heap
+  // allocations are made. Not thread safe, each thread keeps its own.
+  class arena {
+  private:
+    typedef std::max_align_t word;
+
+    std::unique_ptr<word[]> block;
+    std::size_t size, used, peak;
+    std::vector< std::unique_ptr<word[]> > spill;
+
+    arena(const arena&);
+    arena& operator=(const arena&);
+
+  public:
+
+    arena() : size(0), used(0), peak(0) { }
+
+    // uninitialized space for n objects of a trivial type T
+    template <class T>
+      T* alloc(std::size_t n)
+    {
+      static_assert(std::is_trivial<T>::value, "arena objects are not destroyed");
+      const std::size_t nwords = (n * sizeof(T) + sizeof(word) - 1) / sizeof(word);
+
+      peak += nwords;
+      if (used + nwords <= size) {
+	T* p = reinterpret_cast<T*>(block.get() + used);
+	used += nwords;
+	return p;
+      }
+
+      spill.push_back(std::unique_ptr<word[]>(new word[nwords]));
+      return reinterpret_cast<T*>(spill.back().get());
+    }
+
+    void reset()
+    {
+      if (!spill.empty()) {
+	spill.clear();
+	block.reset(new word[peak]);
+	size = peak;
+      }
+      used = peak = 0;
+    }
+
+  };
+
+} // namespace lab
+
+#endif
@@ -92,7 +92,7 @@ my $bg_hists = Lab::bg_hists($opts{bgfile}?($opts{bgfile}) : ());
 $bg_hists = Lab::three_by_three($bg_hists) if $opts{'3x3'};
 
 if ($opts{mask}) {
-  (my $tmp = Lab::hists_indexND($bg_hists, scalar whichND(!Lab::active_mask_bg_noiffyv()))) .= 0;
+  Lab::hists_mask($bg_hists, Lab::active_mask_bg_noiffyv());
 }
 
 #
@@ -156,7 +156,7 @@ for (0..$#anodes) {
   $src_hists = Lab::three_by_three($src_hists) if $opts{'3x3'};
 
   if ($opts{mask}) {
-    (my $tmp = Lab::hists_indexND($src_hists, scalar whichND(!Lab::active_mask_src_noiffyv()))) .= 0;
+    Lab::hists_mask($src_hists, Lab::active_mask_src_noiffyv());
   }
 
   if ($opts{bgsubtract} and $anode eq 'B-Ka') {
@@ -169,7 +169,7 @@ for (0..$#anodes) {
 		    'Al-Ka' => 2,
 		    );
     die $anode unless exists $exptimes{$anode};
-    $src_hists -= $bg_hists * ($exptimes{$anode} / 66);
+    Lab::hists_subtract($src_hists, $bg_hists, $exptimes{$anode} / 66);
   }
 
   my $src_n = $src_hists->sumover;
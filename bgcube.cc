@@ -0,0 +1,78 @@
+#include <stdexcept>
+#include <algorithm>
+#include "lab.hh"
+#include "bgcube.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::vector;
+  using std::map;
+
+  bgcube::bgcube(const subtap_grid& g, const map<int, double>& bgtimes)
+    : grid(g), nsubtaps(grid.size()), total(nsubtaps, 0.), counts(nsubtaps, 0)
+  {
+    for (int c=0; c<ndata_cols; ++c)
+      rates[c].assign(nsubtaps * nbins(data_col_names[c]), 0.f);
+
+    // 1 / exposure time for each chip
+    std::fill(w, w+4, 0.);
+    for (map<int, double>::const_iterator it=bgtimes.begin(); it!=bgtimes.end(); ++it)
+      if (it->first >= 1 && it->first <= 3 && it->second > 0)
+	w[it->first] = 1 / it->second;
+  }
+
+  bgcube::bgcube(const subtap_grid& g, const events& bg,
+		 const map<int, double>& bgtimes)
+    : bgcube(g, bgtimes)
+  {
+    add(bg);
+  }
+
+  void bgcube::add(const events& bg)
+  {
+    for (size_t i=0; i<bg.size(); ++i) {
+      const packed_event& e = bg.packed[i];
+      long s = grid.index(e.rawx(), e.rawy());
+      if (s < 0)
+	continue;
+
+      int chip = e.chip_id();
+      if (!chip)
+	throw std::invalid_argument("background events lack chip_id");
+      if (!w[chip])
+	throw std::runtime_error("no background exposure time for chip_id");
+
+      ++counts[s];
+      total[s] += w[chip];
+
+      for (int c=0; c<ndata_cols; ++c) {
+	const long n = nbins(data_col_names[c]);
+	// bin as PDL's hist(data, -0.5, n-0.5, 1)
+	double d = bg.value(c, i) + 0.5;
+	if (d < 0)
+	  continue;
+	long j = static_cast<long>(d);
+	if (j < n)
+	  rates[c][s * n + j] += w[chip];
+      }
+    }
+  }
+
+  double bgcube::subtract(const size_t* subtaps, size_t nsub, double scale,
+			  int col, double* y) const
+  {
+    const size_t n = nbins(data_col_names[col]);
+    double r = 0;
+
+    for (size_t i=0; i<nsub; ++i) {
+      const float* h = hist(subtaps[i], col);
+      for (size_t j=0; j<n; ++j)
+	y[j] -= scale * h[j];
+      r += total[subtaps[i]];
+    }
+
+    return scale * r;
+  }
+
+} // namespace lab
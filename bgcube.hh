@@ -0,0 +1,60 @@
+#ifndef BGCUBE_HH
+#define BGCUBE_HH
+
+#include <cstddef>
+#include <vector>
+#include <map>
+#include "lab.hh"
+#include "evtfile.hh"
+#include "subtap.hh"
+
+namespace lab {
+
+  // Exposure-normalized histograms of the merged background for every
+  // 1x1 subtap, built in a single pass over the background events.
+  // Each event is weighted by 1/bgtimes[chip_id], so that the
+  // background expected in a test of exposure t over any union of
+  // subtaps is just t times the sum of their rate histograms. This
+  // replaces re-filtering the background event list in lockstep with
+  // the source and re-histogramming it for every subtap.
+  class bgcube {
+  private:
+    const subtap_grid& grid;
+    double w[4];                           // 1/exposure for each chip_id
+    std::size_t nsubtaps;
+    std::vector<float> rates[ndata_cols];  // counts/s, [subtap][bin]
+    std::vector<double> total;             // events/s in each subtap
+    std::vector<long> counts;              // events in each subtap
+
+  public:
+
+    bgcube(const subtap_grid& grid, const events& bg,
+	   const std::map<int, double>& bgtimes);
+
+    // an empty cube, to be filled a chunk of events at a time with
+    // add() so that the background list need not fit in memory
+    bgcube(const subtap_grid& grid, const std::map<int, double>& bgtimes);
+
+    void add(const events& bg);
+
+    std::size_t size() const { return nsubtaps; }
+
+    // raw number of background events in subtap
+    long count(std::size_t subtap) const { return counts[subtap]; }
+
+    // background event rate in subtap
+    double rate(std::size_t subtap) const { return total[subtap]; }
+
+    const float* hist(std::size_t subtap, int col) const
+    { return &rates[col][subtap * nbins(data_col_names[col])]; }
+
+    // y[] -= scale * background rate histogram summed over the n subtaps,
+    // returns scale * the summed background event rate
+    double subtract(const std::size_t* subtaps, std::size_t n, double scale,
+		    int col, double* y) const;
+
+  };
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,207 @@
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include "bootstrap.hh"
+
+namespace lab {
+
+  using std::size_t;
+
+  namespace {
+
+    // log of the binomial probability of k of n at log(p), log(1-p)
+    double log_pmf(long n, long k, double lp, double lq)
+    {
+      return std::lgamma(n+1.) - std::lgamma(k+1.) - std::lgamma(n-k+1.)
+	+ k * lp + (n-k) * lq;
+    }
+
+    // se from the statistics st[5*nrep] of the replicates
+    void replicate_se(const double* st, int nrep, col_stats& se)
+    {
+      double sd[5];
+      for (int j=0; j<5; ++j) {
+	double m = 0;
+	for (int r=0; r<nrep; ++r)
+	  m += st[5*r+j];
+	m /= nrep;
+	double ss = 0;
+	for (int r=0; r<nrep; ++r)
+	  ss += (st[5*r+j] - m) * (st[5*r+j] - m);
+	sd[j] = std::sqrt(ss / (nrep-1));
+      }
+
+      se.mean = sd[0];
+      se.tmean = sd[1];
+      se.rms = sd[2];
+      se.median = sd[3];
+      se.iqr = sd[4];
+    }
+
+    void keep(const col_stats& s, double* st)
+    {
+      st[0] = s.mean;
+      st[1] = s.tmean;
+      st[2] = s.rms;
+      st[3] = s.median;
+      st[4] = s.iqr;
+    }
+
+  }
+
+  long binomial(counter_rng& rng, long n, double p)
+  {
+    if (n <= 0 || p <= 0)
+      return 0;
+    if (p >= 1)
+      return n;
+
+    // draw the rarer outcome
+    if (p > 0.5)
+      return n - binomial(rng, n, 1-p);
+
+    const double q = 1-p, r = p / q;
+    double u = rng.uniform();
+
+    // inversion from zero, for few expected successes
+    if (n * p < 16) {
+      double f = std::pow(q, double(n));
+      for (long k=0; k<n; ++k) {
+	if (u < f)
+	  return k;
+	u -= f;
+	f *= r * (n-k) / (k+1);
+      }
+      return n;
+    }
+
+    // otherwise inversion outwards from the mode, taking about
+    // sqrt(npq) steps
+    const long m = long((n+1) * p);
+    const double fm = std::exp(log_pmf(n, m, std::log(p), std::log(q)));
+    if (u < fm)
+      return m;
+    u -= fm;
+
+    long lo = m, hi = m;
+    double flo = fm, fhi = fm;
+    while (lo > 0 || hi < n) {
+      if (hi < n) {
+	fhi *= r * (n-hi) / (hi+1);
+	++hi;
+	if (u < fhi)
+	  return hi;
+	u -= fhi;
+      }
+      if (lo > 0) {
+	flo *= lo / (r * (n-lo+1));
+	--lo;
+	if (u < flo)
+	  return lo;
+	u -= flo;
+      }
+    }
+    return m;  // u beyond the sum of the pmf by rounding
+  }
+
+  void multinomial(counter_rng& rng, const double* y, size_t nbins,
+		   long total, double* n)
+  {
+    // conditional binomials, each bin given what is left for the rest
+    double left = 0;
+    for (size_t i=0; i<nbins; ++i)
+      if (y[i] > 0)
+	left += y[i];
+
+    long remaining = total;
+    for (size_t i=0; i<nbins; ++i) {
+      n[i] = 0;
+      if (!(y[i] > 0) || remaining <= 0)
+	continue;
+      const long k = y[i] >= left ? remaining : binomial(rng, remaining, y[i] / left);
+      n[i] = k;
+      remaining -= k;
+      left -= y[i];
+    }
+  }
+
+  void hist_bootstrap(counter_rng& rng, const double* y, const double* bg,
+		      size_t nbins, double trim, int nrep, col_stats& se,
+		      arena& scratch)
+  {
+    se = col_stats();
+
+    long total = 0;
+    for (size_t i=0; i<nbins; ++i)
+      if (y[i] > 0)
+	total += long(y[i] + 0.5);
+    if (nrep < 2 || !total)
+      return;
+
+    double* rep = scratch.alloc<double>(nbins);
+    double* st = scratch.alloc<double>(5 * nrep);
+
+    // hist_stats() takes its working storage from an arena of its own,
+    // emptied for every replicate
+    static thread_local arena work;
+
+    for (int r=0; r<nrep; ++r) {
+      multinomial(rng, y, nbins, total, rep);
+      if (bg)
+	for (size_t i=0; i<nbins; ++i)
+	  rep[i] -= bg[i];
+
+      col_stats s;
+      work.reset();
+      hist_stats(rep, nbins, trim, s, work);
+      keep(s, st + 5*r);
+    }
+
+    replicate_se(st, nrep, se);
+  }
+
+  void data_bootstrap(counter_rng& rng, const double* vals, size_t n,
+		      double trim, int nrep, col_stats& se, arena& scratch)
+  {
+    se = col_stats();
+    if (nrep < 2 || !n)
+      return;
+
+    // the distinct values and how often each occurs, which for
+    // integer PHA are far fewer than the events
+    double* u = scratch.alloc<double>(n);
+    std::copy(vals, vals+n, u);
+    std::sort(u, u+n);
+    double* w = scratch.alloc<double>(n);
+    size_t nu = 0;
+    for (size_t i=0; i<n; ++i) {
+      if (nu && u[i] == u[nu-1])
+	++w[nu-1];
+      else {
+	u[nu] = u[i];
+	w[nu++] = 1;
+      }
+    }
+
+    double* cnt = scratch.alloc<double>(nu);
+    double* rep = scratch.alloc<double>(n);
+    double* st = scratch.alloc<double>(5 * nrep);
+
+    // each replicate is n events drawn with replacement, expanded in
+    // order from the draws of each distinct value
+    for (int r=0; r<nrep; ++r) {
+      multinomial(rng, w, nu, n, cnt);
+      size_t k = 0;
+      for (size_t j=0; j<nu; ++j)
+	for (long c=long(cnt[j]); c>0; --c)
+	  rep[k++] = u[j];
+
+      col_stats s;
+      data_stats(rep, n, trim, s);
+      keep(s, st + 5*r);
+    }
+
+    replicate_se(st, nrep, se);
+  }
+
+} // namespace lab
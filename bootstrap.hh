@@ -0,0 +1,64 @@
+#ifndef BOOTSTRAP_HH
+#define BOOTSTRAP_HH
+
+#include <cstddef>
+#include <cstdint>
+#include "stats.hh"
+
+namespace lab {
+
+  // A counter-based random number generator: the nth number of stream
+  // s under key k is a fixed function of (k, s, n), so that each
+  // subtap can draw from its own stream, on whichever thread, and the
+  // results depend neither on the number of threads nor on the order
+  // in which subtaps are processed.
+  class counter_rng {
+  private:
+    std::uint64_t key, ctr;
+
+    static std::uint64_t mix(std::uint64_t z)
+    {
+      // splitmix64's finalizer
+      z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+      z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+      return z ^ (z >> 31);
+    }
+
+  public:
+
+    counter_rng(std::uint64_t seed, std::uint64_t stream)
+      : key(mix(seed + 0x9e3779b97f4a7c15ULL * (stream + 1))), ctr(0) { }
+
+    std::uint64_t next() { return mix(key + 0x9e3779b97f4a7c15ULL * ++ctr); }
+
+    // uniform on [0, 1)
+    double uniform() { return (next() >> 11) * (1.0 / 9007199254740992.0); }
+  };
+
+  // a draw from the binomial distribution of n trials of probability p
+  long binomial(counter_rng& rng, long n, double p);
+
+  // n[nbins], the bins of a histogram of total events drawn with
+  // probabilities proportional to y[nbins]
+  void multinomial(counter_rng& rng, const double* y, std::size_t nbins,
+		   long total, double* n);
+
+  // Bootstrap standard errors of the hist_stats() statistics of a
+  // histogram of counts y[nbins], from nrep histograms of the same
+  // total resampled multinomially from y. If bg is given, bg[nbins] is
+  // subtracted from each resampled histogram, i.e., the background is
+  // taken as known, as when genstats subtracts it. se.mean, .tmean,
+  // .rms, .median and .iqr are the standard deviations of those
+  // statistics over the replicates.
+  void hist_bootstrap(counter_rng& rng, const double* y, const double* bg,
+		      std::size_t nbins, double trim, int nrep, col_stats& se,
+		      arena& scratch);
+
+  // The same for the data_stats() statistics of n event values vals,
+  // from nrep resamplings of the events with replacement.
+  void data_bootstrap(counter_rng& rng, const double* vals, std::size_t n,
+		      double trim, int nrep, col_stats& se, arena& scratch);
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,185 @@
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cache.hh"
+
+namespace lab {
+
+  using std::string;
+  using std::size_t;
+
+  namespace {
+
+    bool file_stat(const string& file, long long& size, long long& mtime)
+    {
+      struct stat st;
+      if (stat(file.c_str(), &st))
+	return false;
+      size = st.st_size;
+      mtime = st.st_mtime;
+      return true;
+    }
+
+  }
+
+  digest& digest::add(const void* p, size_t n)
+  {
+    const unsigned char* c = static_cast<const unsigned char*>(p);
+    for (size_t i=0; i<n; ++i) {
+      h ^= c[i];
+      h *= 1099511628211ULL;
+    }
+    return *this;
+  }
+
+  // the length keeps ("ab", "c") and ("a", "bc") apart
+  digest& digest::add(const string& s)
+  {
+    add(static_cast<long>(s.size()));
+    return add(s.data(), s.size());
+  }
+
+  digest& digest::add(long l)
+  {
+    return add(&l, sizeof(l));
+  }
+
+  digest& digest::add(double d)
+  {
+    return add(&d, sizeof(d));
+  }
+
+  digest& digest::add_file(const string& file)
+  {
+    long long size, mtime;
+    if (!file_stat(file, size, mtime))
+      throw std::runtime_error("could not stat " + file);
+    add(file);
+    add(&size, sizeof(size));
+    return add(&mtime, sizeof(mtime));
+  }
+
+  string digest::hex() const
+  {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(h));
+    return buf;
+  }
+
+  result_cache::result_cache(const string& dir, const string& name)
+    : manifest(dir + '/' + name)
+  {
+    // a missing or unreadable manifest just means nothing is current
+    std::ifstream in(manifest.c_str());
+    string line;
+    while (std::getline(in, line)) {
+      std::istringstream ss(line);
+      string file;
+      entry e;
+      if (std::getline(ss, file, '\t') && ss >> e.digest >> e.size >> e.mtime)
+	entries[file] = e;
+    }
+  }
+
+  bool result_cache::current(const string& file, const string& d)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::map<string, entry>::const_iterator it = entries.find(file);
+    if (it == entries.end() || it->second.digest != d)
+      return false;
+
+    long long size, mtime;
+    return file_stat(file, size, mtime)
+      && size == it->second.size && mtime == it->second.mtime;
+  }
+
+  void result_cache::update(const string& file, const string& d)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    entry e;
+    e.digest = d;
+    if (!file_stat(file, e.size, e.mtime))
+      throw std::runtime_error("could not stat " + file);
+    entries[file] = e;
+
+    save();
+  }
+
+  // written aside and renamed, so an interrupted run leaves the old
+  // manifest intact
+  void result_cache::save()
+  {
+    string tmp = manifest + ".tmp";
+    std::ofstream out(tmp.c_str());
+    for (std::map<string, entry>::const_iterator it=entries.begin();
+	 it!=entries.end(); ++it)
+      out << it->first << '\t' << it->second.digest << '\t'
+	  << it->second.size << '\t' << it->second.mtime << '\n';
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), manifest.c_str()))
+      throw std::runtime_error("error writing " + manifest);
+  }
+
+  void save_checkpoint(const string& file, checkpoint& c)
+  {
+    c.sizes.resize(c.files.size());
+    for (std::vector<string>::size_type i=0; i<c.files.size(); ++i) {
+      long long mtime;
+      if (!file_stat(c.files[i], c.sizes[i], mtime))
+	throw std::runtime_error("could not stat " + c.files[i]);
+    }
+
+    string tmp = file + ".tmp";
+    std::ofstream out(tmp.c_str());
+    out << "done\t" << c.done << '\n';
+    for (std::vector<string>::size_type i=0; i<c.files.size(); ++i)
+      out << c.files[i] << '\t' << c.digests[i] << '\t' << c.sizes[i] << '\n';
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), file.c_str()))
+      throw std::runtime_error("error writing " + file);
+  }
+
+  bool resume_checkpoint(const string& file, checkpoint& c)
+  {
+    c.done = 0;
+    c.sizes.assign(c.files.size(), 0);
+
+    std::ifstream in(file.c_str());
+    string line, tag;
+    std::size_t done;
+    if (!std::getline(in, line) || !(std::istringstream(line) >> tag >> done)
+	|| tag != "done")
+      return false;
+
+    std::vector<string>::size_type n = 0;
+    while (std::getline(in, line)) {
+      std::istringstream ss(line);
+      string f, d;
+      long long size, cursize, mtime;
+      if (!std::getline(ss, f, '\t') || !(ss >> d >> size)
+	  || n >= c.files.size() || f != c.files[n] || d != c.digests[n]
+	  || !file_stat(f, cursize, mtime) || cursize < size)
+	return false;
+      c.sizes[n++] = size;
+    }
+    if (n != c.files.size())
+      return false;
+
+    // drop whatever was written after the checkpoint
+    for (n=0; n<c.files.size(); ++n)
+      if (truncate(c.files[n].c_str(), c.sizes[n]))
+	throw std::runtime_error("could not truncate " + c.files[n]);
+
+    c.done = done;
+    return true;
+  }
+
+} // namespace lab
@@ -0,0 +1,94 @@
+#ifndef CACHE_HH
+#define CACHE_HH
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+
+namespace lab {
+
+  // 64 bit FNV-1a digest, fed incrementally with the inputs an output
+  // depends on
+  class digest {
+  private:
+    std::uint64_t h;
+
+  public:
+
+    digest() : h(14695981039346656037ULL) { }
+
+    digest& add(const void* p, std::size_t n);
+    digest& add(const std::string& s);
+    digest& add(long l);
+    digest& add(double d);
+
+    // the identity of a file: its name, size and modification time,
+    // which is cheaper than hashing event lists of several hundred MB
+    digest& add_file(const std::string& file);
+
+    std::string hex() const;
+  };
+
+  // Tracks which output files are current. A manifest in the output
+  // directory records, for each output file, the digest of its inputs
+  // along with its own size and modification time, so that an output
+  // which was removed or rewritten by other means is not mistaken for
+  // current.
+  class result_cache {
+  private:
+
+    struct entry {
+      std::string digest;
+      long long size, mtime;
+    };
+
+    std::string manifest;
+    std::map<std::string, entry> entries;
+    std::mutex mtx;
+
+    void save();
+
+    result_cache(const result_cache&);
+    result_cache& operator=(const result_cache&);
+
+  public:
+
+    explicit result_cache(const std::string& dir,
+			  const std::string& name = ".genstats_cache");
+
+    // whether file exists and was made from inputs with digest d
+    bool current(const std::string& file, const std::string& d);
+
+    // record that file was just made from inputs with digest d
+    void update(const std::string& file, const std::string& d);
+
+  };
+
+  // Progress of a long run: the number of units (rows, subtaps, ...)
+  // done, and the output files written so far with the digest of the
+  // inputs each is made from and its size when the checkpoint was
+  // taken.
+  struct checkpoint {
+    std::size_t done;
+    std::vector<std::string> files, digests;
+    std::vector<long long> sizes;
+
+    checkpoint() : done(0) { }
+  };
+
+  // Record c, with the current sizes of its files, in file. The
+  // outputs must have been flushed. Written aside and renamed, so that
+  // an interrupted save leaves the previous checkpoint.
+  void save_checkpoint(const std::string& file, checkpoint& c);
+
+  // If file holds a checkpoint for the same files and digests as c,
+  // truncate the files to their checkpointed sizes, set c.done and
+  // return true. Otherwise, including when there is no checkpoint,
+  // return false and leave c.done at 0.
+  bool resume_checkpoint(const std::string& file, checkpoint& c);
+
+} // namespace lab
+
+#endif
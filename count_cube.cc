@@ -0,0 +1,148 @@
+#include <algorithm>
+#include <limits>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include "count_cube.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::uint8_t;
+  using std::uint16_t;
+  using std::uint32_t;
+  using std::uint64_t;
+
+  count_cube::count_cube(size_t nbins, size_t nx, size_t ny, int width)
+    : n(nbins), nxsub(nx), nysub(ny), initial(width), blocks(nx * ny)
+  {
+    if (width != 8 && width != 16)
+      throw std::invalid_argument("initial counter width must be 8 or 16 bits");
+  }
+
+  count_cube::count_cube(std::istream& in)
+    : n(0), nxsub(0), nysub(0), initial(8)
+  {
+    uint32_t dims[3];
+    if (!in.read(reinterpret_cast<char*>(dims), sizeof(dims)))
+      throw std::runtime_error("truncated cube");
+    n = dims[0];
+    nxsub = dims[1];
+    nysub = dims[2];
+    blocks.resize(nxsub * nysub);
+
+    for (size_t h=0; h<blocks.size(); ++h) {
+      block& b = blocks[h];
+      const int w = in.get();
+      char* p;
+      switch (w) {
+      case 0: continue;
+      case 8: b.c8.reset(new uint8_t[n]); p = reinterpret_cast<char*>(b.c8.get()); break;
+      case 16: b.c16.reset(new uint16_t[n]); p = reinterpret_cast<char*>(b.c16.get()); break;
+      case 32: b.c32.reset(new uint32_t[n]); p = reinterpret_cast<char*>(b.c32.get()); break;
+      default: throw std::runtime_error("truncated or corrupt cube");
+      }
+      b.width = w;
+      if (!in.read(p, n * w / 8))
+	throw std::runtime_error("truncated cube");
+    }
+  }
+
+  void count_cube::write(std::ostream& out) const
+  {
+    const uint32_t dims[3] = { uint32_t(n), uint32_t(nxsub), uint32_t(nysub) };
+    out.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+
+    for (size_t h=0; h<blocks.size(); ++h) {
+      const block& b = blocks[h];
+      out.put(char(b.width));
+      switch (b.width) {
+      case 8: out.write(reinterpret_cast<const char*>(b.c8.get()), n); break;
+      case 16: out.write(reinterpret_cast<const char*>(b.c16.get()), n*2); break;
+      case 32: out.write(reinterpret_cast<const char*>(b.c32.get()), n*4); break;
+      }
+    }
+  }
+
+  void count_cube::reserve(block& b, uint64_t max)
+  {
+    int w = b.width ? b.width : initial;
+    while (w < 32 && max > (uint64_t(1) << w) - 1)
+      w *= 2;
+    if (max > std::numeric_limits<uint32_t>::max())
+      throw std::overflow_error("histogram count exceeds 32 bits");
+    if (w == b.width)
+      return;
+
+    // counts so far, none if the block is new
+    std::vector<uint32_t> old(n, 0);
+    switch (b.width) {
+    case 8: copy_from(b.c8.get(), n, old.data()); break;
+    case 16: copy_from(b.c16.get(), n, old.data()); break;
+    }
+    b.c8.reset();
+    b.c16.reset();
+
+    switch (w) {
+    case 8:
+      b.c8.reset(new uint8_t[n]);
+      copy_from(old.data(), n, b.c8.get());
+      break;
+    case 16:
+      b.c16.reset(new uint16_t[n]);
+      copy_from(old.data(), n, b.c16.get());
+      break;
+    default:
+      b.c32.reset(new uint32_t[n]);
+      copy_from(old.data(), n, b.c32.get());
+      break;
+    }
+    b.width = w;
+  }
+
+  void count_cube::add(size_t h, size_t bin, uint32_t k)
+  {
+    if (!k)
+      return;
+    block& b = blocks[h];
+    reserve(b, uint64_t((*this)(h, bin)) + k);
+    switch (b.width) {
+    case 8: b.c8[bin] += k; break;
+    case 16: b.c16[bin] += k; break;
+    default: b.c32[bin] += k; break;
+    }
+  }
+
+  size_t count_cube::bytes() const
+  {
+    size_t sum = 0;
+    for (size_t h=0; h<blocks.size(); ++h)
+      sum += n * blocks[h].width / 8;
+    return sum;
+  }
+
+  uint64_t count_cube::total(size_t h) const
+  {
+    uint64_t sum = 0;
+    for (size_t i=0; i<n; ++i)
+      sum += (*this)(h, i);
+    return sum;
+  }
+
+  void add_binfile(count_cube& cube, const std::string& file,
+		   long rawy_lo, long rawy_hi, size_t subtaps)
+  {
+    binfile_input in(file, cube.nbins());
+    int ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2;
+    std::vector<int> x, y;
+    while (in.next_subtap(ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2, x, y)) {
+      if (rawy_lo >= 0 && (y1 < rawy_lo || y2 > rawy_hi))
+	continue;
+      const size_t gx = xtap * subtaps + xsubtap, gy = ytap * subtaps + ysubtap;
+      if (gx >= cube.nx() || gy >= cube.ny())
+	throw binfile_error("subtap off the edge of the cube in " + file);
+      cube.add(gy * cube.nx() + gx, y.data());
+    }
+  }
+
+} // namespace lab
@@ -0,0 +1,154 @@
+#ifndef COUNT_CUBE_HH
+#define COUNT_CUBE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include "lab.hh"
+
+namespace lab {
+
+  // Histograms of nbins nonnegative integer counts for every one of nx
+  // by ny subtaps, e.g., the contents of a BIN file as Lab::zero_hists
+  // and add_to_hists build them, laid out as in Lab.pm: histogram h is
+  // subtap gy * nx + gx. Most subtap bins hold a handful of counts, so
+  // rather than 32 bits for each, every histogram is stored with the
+  // narrowest counters its contents need: nothing at all until it is
+  // first added to, then 8 (or 16) bits, widened to 16 and then 32
+  // bits only when a count would overflow. Readers see plain counts
+  // whatever the width. Histograms may be added to from several
+  // threads at once as long as no two add to the same one.
+  class count_cube {
+  private:
+    struct block {
+      unsigned char width;                 // bits per counter, 0 if empty
+      std::unique_ptr<std::uint8_t[]> c8;
+      std::unique_ptr<std::uint16_t[]> c16;
+      std::unique_ptr<std::uint32_t[]> c32;
+      block() : width(0) { }
+    };
+
+    std::size_t n, nxsub, nysub;
+    int initial;
+    std::vector<block> blocks;
+
+    // widen block to hold counts up to max
+    void reserve(block& b, std::uint64_t max);
+
+    template <class C, class T>
+      static void add_to(C* c, std::size_t nbins, const T* y)
+    {
+      for (std::size_t i=0; i<nbins; ++i)
+	c[i] = static_cast<C>(c[i] + static_cast<std::uint32_t>(y[i]));
+    }
+
+    template <class C, class T>
+      static void copy_from(const C* c, std::size_t nbins, T* out)
+    {
+      for (std::size_t i=0; i<nbins; ++i)
+	out[i] = static_cast<T>(c[i]);
+    }
+
+    count_cube(const count_cube&);
+    count_cube& operator=(const count_cube&);
+
+  public:
+
+    // width is that of the counters a histogram starts out with, 8 or 16
+    count_cube(std::size_t nbins, std::size_t nx, std::size_t ny, int width = 8);
+
+    // a cube as written by write(), throws std::runtime_error if in
+    // does not hold one
+    explicit count_cube(std::istream& in);
+
+    // Three 32 bit words nbins, nx and ny, then for each histogram a
+    // byte giving the width of its counters and the counters
+    // themselves, all in the byte order of the host.
+    void write(std::ostream& out) const;
+
+    std::size_t nbins() const { return n; }
+    std::size_t nx() const { return nxsub; }
+    std::size_t ny() const { return nysub; }
+    std::size_t size() const { return blocks.size(); }
+
+    // bits per counter of histogram h, 0 if it has never been added to
+    int width(std::size_t h) const { return blocks[h].width; }
+
+    // memory held by the counters
+    std::size_t bytes() const;
+
+    std::uint32_t operator()(std::size_t h, std::size_t bin) const
+    {
+      const block& b = blocks[h];
+      switch (b.width) {
+      case 8: return b.c8[bin];
+      case 16: return b.c16[bin];
+      case 32: return b.c32[bin];
+      default: return 0;
+      }
+    }
+
+    // add k counts to one bin of histogram h
+    void add(std::size_t h, std::size_t bin, std::uint32_t k = 1);
+
+    // add the nbins counts y to histogram h, which throws
+    // std::invalid_argument if any is negative
+    template <class T>
+      void add(std::size_t h, const T* y)
+    {
+      std::uint64_t max = 0;
+      for (std::size_t i=0; i<n; ++i) {
+	if (y[i] < 0)
+	  throw std::invalid_argument("negative histogram count");
+	const std::uint64_t sum = (*this)(h, i) + static_cast<std::uint64_t>(y[i]);
+	if (sum > max)
+	  max = sum;
+      }
+      if (!max)
+	return;
+
+      block& b = blocks[h];
+      reserve(b, max);
+      switch (b.width) {
+      case 8: add_to(b.c8.get(), n, y); break;
+      case 16: add_to(b.c16.get(), n, y); break;
+      default: add_to(b.c32.get(), n, y); break;
+      }
+    }
+
+    // copy histogram h into out[nbins], as any arithmetic type
+    template <class T>
+      void hist(std::size_t h, T* out) const
+    {
+      const block& b = blocks[h];
+      switch (b.width) {
+      case 8: copy_from(b.c8.get(), n, out); break;
+      case 16: copy_from(b.c16.get(), n, out); break;
+      case 32: copy_from(b.c32.get(), n, out); break;
+      default:
+	for (std::size_t i=0; i<n; ++i)
+	  out[i] = 0;
+	break;
+      }
+    }
+
+    // total count of histogram h
+    std::uint64_t total(std::size_t h) const;
+
+  };
+
+  // Add the histograms of every subtap of a BIN file to cube, as
+  // Lab::add_to_hists does, optionally only those subtaps within rawy
+  // range [rawy_lo, rawy_hi]. The cube must have nbins matching the
+  // file and subtaps subtaps to a tap.
+  void add_binfile(count_cube& cube, const std::string& file,
+		   long rawy_lo = -1, long rawy_hi = -1,
+		   std::size_t subtaps = lab::subtaps);
+
+} // namespace lab
+
+#endif
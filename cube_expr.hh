@@ -0,0 +1,255 @@
+#ifndef CUBE_EXPR_HH
+#define CUBE_EXPR_HH
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include "thread_pool.hh"
+
+namespace lab {
+
+  // Lazy element-wise arithmetic on histogram cubes, i.e., on nhists
+  // histograms of nbins bins each, stored one after another as in a
+  // PDL of dims (nbins, nx, ny). An expression such as
+  //
+  //   sumover((src - w*bg) * xvals) / sumover(src - w*bg)
+  //
+  // builds no cube of its own: it is evaluated a histogram at a time,
+  // any sumover() within it first and then the bins, so that each
+  // input histogram is read while it is still in cache and nothing of
+  // cube size is ever allocated, where PDL makes a full temporary of
+  // every intermediate result.
+  //
+  // Every node has select(h), which moves it to histogram h (and
+  // computes its sums), operator[](b), the value at bin b of the
+  // selected histogram, and bins(), the number of bins, 0 for those
+  // which are constant over a histogram. Nodes are held by value, each
+  // thread evaluating its own copy.
+  namespace cube_expr {
+
+    template <class E>
+      struct expr {
+	const E& self() const { return static_cast<const E&>(*this); }
+      };
+
+    // histograms of a cube
+    template <class T>
+      class cube_term : public expr< cube_term<T> > {
+      private:
+	const T* data;
+	std::size_t n;
+	const T* cur;
+
+      public:
+	cube_term(const T* d, std::size_t nbins) : data(d), n(nbins), cur(d) { }
+	void select(std::size_t h) { cur = data + h*n; }
+	double operator[](std::size_t b) const { return cur[b]; }
+	std::size_t bins() const { return n; }
+      };
+
+    // the same value for every bin of every histogram
+    class scalar_term : public expr<scalar_term> {
+    private:
+      double v;
+
+    public:
+      explicit scalar_term(double d) : v(d) { }
+      void select(std::size_t) { }
+      double operator[](std::size_t) const { return v; }
+      std::size_t bins() const { return 0; }
+    };
+
+    // a value per bin, the same for every histogram, e.g., xvals
+    class bins_term : public expr<bins_term> {
+    private:
+      const double* x;
+      std::size_t n;
+
+    public:
+      bins_term(const double* xv, std::size_t nbins) : x(xv), n(nbins) { }
+      void select(std::size_t) { }
+      double operator[](std::size_t b) const { return x[b]; }
+      std::size_t bins() const { return n; }
+    };
+
+    // a value per histogram, the same for every bin, e.g., an image of
+    // means as $mean->dummy(0)
+    class hists_term : public expr<hists_term> {
+    private:
+      const double* v;
+      double cur;
+
+    public:
+      explicit hists_term(const double* vals) : v(vals), cur(0) { }
+      void select(std::size_t h) { cur = v[h]; }
+      double operator[](std::size_t) const { return cur; }
+      std::size_t bins() const { return 0; }
+    };
+
+    template <class Op, class L, class R>
+      class binary : public expr< binary<Op, L, R> > {
+      private:
+	L l;
+	R r;
+
+      public:
+	binary(const L& a, const R& b) : l(a), r(b) { }
+	void select(std::size_t h) { l.select(h); r.select(h); }
+	double operator[](std::size_t b) const { return Op::apply(l[b], r[b]); }
+	std::size_t bins() const { return l.bins() ? l.bins() : r.bins(); }
+      };
+
+    template <class Op, class E>
+      class unary : public expr< unary<Op, E> > {
+      private:
+	E e;
+
+      public:
+	explicit unary(const E& a) : e(a) { }
+	void select(std::size_t h) { e.select(h); }
+	double operator[](std::size_t b) const { return Op::apply(e[b]); }
+	std::size_t bins() const { return e.bins(); }
+      };
+
+    // c ? a : b, bin by bin
+    template <class C, class A, class B>
+      class where_term : public expr< where_term<C, A, B> > {
+      private:
+	C c;
+	A a;
+	B b;
+
+      public:
+	where_term(const C& cond, const A& x, const B& y) : c(cond), a(x), b(y) { }
+	void select(std::size_t h) { c.select(h); a.select(h); b.select(h); }
+	double operator[](std::size_t i) const { return c[i] ? a[i] : b[i]; }
+	std::size_t bins() const
+	{ return c.bins() ? c.bins() : a.bins() ? a.bins() : b.bins(); }
+      };
+
+    // sum over the bins of each histogram, c.f. PDL's sumover
+    template <class E>
+      class sum_term : public expr< sum_term<E> > {
+      private:
+	E e;
+	double cur;
+
+      public:
+	explicit sum_term(const E& a) : e(a), cur(0)
+	{
+	  if (!e.bins())
+	    throw std::logic_error("sumover() of an expression without bins");
+	}
+	void select(std::size_t h)
+	{
+	  e.select(h);
+	  const std::size_t n = e.bins();
+	  double s = 0;
+	  for (std::size_t b=0; b<n; ++b)
+	    s += e[b];
+	  cur = s;
+	}
+	double operator[](std::size_t) const { return cur; }
+	std::size_t bins() const { return 0; }
+      };
+
+    struct add_op { static double apply(double a, double b) { return a + b; } };
+    struct sub_op { static double apply(double a, double b) { return a - b; } };
+    struct mul_op { static double apply(double a, double b) { return a * b; } };
+    struct div_op { static double apply(double a, double b) { return a / b; } };
+    struct gt_op { static double apply(double a, double b) { return a > b; } };
+    struct lt_op { static double apply(double a, double b) { return a < b; } };
+    struct ge_op { static double apply(double a, double b) { return a >= b; } };
+    struct neg_op { static double apply(double a) { return -a; } };
+    struct sqrt_op { static double apply(double a) { return std::sqrt(a); } };
+    struct abs_op { static double apply(double a) { return std::fabs(a); } };
+
+#define LAB_CUBE_EXPR_BINARY(op, Op)					\
+    template <class L, class R>						\
+      binary<Op, L, R> operator op(const expr<L>& l, const expr<R>& r)	\
+    { return binary<Op, L, R>(l.self(), r.self()); }			\
+    template <class L>							\
+      binary<Op, L, scalar_term> operator op(const expr<L>& l, double r) \
+    { return binary<Op, L, scalar_term>(l.self(), scalar_term(r)); }	\
+    template <class R>							\
+      binary<Op, scalar_term, R> operator op(double l, const expr<R>& r) \
+    { return binary<Op, scalar_term, R>(scalar_term(l), r.self()); }
+
+    LAB_CUBE_EXPR_BINARY(+, add_op)
+    LAB_CUBE_EXPR_BINARY(-, sub_op)
+    LAB_CUBE_EXPR_BINARY(*, mul_op)
+    LAB_CUBE_EXPR_BINARY(/, div_op)
+    LAB_CUBE_EXPR_BINARY(>, gt_op)
+    LAB_CUBE_EXPR_BINARY(<, lt_op)
+    LAB_CUBE_EXPR_BINARY(>=, ge_op)
+
+#undef LAB_CUBE_EXPR_BINARY
+
+    template <class E>
+      unary<neg_op, E> operator-(const expr<E>& e)
+    { return unary<neg_op, E>(e.self()); }
+
+    template <class E>
+      unary<sqrt_op, E> sqrt(const expr<E>& e)
+    { return unary<sqrt_op, E>(e.self()); }
+
+    template <class E>
+      unary<abs_op, E> abs(const expr<E>& e)
+    { return unary<abs_op, E>(e.self()); }
+
+    template <class C, class A, class B>
+      where_term<C, A, B> where(const expr<C>& c, const expr<A>& a, const expr<B>& b)
+    { return where_term<C, A, B>(c.self(), a.self(), b.self()); }
+
+    template <class E>
+      sum_term<E> sumover(const expr<E>& e)
+    { return sum_term<E>(e.self()); }
+
+    template <class T>
+      cube_term<T> cube(const T* data, std::size_t nbins)
+    { return cube_term<T>(data, nbins); }
+
+    inline bins_term bins(const double* x, std::size_t nbins)
+    { return bins_term(x, nbins); }
+
+    inline hists_term per_hist(const double* v)
+    { return hists_term(v); }
+
+    // out, a cube of nhists histograms of e.bins() bins, = e
+    template <class T, class E>
+      void assign(thread_pool& pool, T* out, std::size_t nhists, const expr<E>& e)
+    {
+      const E& ex = e.self();
+      const std::size_t n = ex.bins();
+      if (!n)
+	throw std::logic_error("cube assignment of an expression without bins");
+      parallel_for(pool, nhists, [=](std::size_t h) {
+	  E x = ex;
+	  x.select(h);
+	  T* o = out + h*n;
+	  for (std::size_t b=0; b<n; ++b)
+	    o[b] = static_cast<T>(x[b]);
+	});
+    }
+
+    // out[h] = e for an expression which is constant over each
+    // histogram, e.g., sumover(h * x) / sumover(h)
+    template <class E>
+      void evaluate(thread_pool& pool, double* out, std::size_t nhists,
+		    const expr<E>& e)
+    {
+      const E& ex = e.self();
+      if (ex.bins())
+	throw std::logic_error("per-histogram evaluation of an expression with bins");
+      parallel_for(pool, nhists, [=](std::size_t h) {
+	  E x = ex;
+	  x.select(h);
+	  out[h] = x[0];
+	});
+    }
+
+  } // namespace cube_expr
+
+} // namespace lab
+
+#endif
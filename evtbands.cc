@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <stdexcept>
+#include "evtbands.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::vector;
+
+  namespace {
+
+    // an event as spilled to a band file
+    struct record {
+      packed_event e;
+      float data[ndata_cols-1];  // all but PHA, which is packed
+    };
+
+  }
+
+  bool halo_rows(const subtap_grid& grid, long rawx, long rawy,
+		 size_t y1, size_t y2, size_t& r1, size_t& r2)
+  {
+    const long gx = grid.xindex(rawx), gy = grid.yindex(rawy);
+    if (gx < 0 || gy < 0)
+      return false;
+
+    r1 = std::max<long>(gy-1, y1);
+    r2 = std::min<long>(gy+1, long(y2)-1);
+    return r1 <= r2;
+  }
+
+  void read_rows(const subtap_grid& grid, event_reader& in, long chunk,
+		 size_t y1, size_t y2, events& evt)
+  {
+    evt.clear();
+
+    events tmp;
+    while (in.read(tmp, chunk))
+      for (size_t i=0; i<tmp.size(); ++i) {
+	size_t r1, r2;
+	if (halo_rows(grid, tmp.packed[i].rawx(), tmp.packed[i].rawy(), y1, y2, r1, r2))
+	  evt.push_back(tmp, i);
+      }
+  }
+
+  event_bands::event_bands(const subtap_grid& g, event_reader& in,
+			   size_t nbands, long chunk, size_t y1, size_t y2)
+    : grid(g), row1(y1), row2(std::min(y2, grid.ny()))
+  {
+    // bands are whole tap rows, which is how genstats walks the grid
+    const size_t taprows = (row2 - row1 + grid.subtaps() - 1) / grid.subtaps();
+    nbands = std::max<size_t>(1, std::min(nbands, taprows));
+    band_rows = std::max<size_t>(1, (taprows + nbands - 1) / nbands * grid.subtaps());
+    nbands = std::max<size_t>(1, (row2 - row1 + band_rows - 1) / band_rows);
+
+    try {
+      for (size_t b=0; b<nbands; ++b) {
+	std::FILE* f = std::tmpfile();
+	if (!f)
+	  throw std::runtime_error("could not create temporary file");
+	files.push_back(f);
+      }
+
+      events evt;
+      record r;
+      while (in.read(evt, chunk)) {
+	for (size_t i=0; i<evt.size(); ++i) {
+	  size_t r1, r2;
+	  if (!halo_rows(grid, evt.packed[i].rawx(), evt.packed[i].rawy(),
+			 row1, row2, r1, r2))
+	    continue;
+
+	  r.e = evt.packed[i];
+	  for (int c=pha_col+1; c<ndata_cols; ++c)
+	    r.data[c-1] = evt.data[c][i];
+
+	  // the bands with any of those rows
+	  const size_t b1 = (r1 - row1) / band_rows, b2 = (r2 - row1) / band_rows;
+	  for (size_t b=b1; b<=b2; ++b)
+	    if (std::fwrite(&r, sizeof(r), 1, files[b]) != 1)
+	      throw std::runtime_error("error writing temporary file");
+	}
+      }
+    }
+    catch (...) {
+      for (size_t b=0; b<files.size(); ++b)
+	std::fclose(files[b]);
+      throw;
+    }
+  }
+
+  event_bands::~event_bands()
+  {
+    for (size_t b=0; b<files.size(); ++b)
+      std::fclose(files[b]);
+  }
+
+  void event_bands::rows(size_t b, size_t& y1, size_t& y2) const
+  {
+    y1 = row1 + b * band_rows;
+    y2 = std::min(row2, y1 + band_rows);
+  }
+
+  void event_bands::read(size_t b, events& evt) const
+  {
+    std::FILE* f = files[b];
+    std::fflush(f);
+    const long n = std::ftell(f) / sizeof(record);
+    std::rewind(f);
+
+    evt.packed.resize(n);
+    evt.data[pha_col].clear();
+    for (int c=pha_col+1; c<ndata_cols; ++c)
+      evt.data[c].resize(n);
+
+    record r;
+    for (long i=0; i<n; ++i) {
+      if (std::fread(&r, sizeof(r), 1, f) != 1)
+	throw std::runtime_error("error reading temporary file");
+      evt.packed[i] = r.e;
+      for (int c=pha_col+1; c<ndata_cols; ++c)
+	evt.data[c][i] = r.data[c-1];
+    }
+
+    // leave the position at the end for a later read
+    std::fseek(f, 0, SEEK_END);
+  }
+
+} // namespace lab
@@ -0,0 +1,60 @@
+#ifndef EVTBANDS_HH
+#define EVTBANDS_HH
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+#include "evtfile.hh"
+#include "subtap.hh"
+
+namespace lab {
+
+  // Whether an event at (rawx, rawy) is needed to process any subtap
+  // row in [y1, y2), i.e., lies in it or in a row adjacent to it. If
+  // so, [r1, r2] are the rows in [y1, y2) it is needed for.
+  bool halo_rows(const subtap_grid& grid, long rawx, long rawy,
+		 std::size_t y1, std::size_t y2,
+		 std::size_t& r1, std::size_t& r2);
+
+  // replace the contents of evt by the events of the rest of in needed
+  // to process subtap rows [y1, y2), reading chunk rows at a time
+  void read_rows(const subtap_grid& grid, event_reader& in, long chunk,
+		 std::size_t y1, std::size_t y2, events& evt);
+
+  // An event list split into bands of whole tap rows, spilled to
+  // temporary files in a single pass so that only one band need be
+  // in memory at a time. Only subtap rows [y1, y2) are covered. Each
+  // band also holds the events of the subtap rows on either side of
+  // it, so that subtaps on its edges see all of their neighbors.
+  // Within a band, events keep their order in the list; events off
+  // the grid are dropped.
+  class event_bands {
+  private:
+    const subtap_grid& grid;
+    std::vector<std::FILE*> files;
+    std::size_t row1, row2;
+    std::size_t band_rows;           // subtap rows in each band
+
+    event_bands(const event_bands&);
+    event_bands& operator=(const event_bands&);
+
+  public:
+
+    // read in chunks of chunk rows
+    event_bands(const subtap_grid& grid, event_reader& in,
+		std::size_t nbands, long chunk,
+		std::size_t y1, std::size_t y2);
+    ~event_bands();
+
+    std::size_t size() const { return files.size(); }
+
+    // subtap rows [y1, y2) of band b, not counting the halo
+    void rows(std::size_t b, std::size_t& y1, std::size_t& y2) const;
+
+    // replace the contents of evt by the events of band b
+    void read(std::size_t b, events& evt) const;
+  };
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,120 @@
+#include <fitsio.h>
+#include "evtfile.hh"
+
+namespace lab {
+
+  using std::string;
+  using std::vector;
+
+  namespace {
+
+    void check(int status, const string& what)
+    {
+      if (!status)
+	return;
+      char msg[FLEN_STATUS];
+      fits_get_errstatus(status, msg);
+      throw fits_error(what + ": " + msg);
+    }
+
+    template <class T>
+      void read_col(fitsfile* fptr, const string& file, const char* name,
+		    int colnum, int datatype, long row, long n, vector<T>& v)
+    {
+      int status = 0, anynul;
+      v.resize(n);
+      if (!n)
+	return;
+      fits_read_col(fptr, datatype, colnum, row+1, 1, n, 0,
+		    &v[0], &anynul, &status);
+      check(status, file + ": reading column " + name);
+    }
+
+  }
+
+  event_reader::event_reader(const string& f, bool c)
+    : file(f), fptr(0), nrows(0), row(0), chip_id(c)
+  {
+    fitsfile* fp;
+    int status = 0;
+
+    fits_open_table(&fp, (file + "[events]").c_str(), READONLY, &status);
+    check(status, file);
+    fptr = fp;
+
+    try {
+      fits_get_num_rows(fp, &nrows, &status);
+      check(status, file);
+
+      const char* names[3 + ndata_cols] = { "rawx", "rawy", "chip_id" };
+      for (int i=0; i<ndata_cols; ++i)
+	names[3+i] = data_col_names[i];
+
+      for (int i=0; i<3+ndata_cols; ++i) {
+	colnum[i] = 0;
+	if (i == 2 && !chip_id)
+	  continue;
+	fits_get_colnum(fp, CASEINSEN, const_cast<char*>(names[i]), &colnum[i], &status);
+	check(status, file + ": column " + names[i]);
+      }
+    }
+    catch (...) {
+      status = 0;
+      fits_close_file(fp, &status);
+      throw;
+    }
+  }
+
+  event_reader::~event_reader()
+  {
+    int status = 0;
+    fits_close_file(static_cast<fitsfile*>(fptr), &status);
+  }
+
+  bool event_reader::read(events& evt, long n)
+  {
+    if (n > nrows - row)
+      n = nrows - row;
+
+    fitsfile* fp = static_cast<fitsfile*>(fptr);
+    read_col(fp, file, "rawx", colnum[0], TINT, row, n, cols[0]);
+    read_col(fp, file, "rawy", colnum[1], TINT, row, n, cols[1]);
+    if (chip_id)
+      read_col(fp, file, "chip_id", colnum[2], TINT, row, n, cols[2]);
+    else
+      cols[2].assign(n, 0);
+    read_col(fp, file, "pha", colnum[3+pha_col], TINT, row, n, cols[3]);
+    for (int i=pha_col+1; i<ndata_cols; ++i)
+      read_col(fp, file, data_col_names[i], colnum[3+i], TFLOAT, row, n, evt.data[i]);
+    evt.data[pha_col].clear();
+
+    // pack, squeezing out events off the detector
+    evt.packed.resize(n);
+    long m = 0;
+    for (long i=0; i<n; ++i) {
+      const long x = cols[0][i], y = cols[1][i], c = cols[2][i], p = cols[3][i];
+      if (x < 0 || x > packed_event::rawx_max || y < 0 || y > packed_event::rawy_max)
+	continue;
+      if (c < 0 || c > packed_event::chip_id_max || p < 0 || p > packed_event::pha_max)
+	throw fits_error(file + ": chip_id or pha out of range in row "
+			 + std::to_string(row+i+1));
+      evt.packed[m] = packed_event(x, y, c, p);
+      for (int j=pha_col+1; j<ndata_cols; ++j)
+	evt.data[j][m] = evt.data[j][i];
+      ++m;
+    }
+    evt.packed.resize(m);
+    for (int j=pha_col+1; j<ndata_cols; ++j)
+      evt.data[j].resize(m);
+
+    row += n;
+    return n > 0;
+  }
+
+  void read_events(const string& file, events& evt, bool chip_id)
+  {
+    event_reader in(file, chip_id);
+    in.read(evt, in.rows());
+  }
+
+} // namespace lab
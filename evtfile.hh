@@ -0,0 +1,119 @@
+#ifndef EVTFILE_HH
+#define EVTFILE_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+namespace lab {
+
+  // event list data columns, in the order genstats.pl uses them
+  enum data_col { pha_col, samp_col, spimean_col, spimed_col, ndata_cols };
+
+  const char* const data_col_names[ndata_cols] = {
+    "pha", "samp", "spimean", "spimed"
+  };
+
+  // The integer columns of an event packed into one word: rawx (12
+  // bits), rawy (16), chip_id (2) and pha (8). Partitioning and the
+  // other passes over positions read 8 bytes per event rather than a
+  // separate array per column.
+  class packed_event {
+  private:
+    std::uint64_t w;
+
+  public:
+    static const long rawx_max = (1L << 12) - 1;
+    static const long rawy_max = (1L << 16) - 1;
+    static const long chip_id_max = 3;
+    static const long pha_max = 255;
+
+    packed_event() : w(0) { }
+
+    // the values must be in [0, *_max]
+    packed_event(long rawx, long rawy, long chip_id, long pha)
+      : w(std::uint64_t(rawx) | std::uint64_t(rawy) << 12
+	  | std::uint64_t(chip_id) << 28 | std::uint64_t(pha) << 30)
+    { }
+
+    int rawx() const { return w & 0xfff; }
+    int rawy() const { return (w >> 12) & 0xffff; }
+    int chip_id() const { return (w >> 28) & 0x3; }
+    int pha() const { return (w >> 30) & 0xff; }
+  };
+
+  // The columns of a filtered evt1 file needed for gain work: the
+  // packed integer columns and the floating point data columns. PHA
+  // lives in the packed words only, so data[pha_col] is empty; use
+  // value() for any data column. chip_id is 0 unless it was read.
+  struct events {
+    std::vector<packed_event> packed;
+    std::vector<float> data[ndata_cols];
+
+    std::size_t size() const { return packed.size(); }
+
+    float value(int col, std::size_t i) const
+    { return col == pha_col ? packed[i].pha() : data[col][i]; }
+
+    void clear()
+    {
+      packed.clear();
+      for (int c=0; c<ndata_cols; ++c)
+	data[c].clear();
+    }
+
+    void push_back(const events& e, std::size_t i)
+    {
+      packed.push_back(e.packed[i]);
+      for (int c=pha_col+1; c<ndata_cols; ++c)
+	data[c].push_back(e.data[c][i]);
+    }
+  };
+
+  class fits_error : public std::runtime_error
+  {
+  public:
+    fits_error(const std::string& s = "unidentified error")
+      : std::runtime_error(s)
+    { }
+  };
+
+  // Reads rawx, rawy, the data columns and, if requested, chip_id
+  // from the EVENTS extension of an event list a chunk of rows at a
+  // time, for lists which need not fit in memory. The integer columns
+  // are packed as they are read; events with rawx or rawy outside
+  // the range of packed_event, which lie off the detector, are
+  // dropped, and a PHA or chip_id out of range is an error.
+  class event_reader {
+  private:
+    std::string file;
+    void* fptr;               // fitsfile*
+    int colnum[3 + ndata_cols];
+    long nrows, row;
+    bool chip_id;
+    std::vector<int> cols[4]; // rawx, rawy, chip_id, pha of a chunk
+
+    event_reader(const event_reader&);
+    event_reader& operator=(const event_reader&);
+
+  public:
+
+    explicit event_reader(const std::string& file, bool chip_id = false);
+    ~event_reader();
+
+    long rows() const { return nrows; }
+
+    // replace the contents of evt by the next (up to) n rows, returns
+    // false once all rows have been read
+    bool read(events& evt, long n);
+  };
+
+  // Read all of rawx, rawy and the data columns from the EVENTS
+  // extension of file. chip_id is only read if requested.
+  void read_events(const std::string& file, events& evt, bool chip_id = false);
+
+} // namespace lab
+
+#endif
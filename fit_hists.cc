@@ -0,0 +1,509 @@
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <numeric>
+#include <cmath>
+#include <algorithm>
+#include <cpputil/ss_cast.hh>
+#include "lab.hh"
+#include "arena.hh"
+#include "lmfit.hh"
+#include "lmbatch.hh"
+#include "fitseed.hh"
+#include "thread_pool.hh"
+
+using std::cout;
+using std::cerr;
+using std::vector;
+using std::string;
+
+namespace {
+
+  namespace opts {
+    string type = "samp";
+    int mincnts = 50;
+    int threads = 0;
+    int info = 0;
+    int warm = 0;
+    string seedfile;
+    string telemetry;
+
+    const char* version_string = "0.1";
+    int help = 0;
+    int version = 0;
+    option lopts[] = {
+      { "help",    no_argument, &help, 1 },
+      { "version", no_argument, &version, 1 },
+      { "info",    no_argument, &info, 1 },
+      { "warm",    no_argument, &warm, 1 },
+      { "seedfile", required_argument, 0, 's' },
+      { "telemetry", required_argument, 0, 'L' },
+      { "type",    required_argument, 0, 'T' },
+      { "mincnts", required_argument, 0, 'm' },
+      { "threads", required_argument, 0, 't' },
+      { 0, 0, 0, 0 }
+    };
+  }
+
+  // a subtap histogram, its fitted parameters and fit result
+  struct subtap {
+    int ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2;
+    long sum;
+    vector<int> y;
+    double par[lab::two_ngauss1d::npar];
+    lab::lm_result res;
+    lab::fit_seed seed;
+    bool retried;
+  };
+
+  // initial parameters from fits already done: those of the subtaps
+  // of another test and, with --warm, those of the converged fits of
+  // this one
+  struct warm_start {
+    int subtaps;    // per tap, from the BIN file
+    vector<lab::fit_seeds> test, near;
+
+    long gy(const subtap& s) const { return long(s.ytap) * subtaps + s.ysubtap; }
+    long gx(const subtap& s) const { return long(s.xtap) * subtaps + s.xsubtap; }
+  };
+
+  bool read_block(lab::binfile_input& in, vector<subtap>& block,
+		  std::size_t maxsize);
+  void fit_block(vector<subtap>& block, lab::thread_pool& pool, warm_start& ws);
+  void fit_hists(const string& file, lab::thread_pool& pool);
+
+  int help();
+  int version();
+}
+
+int main(int argc, char** argv) {
+
+  int c;
+  while ((c=getopt_long_only(argc, argv, "", opts::lopts, 0))!=-1) {
+    switch (c) {
+    // a flag was set/unset on our behalf, nothing more to do
+    case 0:
+      break;
+    case 'T':
+      opts::type = optarg;
+      break;
+    case 'm':
+      opts::mincnts = util::ss_cast<int>(optarg);
+      break;
+    case 't':
+      opts::threads = util::ss_cast<int>(optarg);
+      break;
+    case 's':
+      opts::seedfile = optarg;
+      break;
+    case 'L':
+      opts::telemetry = optarg;
+      break;
+    // problem occurred
+    case '?':
+    case ':':
+      cerr << "Try `--help' for more information.\n";
+      return EXIT_FAILURE;
+    // didn't handle all of our specified options
+    default:
+      cerr << "programmer error, unhandled option = "; cerr.put(c); cerr << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opts::help) return help();
+  if (opts::version) return version();
+
+  if ( argc-optind != 1) {
+    cerr << "Usage: " << argv[0] << " [options] binfile\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    lab::thread_pool pool(opts::threads);
+    fit_hists(argv[optind], pool);
+  }
+  catch (std::exception& e) {
+    cerr << argv[0] << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+
+} // main
+
+namespace {
+
+  void fit_hists(const string& file, lab::thread_pool& pool)
+  {
+    lab::binfile_input in(file, lab::nbins(opts::type));
+
+    vector<string> cols;
+    cols.push_back("ytap");
+    cols.push_back("ysubtap");
+    cols.push_back("xtap");
+    cols.push_back("xsubtap");
+    cols.push_back("y1");
+    cols.push_back("y2");
+    cols.push_back("x1");
+    cols.push_back("x2");
+    cols.push_back("sum");
+    if (!opts::info) {
+      const char* fit_cols[] = { "fwhm", "pos", "ampl" };
+      for (int j=0; j<6; ++j)
+	cols.push_back((j<3 ? "g1" : "g2") + string(fit_cols[j%3]));
+    }
+
+    for (vector<string>::size_type i=0; i<cols.size(); ++i)
+      cout << cols[i] << (i+1<cols.size() ? '\t' : '\n');
+    for (vector<string>::size_type i=0; i<cols.size(); ++i)
+      cout << 'N' << (i+1<cols.size() ? '\t' : '\n');
+
+    std::ofstream tel;
+    if (!opts::telemetry.empty()) {
+      tel.open(opts::telemetry.c_str());
+      if (!tel)
+	throw std::runtime_error("could not open " + opts::telemetry);
+      tel << "ytap\tysubtap\txtap\txsubtap\tsum\ttype\tseed\tniter\tnfev\tusec\tconverged\tretried\tchisq\n";
+      tel << "N\tN\tN\tN\tN\tS\tS\tN\tN\tN\tN\tN\tN\n";
+    }
+
+    // amplitudes are scaled by counts when passed from one subtap to
+    // another
+    vector<std::size_t> ampl;
+    ampl.push_back(2);
+    ampl.push_back(5);
+    warm_start ws;
+    ws.subtaps = 0;
+    lab::fit_telemetry telemetry;
+
+    // subtaps are read and fitted in blocks so that memory use stays
+    // bounded regardless of the size of the BIN file
+    vector<subtap> block;
+    while (read_block(in, block, 1024)) {
+
+      // subtaps per tap are taken from the first block, which spans
+      // several rows of taps
+      if (!opts::info && !ws.subtaps && (opts::warm || !opts::seedfile.empty())) {
+	for (vector<subtap>::size_type i=0; i<block.size(); ++i)
+	  ws.subtaps = std::max(ws.subtaps,
+				std::max(block[i].ysubtap, block[i].xsubtap) + 1);
+	ws.near.assign(1, lab::fit_seeds(lab::two_ngauss1d::npar, ampl));
+	if (!opts::seedfile.empty()) {
+	  const char* const pos[] = { "ytap", "ysubtap", "xtap", "xsubtap", "sum" };
+	  ws.test.assign(1, lab::fit_seeds(lab::two_ngauss1d::npar, ampl));
+	  ws.test[0].read(opts::seedfile, pos,
+			  vector<string>(cols.begin()+9, cols.end()), ws.subtaps);
+	}
+      }
+
+      if (!opts::info)
+	fit_block(block, pool, ws);
+
+      for (vector<subtap>::size_type i=0; i<block.size(); ++i) {
+	const subtap& s = block[i];
+	if (!opts::info && s.sum < opts::mincnts)
+	  continue;
+	cout << s.ytap << '\t' << s.ysubtap << '\t'
+	     << s.xtap << '\t' << s.xsubtap << '\t'
+	     << s.y1 << '\t' << s.y2 << '\t'
+	     << s.x1 << '\t' << s.x2 << '\t' << s.sum;
+	if (!opts::info)
+	  for (std::size_t k=0; k<lab::two_ngauss1d::npar; ++k)
+	    cout << '\t' << s.par[k];
+	cout << '\n';
+
+	if (!opts::info && tel.is_open()) {
+	  const lab::lm_result& r = s.res;
+	  telemetry.add(s.seed, r, s.retried);
+	  tel << s.ytap << '\t' << s.ysubtap << '\t'
+	      << s.xtap << '\t' << s.xsubtap << '\t' << s.sum << '\t'
+	      << opts::type << '\t' << lab::fit_seed_names[s.seed] << '\t'
+	      << r.niter << '\t' << r.nfev << '\t' << r.seconds * 1e6 << '\t'
+	      << r.converged << '\t' << s.retried << '\t' << r.chisq << '\n';
+	}
+      }
+    }
+
+    if (!cout.flush())
+      throw std::runtime_error("error writing output");
+
+    if (tel.is_open()) {
+      tel.close();
+      if (!tel)
+	throw std::runtime_error("error writing " + opts::telemetry);
+      if (!opts::info)
+	telemetry.summary(cerr);
+    }
+  }
+
+  bool read_block(lab::binfile_input& in, vector<subtap>& block,
+		  std::size_t maxsize)
+  {
+    block.resize(maxsize);
+
+    vector<int> x;
+    std::size_t n = 0;
+    for ( ; n<maxsize; ++n) {
+      subtap& s = block[n];
+      if (!in.next_subtap(s.ytap, s.ysubtap, s.xtap, s.xsubtap,
+			  s.y1, s.y2, s.x1, s.x2, x, s.y))
+	break;
+      s.sum = std::accumulate(s.y.begin(), s.y.end(), 0L);
+    }
+
+    block.resize(n);
+    return n;
+  }
+
+  // fits of the subtaps fits[lo, hi), each started from the fit of
+  // the same subtap in another test, a converged neighbor's or, with
+  // cold true or neither to be had, fit_hists.pl's initial values
+  void fit_chunk(const vector<subtap*>& fits, std::size_t lo, std::size_t hi,
+		 const warm_start& ws, bool cold)
+  {
+    static thread_local lab::arena scratch;
+    scratch.reset();
+
+    const std::size_t nf = hi - lo;
+    const std::size_t nbins = fits[lo]->y.size();
+    const double** y = scratch.alloc<const double*>(nf);
+    double** par = scratch.alloc<double*>(nf);
+
+    for (std::size_t f=0; f<nf; ++f) {
+      subtap& s = *fits[lo+f];
+      double* yf = scratch.alloc<double>(nbins);
+      double sxy = 0;
+      for (std::size_t j=0; j<nbins; ++j) {
+	yf[j] = s.y[j];
+	sxy += j * yf[j];
+      }
+      y[f] = yf;
+      par[f] = s.par;
+
+      double* a = s.par;
+      if (!cold && !ws.test.empty() && ws.test[0].seed(ws.gy(s), ws.gx(s), s.sum, false, a))
+	s.seed = lab::seed_test;
+      else if (!cold && opts::warm && ws.near[0].seed(ws.gy(s), ws.gx(s), s.sum, true, a))
+	s.seed = lab::seed_neighbor;
+      else {
+	// fit_hists.pl's initial values, including its setting g1.ampl
+	// a second time where g2.ampl was meant, which left g2.ampl at
+	// Sherpa's default of 1
+	const double mean = sxy / s.sum;
+	a[0] = 30;
+	a[1] = mean / 2;
+	a[2] = s.sum / 2.;
+	a[3] = 20;
+	a[4] = mean;
+	a[5] = 1;
+	if (!cold)
+	  s.seed = lab::seed_cold;
+      }
+    }
+
+    vector<lab::lm_result> r(nf);
+    lab::ngauss_fit_batch(y, nbins, par, r.data(), nf, HUGE_VAL, scratch);
+    for (std::size_t f=0; f<nf; ++f)
+      fits[lo+f]->res = r[f];
+  }
+
+  // fits in chunks of a few lmfit_batch lane groups over the pool
+  void fit_subtaps(const vector<subtap*>& fits, lab::thread_pool& pool,
+		   const warm_start& ws, bool cold)
+  {
+    const std::size_t chunk = 8 * lab::lm_lanes;
+    const std::size_t nchunks = (fits.size() + chunk - 1) / chunk;
+    lab::parallel_for(pool, nchunks,
+		      [&](std::size_t k) {
+			fit_chunk(fits, k*chunk, std::min((k+1)*chunk, fits.size()),
+				  ws, cold);
+		      }, 1);
+  }
+
+  // The subtaps of a block with enough counts, fitted in the passes of
+  // lab::fit_pass with --warm, c.f. gaussfit. A warm started fit which
+  // does not converge is done again cold and the better of the two
+  // kept.
+  void fit_block(vector<subtap>& block, lab::thread_pool& pool, warm_start& ws)
+  {
+    const int npasses = opts::warm ? lab::nfit_passes : 1;
+    for (int p=0; p<npasses; ++p) {
+
+      vector<subtap*> fits;
+      for (vector<subtap>::size_type i=0; i<block.size(); ++i) {
+	subtap& s = block[i];
+	if (s.sum < opts::mincnts)
+	  continue;
+	if (opts::warm && lab::fit_pass(ws.gy(s), ws.gx(s)) != p)
+	  continue;
+	fits.push_back(&s);
+	s.seed = lab::seed_cold;
+	s.retried = false;
+      }
+      fit_subtaps(fits, pool, ws, false);
+
+      vector<subtap*> retry;
+      vector<double> par;
+      vector<lab::lm_result> res;
+      for (std::size_t f=0; f<fits.size(); ++f) {
+	subtap& s = *fits[f];
+	if (s.seed == lab::seed_cold || s.res.converged)
+	  continue;
+	retry.push_back(&s);
+	par.insert(par.end(), s.par, s.par + lab::two_ngauss1d::npar);
+	res.push_back(s.res);
+      }
+      fit_subtaps(retry, pool, ws, true);
+
+      for (std::size_t f=0; f<retry.size(); ++f) {
+	subtap& s = *retry[f];
+	const lab::lm_result& warm = res[f];
+	s.retried = true;
+	s.res.niter += warm.niter;
+	s.res.nfev += warm.nfev;
+	s.res.seconds += warm.seconds;
+	if (!(s.res.chisq < warm.chisq)) {
+	  s.res.chisq = warm.chisq;
+	  s.res.converged = warm.converged;
+	  std::copy(&par[f * lab::two_ngauss1d::npar],
+		    &par[f * lab::two_ngauss1d::npar] + lab::two_ngauss1d::npar,
+		    s.par);
+	}
+      }
+
+      if (opts::warm)
+	for (std::size_t f=0; f<fits.size(); ++f)
+	  if (fits[f]->res.converged)
+	    ws.near[0].add(ws.gy(*fits[f]), ws.gx(*fits[f]), fits[f]->sum, fits[f]->par);
+    }
+  }
+
+  int version() {
+    cout << opts::version_string << '\n';
+    return 0;
+  }
+
+  int help() {
+    const char* help_text = "\
+=head1 NAME\n\
+\n\
+fit_hists - fit two Gaussians to each subtap histogram of a BIN file\n\
+\n\
+=head1 SYNOPSIS\n\
+\n\
+fit_hists [options] binfile\n\
+\n\
+=head1 DESCRIPTION\n\
+\n\
+A native replacement for the Sherpa fits of F<fit_hists.pl>. The\n\
+histogram of each subtap with at least I<--mincnts> counts is fitted\n\
+with the sum of two normalized Gaussians, Sherpa's\n\
+ngauss1d[g1]+ngauss1d[g2], using the Levenberg-Marquardt method with\n\
+analytic partial derivatives and the chi gehrels statistic. The first\n\
+and last bins are ignored, and the initial values are those\n\
+F<fit_hists.pl> gave Sherpa: g1.fwhm=30, g1.pos=mean/2, g1.ampl=sum/2,\n\
+g2.fwhm=20, g2.pos=mean and g2.ampl=1. Subtaps are fitted in parallel,\n\
+in one process, rather than one Sherpa process each, and several at a\n\
+time on each thread with the fits in vector lanes.\n\
+\n\
+Output to stdout is RDB with the columns of F<fit_hists.pl>: ytap,\n\
+ysubtap, xtap, xsubtap, y1, y2, x1, x2, sum, g1fwhm, g1pos, g1ampl,\n\
+g2fwhm, g2pos and g2ampl.\n\
+\n\
+=head1 OPTIONS\n\
+\n\
+=over 4\n\
+\n\
+=item --help\n\
+\n\
+Print this help text and exit.\n\
+\n\
+=item --version\n\
+\n\
+Print the program version and exit.\n\
+\n\
+=item --type=s\n\
+\n\
+Histogram type of the BIN file, one of pha, samp, spimean or spimed.\n\
+The default is samp, as for $Lab::TYPE.\n\
+\n\
+=item --mincnts=i\n\
+\n\
+Minimum number of counts a subtap must have to be fitted. The default\n\
+value is 50.\n\
+\n\
+=item --warm\n\
+\n\
+Start each fit from the parameters of a converged neighboring subtap,\n\
+amplitudes scaled by the ratio of counts, fitting subtaps in the four\n\
+checkerboard passes described for F<gaussfit>.\n\
+\n\
+=item --seedfile=s\n\
+\n\
+Start the fit of each subtap from its fit in RDB file I<s>, the output\n\
+of F<fit_hists> for another test of the same anode, in preference to\n\
+any neighbor's. Warm started fits which do not converge are fitted\n\
+again from the usual initial values and the better fit kept.\n\
+\n\
+=item --telemetry=s\n\
+\n\
+Write the iterations, model evaluations, time, convergence and\n\
+chi-square of every fit, with where its initial values came from, to\n\
+RDB file I<s>, and a summary of them, with histograms, to stderr.\n\
+\n\
+=item --info\n\
+\n\
+List every subtap, through the sum column only, without fitting.\n\
+\n\
+=item --threads=i\n\
+\n\
+Number of fitting threads. The default is one per processor core.\n\
+\n\
+=back\n\
+\n\
+=head1 AUTHOR\n\
+\n\
+Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt>\n\
+\n\
+=head1 SEE ALSO\n\
+\n\
+fit_hists.pl, gaussfit\n\
+\n\
+=cut\n\
+";
+
+    const char* pager = std::getenv("PAGER");
+    if (!pager) pager = "more";
+
+    FILE* pd = popen((std::string("pod2text -c | ")+pager).c_str(), "w");
+    if (!pd) {
+      std::perror("error starting pod2text");
+      return EXIT_FAILURE;
+    }
+
+    int n = 0;
+    int len = std::strlen(help_text);
+    while (n < len) {
+      int written = std::fwrite(help_text, 1, len-n, pd);
+      if (!written) {
+	std::perror("error writing help");
+	return EXIT_FAILURE;
+      }
+      n+=written;
+    }
+
+    if (pclose(pd) == -1) {
+      std::perror("error writing help");
+      return EXIT_FAILURE;
+    }
+
+    return 0;
+  }
+
+}
@@ -46,6 +46,8 @@ use Lab;
 use PDL;
 use File::Temp;
 
+my $FIT_HISTS = 'fit_hists';
+
 use Getopt::Long;
 my %default_opts = (
 		    mincnts => 50,
@@ -53,7 +55,7 @@ my %default_opts = (
 my %opts = %default_opts;
 GetOptions(\%opts,
 	   'help!', 'version!', 'debug!',
-	   'info!', 'mincnts=i',
+	   'info!', 'mincnts=i', 'sherpa!',
 	   ) or die "Try --help for more information.\n";
 if ($opts{debug}) {
   $SIG{__WARN__} = \&Carp::cluck;
@@ -64,6 +66,15 @@ $opts{version} and _version();
 
 my $bin = shift;
 
+# the native fit_hists does the same fits without a Sherpa process
+# per subtap, Sherpa is only used if it isn't on the PATH or with
+# --sherpa
+unless ($opts{sherpa}) {
+  my @args = ('--type='.$Lab::TYPE, '--mincnts='.$opts{mincnts});
+  push @args, '--info' if $opts{info};
+  { no warnings 'exec'; exec $FIT_HISTS, @args, $bin; }
+}
+
 my $it = Lab::InBinFile->new($bin) or die;
 
 my @cols = qw( ytap ysubtap xtap xsubtap y1 y2 x1 x2 sum );
@@ -51,6 +51,8 @@ use File::Temp;
 use Lab;
 use PDL::Fit::Polynomial;
 
+my $FIT_STACKS = 'fit_stacks';
+
 use Getopt::Long;
 my %default_opts = (
 		    rdb => 'hrcs_lab.rdb',
@@ -66,6 +68,7 @@ GetOptions(\%opts,
 	   'help!', 'version!', 'debug!',
 	   'rdb=s', 'datadir=s', 'mincnts=i', 'dev=s', 'minsubtaps=i',
 	   'revcolors!', 'colors!', 'charsize=f', 'fitfits!', 'samp!',
+	   'sherpa!',
 	   ) or die "Try --help for more information.\n";
 if ($opts{debug}) {
   $SIG{__WARN__} = \&Carp::cluck;
@@ -84,6 +87,7 @@ if ($opts{samp}) {
   $name = 'SAMP';
   $Lab::SAMP = 1;
 }
+$Lab::TYPE = lc $name;
 
 my $dev = PDL::Graphics::PGPLOT::Window->new(Device => $opts{dev},
 					     NXPanel => 4, NYPanel => 3,
@@ -100,68 +104,58 @@ my (@u2_median, @u2_median_err,
     @n1_n2, @n1_n2_err,
    );
 
-for my $anode (@anodes) {
-
-  my (undef, undef, $MCP, undef, $HRC_file) = Lab::test_data($anode);
-
-  my @n = (0)x$nz;
-  my @hists = map { zeroes(long, $nz) } 1..$nz;
+# the stacks of every anode are fitted by the native fit_stacks,
+# Sherpa is only used if it isn't on the PATH or with --sherpa
+my %fits = $opts{sherpa} ? () : native_fits(@anodes);
 
-  for (0..$#{$HRC_file}) {
-
-    my $hrc_file = $HRC_file->[$_];
-    my $mcp = $MCP->[$_];
-
-    my $bin = $opts{bindir} . '/' . $hrc_file . ($opts{samp} ? '_samp' : '') . '.bin';
+for my $anode (@anodes) {
 
-    print STDERR "Processing $bin...";
-    STDERR->flush;
+  my (@nsubtaps, @ncounts, @median, @g1fwhm, @g2fwhm, @g1pos, @g2pos, @g1ampl, @g2ampl);
 
-    my ($rawy_min, $rawy_max) = Lab::rawy_limits_mcp($mcp);
+  if (my $f = $fits{$anode}) {
+    @nsubtaps = @{ $f->{nsubtaps} };
+    @ncounts = @{ $f->{ncounts} };
+    @median = @{ $f->{median} };
+    @g1fwhm = @{ $f->{g1fwhm} };
+    @g1pos = @{ $f->{g1pos} };
+    @g1ampl = @{ $f->{g1ampl} };
+    @g2fwhm = @{ $f->{g2fwhm} };
+    @g2pos = @{ $f->{g2pos} };
+    @g2ampl = @{ $f->{g2ampl} };
+  }
 
-    my $it = Lab::InBinFile->new($bin) or die;
+  else {
+    # subtaps of every test of the anode, each on its own MCP
+    my ($n, $hists) = Lab::median_stacks(Lab::src_hists($anode, 1, $opts{bindir}),
+					 $opts{mincnts});
+    my @n = @$n;
+    my @hists = @$hists;
 
-    while (my ($ytap, $ysubtap, $xtap, $xsubtap, $y1, $y2, $x1, $x2, $x, $y) = $it->next_subtap) {
+    for my $i (0..$#n) {
+      $n[$i] >= $opts{minsubtaps} or next;
 
-      next if $y1 < $rawy_min or $y2 > $rawy_max;
+      my ($x, $y) = (sequence(long, $nz), $hists[$i]);
 
-      my $sum = $y->sum;
-      $sum >= $opts{mincnts} or next;
+#      line $x, $y, { title => "$anode, median = $i" };
 
-      my $vals = $y->rld($x); # PHA or SAMP values for events in this subtap
-      my $median = rint($vals->median)->at;
+      my ($g1fwhm, $g1pos, $g1ampl, $g2fwhm, $g2pos, $g2ampl) = fit_hist($x,$y);
 
-      $n[$median]++;
-      $hists[$median] += $y;
+      push @nsubtaps, $n[$i];
+      push @ncounts, $y->sum;
+      push @median, $i;
+      push @g1fwhm, $g1fwhm;
+      push @g2fwhm, $g2fwhm;
+      push @g1pos, $g1pos;
+      push @g2pos, $g2pos;
+      push @g1ampl, $g1ampl;
+      push @g2ampl, $g2ampl;
     }
-
-    print STDERR "done\n";
   }
 
-  my (@nsubtaps, @ncounts, @median, @g1fwhm, @g2fwhm, @g1pos, @g2pos, @g1ampl, @g2ampl);
-
-  for my $i (0..$#n) {
-    $n[$i] >= $opts{minsubtaps} or next;
-
-    my ($x, $y) = (sequence(long, $nz), $hists[$i]);
-
-#    line $x, $y, { title => "$anode, median = $i" };
-
-    my ($g1fwhm, $g1pos, $g1ampl, $g2fwhm, $g2pos, $g2ampl) = fit_hist($x,$y);
-
+  for my $i (0..$#median) {
     print join("\t",
-	       $i, $g1fwhm, $g1pos, $g1ampl, $g2fwhm, $g2pos, $g2ampl),"\n";
-
-    push @nsubtaps, $n[$i];
-    push @ncounts, $y->sum;
-    push @median, $i;
-    push @g1fwhm, $g1fwhm;
-    push @g2fwhm, $g2fwhm;
-    push @g1pos, $g1pos;
-    push @g2pos, $g2pos;
-    push @g1ampl, $g1ampl;
-    push @g2ampl, $g2ampl;
-
+	       $median[$i], $g1fwhm[$i], $g1pos[$i], $g1ampl[$i],
+	       $g2fwhm[$i], $g2pos[$i], $g2ampl[$i]),"\n";
   }
 
   my $nsubtaps = pdl \@nsubtaps;
@@ -187,17 +181,27 @@ for my $anode (@anodes) {
   $dev->points( $median, $g1ampl/$g2ampl, { title => $anode, xtitle => "median $name", ytitle => 'N\\d1\\u / N\\d2\\u' });
   $dev->points( $median, $g1fwhm/$g2fwhm, { title => $anode, xtitle => "median $name", ytitle => '\\gs\\d1\\u / \\gs\\d2\\u' });
 
-  my $u2_median = sum($g2pos / $median * $ncounts / $ncounts->sum);
-  my $u2_median_err = +(stats($g2pos / $median))[1]->at;
+  my ($u2_median, $u2_median_err, $s2_median, $s2_median_err,
+      $u1_u2, $u1_u2_err, $n1_n2, $n1_n2_err);
+
+  if ($fits{$anode}) {
+    ($u2_median, $u2_median_err, $s2_median, $s2_median_err,
+     $u1_u2, $u1_u2_err, $n1_n2, $n1_n2_err) = @{ $fits{$anode}{summary} };
+  }
+
+  else {
+    $u2_median = sum($g2pos / $median * $ncounts / $ncounts->sum);
+    $u2_median_err = +(stats($g2pos / $median))[1]->at;
 
-  my $s2_median = sum($g2fwhm / 2.354 / $median * $ncounts / $ncounts->sum);
-  my $s2_median_err = +(stats($g2fwhm / 2.354 / $median))[1]->at;
+    $s2_median = sum($g2fwhm / 2.354 / $median * $ncounts / $ncounts->sum);
+    $s2_median_err = +(stats($g2fwhm / 2.354 / $median))[1]->at;
 
-  my $u1_u2 = sum($g1pos / $g2pos * $ncounts / $ncounts->sum);
-  my $u1_u2_err = +(stats($g1pos / $g2pos))[1]->at;
+    $u1_u2 = sum($g1pos / $g2pos * $ncounts / $ncounts->sum);
+    $u1_u2_err = +(stats($g1pos / $g2pos))[1]->at;
 
-  my $n1_n2 = sum($g1ampl / $g2ampl * $ncounts / $ncounts->sum);
-  my $n1_n2_err = +(stats($g1ampl / $g2ampl))[1]->at;
+    $n1_n2 = sum($g1ampl / $g2ampl * $ncounts / $ncounts->sum);
+    $n1_n2_err = +(stats($g1ampl / $g2ampl))[1]->at;
+  }
 
   push @u2_median, $u2_median;
   push @u2_median_err, $u2_median_err;
@@ -264,6 +268,54 @@ sub _help {
   exec("$Config{installbin}/perldoc", '-F', $FindBin::Bin . '/' . $FindBin::RealScript);
 }
 
+#
+# Fits of the median stacks of each anode by fit_stacks, as a hash of
+# anode to { median => [ ... ], nsubtaps => [ ... ], ..., summary =>
+# [ u2_median, u2_median_err, ... ] }. Empty if fit_stacks could not
+# be run.
+#
+sub native_fits {
+  my @anodes = @_;
+
+  my $fits = File::Temp->new
+    or die "could not create temporary fits file: $!";
+  my $summary = File::Temp->new
+    or die "could not create temporary summary file: $!";
+  $_->close for $fits, $summary;
+
+  {
+    no warnings 'exec';
+    system($FIT_STACKS,
+	   '--config='.$Lab::TESTFILE, '--bindir='.$opts{bindir},
+	   '--type='.$Lab::TYPE, '--mincnts='.$opts{mincnts},
+	   '--minsubtaps='.$opts{minsubtaps},
+	   "--output=$fits", "--summary=$summary",
+	   @anodes) == 0 or return;
+  }
+
+  my @cols = qw( median nsubtaps ncounts g1fwhm g1pos g1ampl g2fwhm g2pos g2ampl );
+  my ($line, @vals) = MyRDB::rdb_cols("$fits", 'line', @cols) or die;
+
+  my %fits;
+  for my $anode (@anodes) {
+    $fits{$anode}{$_} = [] for @cols;
+  }
+  for my $i (0..$#{$line}) {
+    push @{ $fits{$line->[$i]}{$cols[$_]} }, $vals[$_][$i] for 0..$#cols;
+  }
+
+  my ($sline, @ratios) = MyRDB::rdb_cols("$summary",
+					 qw( line u2_median u2_median_err
+					     s2_median s2_median_err
+					     u1_u2 u1_u2_err n1_n2 n1_n2_err ))
+    or die;
+  for my $i (0..$#{$sline}) {
+    $fits{$sline->[$i]}{summary} = [ map { $_->[$i] } @ratios ];
+  }
+
+  return %fits;
+}
+
 sub fit_hist {
   my ($x, $y) = @_;
 
@@ -0,0 +1,512 @@
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cpputil/ss_cast.hh>
+#include "lab.hh"
+#include "subtap.hh"
+#include "count_cube.hh"
+#include "arena.hh"
+#include "lmfit.hh"
+#include "thread_pool.hh"
+
+using std::cout;
+using std::cerr;
+using std::vector;
+using std::string;
+
+namespace {
+
+  namespace opts {
+    string config = lab::testfile;
+    string bindir = lab::analdir;
+    string type = "pha";
+    string output = "-";
+    string summary;
+    int mincnts = 50;
+    int minsubtaps = 10;
+    int threads = 0;
+
+    const char* version_string = "0.1";
+    int help = 0;
+    int version = 0;
+    option lopts[] = {
+      { "help",       no_argument, &help, 1 },
+      { "version",    no_argument, &version, 1 },
+      { "config",     required_argument, 0, 'c' },
+      { "bindir",     required_argument, 0, 'b' },
+      { "type",       required_argument, 0, 'T' },
+      { "output",     required_argument, 0, 'o' },
+      { "summary",    required_argument, 0, 'S' },
+      { "mincnts",    required_argument, 0, 'm' },
+      { "minsubtaps", required_argument, 0, 'M' },
+      { "threads",    required_argument, 0, 't' },
+      { 0, 0, 0, 0 }
+    };
+  }
+
+  // the tests of one anode and its subtap histograms stacked by
+  // median, stack m of those subtaps whose rounded median is m
+  struct anode {
+    string line;
+    int energy;
+    vector<string> hrc_file;
+    vector<int> mcp;
+    vector<long> n;
+    vector<long> stacks;
+  };
+
+  // a stack with enough subtaps to be fitted
+  struct group {
+    std::size_t anode;
+    int median;
+    long nsubtaps, ncounts;
+    double par[lab::two_ngauss1d::npar];
+  };
+
+  void anodes_from_config(const vector<string>& lines, vector<anode>& anodes);
+  void median_stacks(anode& a);
+  void fit_group(const anode& a, group& g);
+  void write_fits(std::ostream& out, const vector<anode>& anodes,
+		  const vector<group>& groups);
+  void write_summary(std::ostream& out, const vector<anode>& anodes,
+		     const vector<group>& groups);
+
+  int help();
+  int version();
+}
+
+int main(int argc, char** argv) {
+
+  int c;
+  while ((c=getopt_long_only(argc, argv, "", opts::lopts, 0))!=-1) {
+    switch (c) {
+    // a flag was set/unset on our behalf, nothing more to do
+    case 0:
+      break;
+    case 'c':
+      opts::config = optarg;
+      break;
+    case 'b':
+      opts::bindir = optarg;
+      break;
+    case 'T':
+      opts::type = optarg;
+      break;
+    case 'o':
+      opts::output = optarg;
+      break;
+    case 'S':
+      opts::summary = optarg;
+      break;
+    case 'm':
+      opts::mincnts = util::ss_cast<int>(optarg);
+      break;
+    case 'M':
+      opts::minsubtaps = util::ss_cast<int>(optarg);
+      break;
+    case 't':
+      opts::threads = util::ss_cast<int>(optarg);
+      break;
+    // problem occurred
+    case '?':
+    case ':':
+      cerr << "Try `--help' for more information.\n";
+      return EXIT_FAILURE;
+    // didn't handle all of our specified options
+    default:
+      cerr << "programmer error, unhandled option = "; cerr.put(c); cerr << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opts::help) return help();
+  if (opts::version) return version();
+
+  try {
+    vector<anode> anodes;
+    anodes_from_config(vector<string>(argv+optind, argv+argc), anodes);
+
+    lab::thread_pool pool(opts::threads);
+
+    // anodes are stacked in parallel, then all of their groups fitted
+    // in parallel together
+    lab::parallel_for(pool, anodes.size(),
+		      [&anodes](std::size_t i) { median_stacks(anodes[i]); });
+
+    vector<group> groups;
+    for (vector<anode>::size_type i=0; i<anodes.size(); ++i) {
+      const anode& a = anodes[i];
+      for (vector<long>::size_type m=0; m<a.n.size(); ++m) {
+	if (a.n[m] < opts::minsubtaps)
+	  continue;
+	group g = { i, int(m), a.n[m], 0, { } };
+	groups.push_back(g);
+      }
+    }
+
+    lab::parallel_for(pool, groups.size(),
+		      [&anodes, &groups](std::size_t i) {
+			fit_group(anodes[groups[i].anode], groups[i]);
+		      });
+
+    if (opts::output == "-")
+      write_fits(cout, anodes, groups);
+    else {
+      std::ofstream out(opts::output.c_str());
+      if (!out)
+	throw std::runtime_error("could not open " + opts::output);
+      write_fits(out, anodes, groups);
+      out.close();
+      if (!out)
+	throw std::runtime_error("error writing " + opts::output);
+    }
+
+    if (!opts::summary.empty()) {
+      std::ofstream out(opts::summary.c_str());
+      if (!out)
+	throw std::runtime_error("could not open " + opts::summary);
+      write_summary(out, anodes, groups);
+      out.close();
+      if (!out)
+	throw std::runtime_error("error writing " + opts::summary);
+    }
+  }
+  catch (std::exception& e) {
+    cerr << argv[0] << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+
+} // main
+
+namespace {
+
+  // the tests of each line, or of every line in order of energy if
+  // none are given, c.f. Lab::lines
+  void anodes_from_config(const vector<string>& lines, vector<anode>& anodes)
+  {
+    vector<string> line, hrc_file, bg_hrc_file;
+    vector<int> energy, mcp, time, bg_time;
+    lab::test_data(opts::config, lines, line, energy, mcp, time,
+		   hrc_file, bg_time, bg_hrc_file);
+
+    vector<string> names = lines;
+    if (names.empty()) {
+      vector<vector<string>::size_type> order;
+      for (vector<string>::size_type i=0; i<line.size(); ++i)
+	if (std::find(names.begin(), names.end(), line[i]) == names.end()) {
+	  names.push_back(line[i]);
+	  order.push_back(i);
+	}
+      std::stable_sort(order.begin(), order.end(),
+		       [&energy](std::size_t a, std::size_t b) {
+			 return energy[a] < energy[b];
+		       });
+      for (vector<string>::size_type i=0; i<order.size(); ++i)
+	names[i] = line[order[i]];
+    }
+
+    anodes.resize(names.size());
+    for (vector<string>::size_type i=0; i<names.size(); ++i) {
+      anode& a = anodes[i];
+      a.line = names[i];
+      for (vector<string>::size_type j=0; j<line.size(); ++j)
+	if (line[j] == a.line) {
+	  a.energy = energy[j];
+	  a.hrc_file.push_back(hrc_file[j]);
+	  a.mcp.push_back(mcp[j]);
+	}
+      if (a.hrc_file.empty())
+	throw std::invalid_argument("no lines matching " + a.line);
+    }
+  }
+
+  // Lab::median_stacks of Lab::src_hists: the subtap histograms of
+  // every test of the anode, each on its own MCP, are summed, then
+  // those with at least mincnts counts added to the stack of their
+  // rounded median
+  void median_stacks(anode& a)
+  {
+    const std::size_t nbins = lab::nbins(opts::type);
+    const std::size_t nx = lab::nrawx / lab::tapsize * lab::subtaps;
+    const std::size_t ny = lab::nrawy / lab::tapsize * lab::subtaps;
+
+    lab::count_cube cube(nbins, nx, ny);
+    for (vector<string>::size_type i=0; i<a.hrc_file.size(); ++i) {
+      long lo, hi;
+      lab::rawy_limits_mcp(a.mcp[i], lo, hi);
+      lab::add_binfile(cube, opts::bindir + '/' + a.hrc_file[i] + '_' + opts::type + ".bin",
+		       lo, hi, lab::subtaps);
+    }
+
+    a.n.assign(nbins, 0);
+    a.stacks.assign(nbins * nbins, 0);
+
+    vector<int> y(nbins);
+    for (std::size_t h=0; h<cube.size(); ++h) {
+      cube.hist(h, y.data());
+      long sum = 0;
+      for (std::size_t j=0; j<nbins; ++j)
+	sum += y[j];
+      if (sum < opts::mincnts || sum <= 0)
+	continue;
+
+      const std::size_t m = static_cast<std::size_t>(std::rint(lab::hist_median(y)));
+      ++a.n[m];
+      long* stack = &a.stacks[m * nbins];
+      for (std::size_t j=0; j<nbins; ++j)
+	stack[j] += y[j];
+    }
+  }
+
+  // fit_hists2.pl's fit of a stack, with its initial values and limit
+  // on g1.ampl
+  void fit_group(const anode& a, group& g)
+  {
+    static thread_local lab::arena scratch;
+    scratch.reset();
+
+    const std::size_t nbins = a.n.size();
+    const long* stack = &a.stacks[g.median * nbins];
+
+    double* y = scratch.alloc<double>(nbins);
+    double sum = 0, sxy = 0;
+    for (std::size_t j=0; j<nbins; ++j) {
+      y[j] = stack[j];
+      sum += y[j];
+      sxy += j * y[j];
+    }
+    g.ncounts = long(sum);
+    const double mean = sxy / sum;
+
+    double* p = g.par;
+    p[0] = 50;
+    p[1] = mean / 2;
+    p[2] = 0.2 * sum;
+    p[3] = 20;
+    p[4] = mean;
+    p[5] = 0.8 * sum;
+
+    lab::ngauss_fit(y, nbins, p, 0.6 * sum, scratch);
+  }
+
+  void write_fits(std::ostream& out, const vector<anode>& anodes,
+		  const vector<group>& groups)
+  {
+    const char* cols[] = { "line", "median", "nsubtaps", "ncounts",
+			   "g1fwhm", "g1pos", "g1ampl",
+			   "g2fwhm", "g2pos", "g2ampl" };
+    const int ncols = sizeof(cols) / sizeof(cols[0]);
+
+    for (int i=0; i<ncols; ++i)
+      out << cols[i] << (i+1<ncols ? '\t' : '\n');
+    for (int i=0; i<ncols; ++i)
+      out << (i ? 'N' : 'S') << (i+1<ncols ? '\t' : '\n');
+
+    for (vector<group>::size_type i=0; i<groups.size(); ++i) {
+      const group& g = groups[i];
+      out << anodes[g.anode].line << '\t' << g.median << '\t'
+	  << g.nsubtaps << '\t' << g.ncounts;
+      for (std::size_t k=0; k<lab::two_ngauss1d::npar; ++k)
+	out << '\t' << g.par[k];
+      out << '\n';
+    }
+  }
+
+  // mean of r weighted by w and standard deviation of r, as
+  // fit_hists2.pl takes from PDL's stats(); zero for fewer than two
+  void weighted_ratio(const vector<double>& r, const vector<double>& w,
+		      double& mean, double& sd)
+  {
+    double wsum = 0, m = 0, u = 0;
+    for (vector<double>::size_type i=0; i<r.size(); ++i) {
+      wsum += w[i];
+      m += r[i] * w[i];
+      u += r[i];
+    }
+    mean = wsum ? m / wsum : 0;
+
+    sd = 0;
+    if (r.size() < 2)
+      return;
+    u /= r.size();
+    for (vector<double>::size_type i=0; i<r.size(); ++i)
+      sd += (r[i] - u) * (r[i] - u);
+    sd = std::sqrt(sd / (r.size() - 1));
+  }
+
+  void write_summary(std::ostream& out, const vector<anode>& anodes,
+		     const vector<group>& groups)
+  {
+    const char* cols[] = { "line", "energy", "ngroups",
+			   "u2_median", "u2_median_err",
+			   "s2_median", "s2_median_err",
+			   "u1_u2", "u1_u2_err",
+			   "n1_n2", "n1_n2_err" };
+    const int ncols = sizeof(cols) / sizeof(cols[0]);
+
+    for (int i=0; i<ncols; ++i)
+      out << cols[i] << (i+1<ncols ? '\t' : '\n');
+    for (int i=0; i<ncols; ++i)
+      out << (i ? 'N' : 'S') << (i+1<ncols ? '\t' : '\n');
+
+    for (vector<anode>::size_type i=0; i<anodes.size(); ++i) {
+      vector<double> w, r[4];
+      for (vector<group>::size_type j=0; j<groups.size(); ++j) {
+	const group& g = groups[j];
+	if (g.anode != i)
+	  continue;
+	const double* p = g.par;
+	w.push_back(g.ncounts);
+	r[0].push_back(p[4] / g.median);
+	r[1].push_back(p[3] / 2.354 / g.median);
+	r[2].push_back(p[1] / p[4]);
+	r[3].push_back(p[2] / p[5]);
+      }
+
+      out << anodes[i].line << '\t' << anodes[i].energy << '\t' << w.size();
+      for (int k=0; k<4; ++k) {
+	double mean, sd;
+	weighted_ratio(r[k], w, mean, sd);
+	out << '\t' << mean << '\t' << sd;
+      }
+      out << '\n';
+    }
+  }
+
+  int version() {
+    cout << opts::version_string << '\n';
+    return 0;
+  }
+
+  int help() {
+    const char* help_text = "\
+=head1 NAME\n\
+\n\
+fit_stacks - fit two Gaussians to subtap histograms stacked by median\n\
+\n\
+=head1 SYNOPSIS\n\
+\n\
+fit_stacks [options] [line...]\n\
+\n\
+=head1 DESCRIPTION\n\
+\n\
+The fitting done by F<fit_hists2.pl>, natively. For each anode line\n\
+given (e.g., B-Ka), or every line in order of energy if none are,\n\
+the subtap histograms of all of its tests are summed, each test\n\
+limited to the rawy range of its MCP as Lab::src_hists does. The\n\
+histograms of subtaps with at least I<--mincnts> counts are then\n\
+stacked by their median, rounded to the nearest bin, and each stack\n\
+of at least I<--minsubtaps> subtaps fitted with Sherpa's\n\
+ngauss1d[g1]+ngauss1d[g2] as F<fit_hists2.pl> did: chi gehrels, the\n\
+first and last bins ignored and initial values g1.fwhm=50,\n\
+g1.pos=mean/2, g1.ampl=0.2*sum (at most 0.6*sum), g2.fwhm=20,\n\
+g2.pos=mean, g2.ampl=0.8*sum. Anodes are read in parallel, and the\n\
+stacks of all anodes fitted in parallel.\n\
+\n\
+The fits are written as RDB with columns line, median, nsubtaps,\n\
+ncounts, g1fwhm, g1pos, g1ampl, g2fwhm, g2pos and g2ampl. With\n\
+I<--summary>, the ratios of F<fit_hists2.pl> are also written for each\n\
+line: u2_median (g2pos/median), s2_median (g2fwhm/2.354/median), u1_u2\n\
+(g1pos/g2pos) and n1_n2 (g1ampl/g2ampl), each the mean over the\n\
+stacks weighted by ncounts, with the unweighted standard deviation in\n\
+the _err column (zero if there is only one stack).\n\
+\n\
+=head1 OPTIONS\n\
+\n\
+=over 4\n\
+\n\
+=item --help\n\
+\n\
+Print this help text and exit.\n\
+\n\
+=item --version\n\
+\n\
+Print the program version and exit.\n\
+\n\
+=item --config=s\n\
+\n\
+The test configuration file. The default is\n\
+F</data/legs/rpete/cal/hrcs_gain/hrcs_lab.rdb>.\n\
+\n\
+=item --bindir=s\n\
+\n\
+Location of the BIN files. The default is\n\
+F</data/legs/rpete/data/hrcs_lab/analysis>.\n\
+\n\
+=item --type=s\n\
+\n\
+Histogram type, pha (the default) or samp, etc.\n\
+\n\
+=item --mincnts=i\n\
+\n\
+Minimum number of counts of a subtap for it to be stacked. The\n\
+default is 50.\n\
+\n\
+=item --minsubtaps=i\n\
+\n\
+Minimum number of subtaps in a stack for it to be fitted. The default\n\
+is 10.\n\
+\n\
+=item --output=s\n\
+\n\
+Where to write the fits, the default - being stdout.\n\
+\n\
+=item --summary=s\n\
+\n\
+Write the per-line summary ratios to this RDB file.\n\
+\n\
+=item --threads=i\n\
+\n\
+Number of threads. The default is one per processor core.\n\
+\n\
+=back\n\
+\n\
+=head1 AUTHOR\n\
+\n\
+Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt>\n\
+\n\
+=head1 SEE ALSO\n\
+\n\
+fit_hists2.pl, fit_hists\n\
+\n\
+=cut\n\
+";
+
+    const char* pager = std::getenv("PAGER");
+    if (!pager) pager = "more";
+
+    FILE* pd = popen((std::string("pod2text -c | ")+pager).c_str(), "w");
+    if (!pd) {
+      std::perror("error starting pod2text");
+      return EXIT_FAILURE;
+    }
+
+    int n = 0;
+    int len = std::strlen(help_text);
+    while (n < len) {
+      int written = std::fwrite(help_text, 1, len-n, pd);
+      if (!written) {
+	std::perror("error writing help");
+	return EXIT_FAILURE;
+      }
+      n+=written;
+    }
+
+    if (pclose(pd) == -1) {
+      std::perror("error writing help");
+      return EXIT_FAILURE;
+    }
+
+    return 0;
+  }
+
+}
@@ -0,0 +1,199 @@
+#include <cmath>
+#include <map>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cpputil/rdb.hh>
+#include <cpputil/ss_cast.hh>
+#include "fitseed.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::string;
+  using std::vector;
+
+  const char* const fit_seed_names[nseeds] = { "cold", "test", "neighbor" };
+
+  void fit_seeds::scaled(const entry& e, long counts, double* a) const
+  {
+    std::copy(pars.begin()+e.par, pars.begin()+e.par+npar, a);
+    if (e.counts > 0)
+      for (size_t j=0; j<ampl.size(); ++j)
+	a[ampl[j]] *= double(counts) / e.counts;
+  }
+
+  void fit_seeds::add(long gy, long gx, long counts, const double* a)
+  {
+    std::pair<std::unordered_map<long long, entry>::iterator, bool> i =
+      fits.insert(std::make_pair(key(gy, gx), entry()));
+    if (i.second) {
+      i.first->second.par = pars.size();
+      pars.resize(pars.size() + npar);
+    }
+    i.first->second.counts = counts;
+    std::copy(a, a+npar, pars.begin() + i.first->second.par);
+  }
+
+  bool fit_seeds::seed(long gy, long gx, long counts, bool neighbors,
+		       double* a) const
+  {
+    std::unordered_map<long long, entry>::const_iterator i = fits.find(key(gy, gx));
+    if (i != fits.end()) {
+      scaled(i->second, counts, a);
+      return true;
+    }
+    if (!neighbors)
+      return false;
+
+    const entry* best = 0;
+    for (int dy=-1; dy<=1; ++dy)
+      for (int dx=-1; dx<=1; ++dx) {
+	if (!dy && !dx)
+	  continue;
+	i = fits.find(key(gy+dy, gx+dx));
+	if (i != fits.end() && (!best || i->second.counts > best->counts))
+	  best = &i->second;
+      }
+
+    if (!best)
+      return false;
+    scaled(*best, counts, a);
+    return true;
+  }
+
+  void fit_seeds::read(const string& file, const char* const pos[5],
+		       const vector<string>& cols, int subtaps)
+  {
+    if (cols.size() != npar)
+      throw std::logic_error("fit_seeds::read: wrong number of columns");
+
+    vector<string> names(pos, pos+5);
+    names.insert(names.end(), cols.begin(), cols.end());
+
+    std::map<string, vector<string> > c;
+    util::rdb_read(file, c, names);
+    for (size_t j=0; j<names.size(); ++j)
+      if (!c.count(names[j]))
+	throw std::runtime_error("no " + names[j] + " column in " + file);
+
+    const size_t n = c[names[0]].size();
+    vector<double> a(npar);
+    for (size_t i=0; i<n; ++i) {
+      const long gy = util::ss_cast<long>(c[names[0]][i]) * subtaps
+	+ util::ss_cast<long>(c[names[1]][i]);
+      const long gx = util::ss_cast<long>(c[names[2]][i]) * subtaps
+	+ util::ss_cast<long>(c[names[3]][i]);
+      const long counts = util::ss_cast<long>(c[names[4]][i]);
+      for (size_t j=0; j<npar; ++j)
+	a[j] = util::ss_cast<double>(c[cols[j]][i]);
+      add(gy, gx, counts, a.data());
+    }
+  }
+
+  fit_telemetry::fit_telemetry()
+  {
+    std::fill(nfits, nfits+nseeds, 0L);
+    std::fill(nconverged, nconverged+nseeds, 0L);
+    std::fill(nretried, nretried+nseeds, 0L);
+    std::fill(&niter[0][0], &niter[0][0]+nseeds*nbins, 0L);
+    std::fill(&nfev[0][0], &nfev[0][0]+nseeds*nbins, 0L);
+    std::fill(&usec[0][0], &usec[0][0]+nseeds*nbins, 0L);
+    std::fill(seconds, seconds+nseeds, 0.);
+  }
+
+  namespace {
+
+    // bin of v, 0 for v < 1, k for 2^(k-1) <= v < 2^k
+    int log2_bin(double v, int nbins)
+    {
+      int k = 0;
+      while (v >= 1 && k < nbins-1) {
+	v /= 2;
+	++k;
+      }
+      return k;
+    }
+
+    string bin_label(int k, int nbins)
+    {
+      std::ostringstream os;
+      if (!k)
+	os << 0;
+      else {
+	const long lo = 1L << (k-1), hi = (1L << k) - 1;
+	os << lo;
+	if (k == nbins-1)
+	  os << '+';
+	else if (hi > lo)
+	  os << '-' << hi;
+      }
+      return os.str();
+    }
+
+  }
+
+  void fit_telemetry::add(fit_seed seed, const lm_result& r, bool retried)
+  {
+    ++nfits[seed];
+    nconverged[seed] += r.converged;
+    nretried[seed] += retried;
+    ++niter[seed][log2_bin(r.niter, nbins)];
+    ++nfev[seed][log2_bin(r.nfev, nbins)];
+    ++usec[seed][log2_bin(r.seconds * 1e6, nbins)];
+    seconds[seed] += r.seconds;
+  }
+
+  void fit_telemetry::summary(std::ostream& os) const
+  {
+    const std::ios_base::fmtflags flags = os.flags();
+    const std::streamsize prec = os.precision();
+
+    os << std::setw(14) << "";
+    for (int s=0; s<nseeds; ++s)
+      os << std::setw(10) << fit_seed_names[s];
+    os << '\n';
+
+    os << std::setw(14) << std::left << "fits" << std::right;
+    for (int s=0; s<nseeds; ++s)
+      os << std::setw(10) << nfits[s];
+    os << '\n';
+    os << std::setw(14) << std::left << "converged" << std::right;
+    for (int s=0; s<nseeds; ++s)
+      os << std::setw(10) << nconverged[s];
+    os << '\n';
+    os << std::setw(14) << std::left << "retried cold" << std::right;
+    for (int s=0; s<nseeds; ++s)
+      os << std::setw(10) << nretried[s];
+    os << '\n';
+    os << std::setw(14) << std::left << "seconds" << std::right
+       << std::fixed << std::setprecision(3);
+    for (int s=0; s<nseeds; ++s)
+      os << std::setw(10) << seconds[s];
+    os << '\n';
+    os.flags(flags);
+    os.precision(prec);
+
+    const char* names[] = { "iterations", "evaluations", "microseconds" };
+    const long (*h[])[nbins] = { niter, nfev, usec };
+    for (int q=0; q<3; ++q) {
+      int lo = nbins, hi = -1;
+      for (int s=0; s<nseeds; ++s)
+	for (int k=0; k<nbins; ++k)
+	  if (h[q][s][k]) {
+	    lo = std::min(lo, k);
+	    hi = std::max(hi, k);
+	  }
+
+      os << '\n' << names[q] << '\n';
+      for (int k=lo; k<=hi; ++k) {
+	os << "  " << std::setw(12) << std::left << bin_label(k, nbins) << std::right;
+	for (int s=0; s<nseeds; ++s)
+	  os << std::setw(10) << h[q][s][k];
+	os << '\n';
+      }
+    }
+  }
+
+} // namespace lab
@@ -0,0 +1,96 @@
+#ifndef FITSEED_HH
+#define FITSEED_HH
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <unordered_map>
+#include "lmfit.hh"
+
+namespace lab {
+
+  // Warm starts of subtap fits and a record of how the fits went.
+  // Neighboring subtaps have nearly the same gain, so a fit started
+  // from a converged neighbor's parameters, or from those of the same
+  // subtap in another test of the anode, has little left to do.
+
+  // where a fit's initial parameters came from
+  enum fit_seed { seed_cold, seed_test, seed_neighbor, nseeds };
+  extern const char* const fit_seed_names[nseeds];
+
+  // Fits are done in four passes over a checkerboard of 2x2 subtap
+  // cells, every subtap of a pass having neighbors in the passes
+  // before it and none in its own, so each pass can run in parallel:
+  // even rows and columns, even rows and odd columns, odd rows and
+  // even columns, then odd rows and columns. gy and gx are subtap
+  // rows and columns over the detector.
+  const int nfit_passes = 4;
+  inline int fit_pass(long gy, long gx) { return (gy & 1) * 2 + (gx & 1); }
+
+  // Fitted parameters of subtaps by position. Amplitude parameters,
+  // given by index, are scaled by the ratio of counts when passed on.
+  class fit_seeds {
+  private:
+
+    struct entry {
+      long counts;
+      std::size_t par;  // offset in pars
+    };
+
+    std::size_t npar;
+    std::vector<std::size_t> ampl;
+    std::unordered_map<long long, entry> fits;
+    std::vector<double> pars;
+
+    static long long key(long gy, long gx) { return (static_cast<long long>(gy) << 32) + gx; }
+    void scaled(const entry& e, long counts, double* a) const;
+
+  public:
+
+    fit_seeds(std::size_t npar, const std::vector<std::size_t>& ampl)
+      : npar(npar), ampl(ampl) { }
+
+    // a fit of subtap (gy, gx) with counts counts, replacing any other
+    void add(long gy, long gx, long counts, const double* a);
+
+    // initial parameters a for subtap (gy, gx) with counts counts: the
+    // fit of the same subtap, or with neighbors true that of the
+    // neighbor of the eight with the most counts; false if none
+    bool seed(long gy, long gx, long counts, bool neighbors, double* a) const;
+
+    // read the fits of another test from RDB file with a column per
+    // parameter named in cols, subtaps being given by the columns
+    // ytap, ysubtap, xtap, xsubtap and counts, which may be named
+    // differently, e.g., crsv, vsub, crsu, usub and n
+    void read(const std::string& file, const char* const pos[5],
+	      const std::vector<std::string>& cols, int subtaps);
+
+    std::size_t size() const { return fits.size(); }
+  };
+
+  // iterations, evaluations and times of fits, by seed
+  class fit_telemetry {
+  private:
+
+    static const int nbins = 24;
+
+    long nfits[nseeds], nconverged[nseeds], nretried[nseeds];
+    long niter[nseeds][nbins], nfev[nseeds][nbins], usec[nseeds][nbins];
+    double seconds[nseeds];
+
+  public:
+
+    fit_telemetry();
+
+    // a fit started from seed, retried cold if it did not converge
+    void add(fit_seed seed, const lm_result& r, bool retried);
+
+    // counts of fits in power of two bins of iterations, evaluations
+    // and microseconds, and totals, for each seed
+    void summary(std::ostream& os) const;
+  };
+
+} // namespace lab
+
+#endif
@@ -97,28 +97,18 @@ my %maxmedp; # if printing maxmed histograms
 for my $i (0..$#a) {
   my $anode = $a[$i];
 
-  # default values for the case of background plot
-  my ($mcp, $hrc_file) = ([], ['merged_bg']);
-
-  if ($anode ne 'Background') {
-    (undef, undef, $mcp, undef, $hrc_file) = Lab::test_data($anode)
-  }
-
-  my ($n, $hists) = process($hrc_file, $mcp);
+  my ($n, $hists) = process($anode);
   my @n = @$n;
   my @hists = @$hists;
 
   if (!$opts{maxmed}) {
+    # channel at which each fraction is exceeded for each median
+    my $n = $opts{type} eq 'samp' ? 512 : 256;
+    my $pct = Lab::hists_pct(cat(@hists), sequence(long,$n), pdl(@fracs)/100);
+
     for my $j (0..$#fracs) {
       my $frac = $fracs[$j];
 
-      # channel at which this fraction is exceeded for each median
-      my $n = $opts{type} eq 'samp' ? 512 : 256;
-      my @lower = (0)x$n;
-
-      for my $i (0..$#n) {
-	next unless $n[$i];
-
 =begin comment
 
       my $index =which($hists[$i]->cumusumover->double / $hists[$i]->sum <= $frac/100);
@@ -128,10 +118,7 @@ for my $i (0..$#a) {
 
 =cut
 
-	$lower[$i] = $hists[$i]->rld(sequence(long,$n))->pct($frac/100);
-      }
-
-      my $lower = float(\@lower);
+      my $lower = $pct->slice("($j)")->float;
       my $median = sequence(float, $n);
 
       my $i = which($lower > 0);
@@ -158,7 +145,7 @@ for my $i (0..$#a) {
     my ($x2, $y2);
     if ($opts{dual}) {
       $opts{type} = 'samp';
-      my ($n, $hists) = process($hrc_file, $mcp);
+      my ($n, $hists) = process($anode);
       my @n = @$n;
       my @hists = @$hists;
       my $maxi = maximum_ind(float(\@n));
@@ -243,49 +230,17 @@ if ($opts{maxmedp}) {
 exit 0;
 
 sub process {
-  my ($files, $mcp) = @_;
+  my $anode = shift;
 
   $Lab::TYPE = $opts{type};
 
-  my $n = $opts{type} eq 'samp' ? 512 : 256;
-
-  my @n = (0)x$n;
-  my @hists = map { zeroes(long, $n) } 1..$n;
-
-  my $mcp_filter = @$mcp;
-
-  for (0..$#{$files}) {
-
-    my $file = $files->[$_];
-    my $mcp = $mcp->[$_] if $mcp_filter;
-
-    my $bin = "$opts{bindir}/${file}_$opts{type}.bin";
-
-    print STDERR "Processing $bin...";
-    STDERR->flush;
-
-    my ($rawy_min, $rawy_max) = Lab::rawy_limits_mcp($mcp) if $mcp_filter;
-
-    my $it = Lab::InBinFile->new($bin) or die;
-
-    while (my ($ytap, $ysubtap, $xtap, $xsubtap, $y1, $y2, $x1, $x2, $x, $y) = $it->next_subtap) {
-
-      next unless !$mcp_filter or ($y1 >= $rawy_min && $y2 <= $rawy_max);
-
-      my $sum = $y->sum;
-      $sum >= $opts{mincnts} or next;
-
-      my $vals = $y->rld($x);
-      my $median = rint($vals->median)->at;
-
-      $n[$median]++;
-      $hists[$median] += $y;
-    }
-
-    print STDERR "done\n";
-  }
+  # subtaps of every test of the anode, each on its own MCP, or of the
+  # merged background, from the cube store when there is one
+  my $hists = $anode eq 'Background' ?
+    Lab::bg_hists("$opts{bindir}/merged_bg_$opts{type}.bin") :
+    Lab::src_hists($anode, 1, $opts{bindir});
 
-  return \(@n, @hists);
+  return Lab::median_stacks($hists, $opts{mincnts});
 }
 
 sub _help {
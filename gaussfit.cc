@@ -0,0 +1,700 @@
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <cpputil/ss_cast.hh>
+#include "lab.hh"
+#include "cache.hh"
+#include "arena.hh"
+#include "lmfit.hh"
+#include "lmbatch.hh"
+#include "fitseed.hh"
+#include "thread_pool.hh"
+
+using std::cout;
+using std::cerr;
+using std::vector;
+using std::string;
+
+namespace {
+
+  const char* const types[] = { "pha", "samp", "spimean", "spimed" };
+  const int ntypes = sizeof(types) / sizeof(types[0]);
+
+  // parameters of the largest model, two normals with a tail
+  const std::size_t maxpar = lab::normal_gauss_tail::npar;
+
+  namespace opts {
+    string bindir = lab::analdir;
+    string outdir = ".";
+    string binext = ".bin";
+    string rdbext;
+    int fitcnts = 50;
+    int threads = 0;
+    int twogauss = 0;
+    int tail = 0;
+    int checkpoint = 300;
+    int warm = 0;
+    int telemetry = 0;
+    string seedfile;
+
+    const char* version_string = "0.1";
+    int help = 0;
+    int version = 0;
+    option lopts[] = {
+      { "help",     no_argument, &help, 1 },
+      { "version",  no_argument, &version, 1 },
+      { "twogauss", no_argument, &twogauss, 1 },
+      { "tail",     no_argument, &tail, 1 },
+      { "warm",     no_argument, &warm, 1 },
+      { "telemetry", no_argument, &telemetry, 1 },
+      { "seedfile", required_argument, 0, 's' },
+      { "bindir",   required_argument, 0, 'b' },
+      { "outdir",   required_argument, 0, 'o' },
+      { "binext",   required_argument, 0, 'B' },
+      { "rdbext",   required_argument, 0, 'R' },
+      { "fitcnts",  required_argument, 0, 'f' },
+      { "threads",  required_argument, 0, 't' },
+      { "checkpoint", required_argument, 0, 'C' },
+      { 0, 0, 0, 0 }
+    };
+  }
+
+  // histograms, fitted parameters and fit results of all types for
+  // one subtap
+  struct subtap {
+    int ytap, ysubtap, xtap, xsubtap;
+    long n;
+    vector<int> y[ntypes];
+    double par[ntypes][maxpar];
+    lab::lm_result res[ntypes];
+    lab::fit_seed seed[ntypes];
+    bool retried[ntypes];
+  };
+
+  // initial parameters from fits already done, one set for each type:
+  // those of the subtaps of another test and, with --warm, those of
+  // the converged fits of this one
+  struct warm_start {
+    int subtaps;    // per tap, from the BIN files
+    vector<lab::fit_seeds> test, near;
+  };
+
+  bool read_block(vector<std::unique_ptr<lab::binfile_input> >& in,
+		  vector<subtap>& block, std::size_t maxsize);
+  void fit_block(vector<subtap>& block, lab::thread_pool& pool, warm_start& ws);
+  void gaussfit(const string& base, lab::thread_pool& pool);
+
+  int help();
+  int version();
+}
+
+int main(int argc, char** argv) {
+
+  int c;
+  while ((c=getopt_long_only(argc, argv, "", opts::lopts, 0))!=-1) {
+    switch (c) {
+    // a flag was set/unset on our behalf, nothing more to do
+    case 0:
+      break;
+    case 'b':
+      opts::bindir = optarg;
+      break;
+    case 'o':
+      opts::outdir = optarg;
+      break;
+    case 'B':
+      opts::binext = optarg;
+      break;
+    case 'R':
+      opts::rdbext = optarg;
+      break;
+    case 'f':
+      opts::fitcnts = util::ss_cast<int>(optarg);
+      break;
+    case 't':
+      opts::threads = util::ss_cast<int>(optarg);
+      break;
+    case 'C':
+      opts::checkpoint = util::ss_cast<int>(optarg);
+      break;
+    case 's':
+      opts::seedfile = optarg;
+      break;
+    // problem occurred
+    case '?':
+    case ':':
+      cerr << "Try `--help' for more information.\n";
+      return EXIT_FAILURE;
+    // didn't handle all of our specified options
+    default:
+      cerr << "programmer error, unhandled option = "; cerr.put(c); cerr << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opts::help) return help();
+  if (opts::version) return version();
+
+  if ( argc-optind < 1) {
+    cerr << "Usage: " << argv[0] << " [options] base ...\n";
+    return EXIT_FAILURE;
+  }
+
+  if (opts::rdbext.empty())
+    opts::rdbext = string(opts::twogauss ? "_lmfit2" : "_lmfit") +
+      (opts::tail ? "_tail.rdb" : ".rdb");
+
+  try {
+    lab::thread_pool pool(opts::threads);
+    for (int i=optind; i<argc; ++i)
+      gaussfit(argv[i], pool);
+  }
+  catch (std::exception& e) {
+    cerr << argv[0] << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+
+} // main
+
+namespace {
+
+  void gaussfit(const string& base, lab::thread_pool& pool)
+  {
+    vector<std::unique_ptr<lab::binfile_input> > in;
+    lab::digest d;
+    for (int i=0; i<ntypes; ++i) {
+      string file = opts::bindir + '/' + base + '_' + types[i] + opts::binext;
+      in.push_back(std::unique_ptr<lab::binfile_input>(
+	  new lab::binfile_input(file, lab::nbins(types[i]))));
+      d.add_file(file);
+    }
+    d.add(static_cast<long>(opts::twogauss)).add(static_cast<long>(opts::fitcnts));
+    d.add(static_cast<long>(opts::tail));
+    d.add(static_cast<long>(opts::warm));
+    if (!opts::seedfile.empty())
+      d.add_file(opts::seedfile);
+
+    string rdbfile = opts::outdir + '/' + base + opts::rdbext;
+    string telfile = rdbfile;
+    if (telfile.size() > 4 && !telfile.compare(telfile.size()-4, 4, ".rdb"))
+      telfile.erase(telfile.size()-4);
+    telfile += "_telemetry.rdb";
+
+    // resume an interrupted fit of the same inputs, skipping the
+    // subtaps already done
+    const string ckptfile = rdbfile + ".ckpt";
+    lab::checkpoint ckpt;
+    ckpt.files.push_back(rdbfile);
+    ckpt.digests.push_back(d.hex());
+    if (opts::telemetry) {
+      ckpt.files.push_back(telfile);
+      ckpt.digests.push_back(d.hex());
+    }
+    const bool resumed = opts::checkpoint > 0 && lab::resume_checkpoint(ckptfile, ckpt);
+
+    std::ofstream rdb(rdbfile.c_str(), resumed ? std::ios_base::app : std::ios_base::trunc);
+    if (!rdb)
+      throw std::runtime_error("could not open " + rdbfile);
+
+    std::ofstream tel;
+    if (opts::telemetry) {
+      tel.open(telfile.c_str(), resumed ? std::ios_base::app : std::ios_base::trunc);
+      if (!tel)
+	throw std::runtime_error("could not open " + telfile);
+    }
+
+    if (resumed)
+      cerr << "resuming " << rdbfile << " after " << ckpt.done << " subtaps...";
+    else
+      cerr << "creating " << rdbfile << "...";
+
+    const char* fit_cols[] = { "_gnorm", "_gsigma", "_gmean", "_gtail" };
+    const int npar = (opts::twogauss ? 6 : 3) + opts::tail;
+
+    vector<string> cols;
+    cols.push_back("crsv");
+    cols.push_back("vsub");
+    cols.push_back("crsu");
+    cols.push_back("usub");
+    cols.push_back("n");
+    for (int i=0; i<ntypes; ++i)
+      for (int j=0; j<npar; ++j)
+	cols.push_back(string(types[i]) +
+		       fit_cols[opts::tail && j==npar-1 ? 3 : j%3] +
+		       (opts::twogauss && j>=3 ? "2" : ""));
+
+    if (!resumed) {
+      for (vector<string>::size_type i=0; i<cols.size(); ++i)
+	rdb << cols[i] << (i+1<cols.size() ? '\t' : '\n');
+      for (vector<string>::size_type i=0; i<cols.size(); ++i)
+	rdb << 'N' << (i+1<cols.size() ? '\t' : '\n');
+    }
+
+    if (opts::telemetry && !resumed) {
+      tel << "crsv\tvsub\tcrsu\tusub\tn\ttype\tseed\tniter\tnfev\tusec\tconverged\tretried\tchisq\n";
+      tel << "N\tN\tN\tN\tN\tS\tS\tN\tN\tN\tN\tN\tN\n";
+    }
+
+    rdb << std::fixed << std::setprecision(2);
+
+    // norms are scaled by counts when passed from one subtap to another
+    vector<std::size_t> ampl(1, 0);
+    if (opts::twogauss)
+      ampl.push_back(3);
+    warm_start ws;
+    ws.subtaps = 0;
+    lab::fit_telemetry telemetry;
+
+    // subtaps are read and fitted in blocks so that memory use stays
+    // bounded regardless of the size of the BIN files
+    typedef std::chrono::steady_clock clock;
+    clock::time_point last = clock::now();
+
+    vector<subtap> block;
+    std::size_t skip = ckpt.done;
+    while (read_block(in, block, 1024)) {
+
+      if (skip >= block.size()) {
+	skip -= block.size();
+	continue;
+      }
+      block.erase(block.begin(), block.begin() + skip);
+      ckpt.done += block.size();
+      skip = 0;
+
+      // subtaps per tap are taken from the first block, which spans
+      // several rows of taps
+      if (!ws.subtaps && (opts::warm || !opts::seedfile.empty())) {
+	for (vector<subtap>::size_type i=0; i<block.size(); ++i)
+	  ws.subtaps = std::max(ws.subtaps,
+				std::max(block[i].ysubtap, block[i].xsubtap) + 1);
+	ws.near.assign(ntypes, lab::fit_seeds(npar, ampl));
+	if (!opts::seedfile.empty()) {
+	  const char* const pos[] = { "crsv", "vsub", "crsu", "usub", "n" };
+	  ws.test.assign(ntypes, lab::fit_seeds(npar, ampl));
+	  for (int i=0; i<ntypes; ++i)
+	    ws.test[i].read(opts::seedfile, pos,
+			    vector<string>(cols.begin()+5+i*npar,
+					   cols.begin()+5+(i+1)*npar),
+			    ws.subtaps);
+	}
+      }
+
+      fit_block(block, pool, ws);
+
+      for (vector<subtap>::size_type i=0; i<block.size(); ++i) {
+	const subtap& s = block[i];
+	if (s.n < opts::fitcnts)
+	  continue;
+	rdb << s.ytap << '\t' << s.ysubtap << '\t'
+	    << s.xtap << '\t' << s.xsubtap << '\t' << s.n;
+	for (int j=0; j<ntypes; ++j)
+	  for (int k=0; k<npar; ++k)
+	    rdb << '\t' << s.par[j][k];
+	rdb << '\n';
+
+	if (opts::telemetry)
+	  for (int j=0; j<ntypes; ++j) {
+	    const lab::lm_result& r = s.res[j];
+	    telemetry.add(s.seed[j], r, s.retried[j]);
+	    tel << s.ytap << '\t' << s.ysubtap << '\t'
+		<< s.xtap << '\t' << s.xsubtap << '\t' << s.n << '\t'
+		<< types[j] << '\t' << lab::fit_seed_names[s.seed[j]] << '\t'
+		<< r.niter << '\t' << r.nfev << '\t' << r.seconds * 1e6 << '\t'
+		<< r.converged << '\t' << s.retried[j] << '\t' << r.chisq << '\n';
+	  }
+      }
+
+      if (opts::checkpoint > 0 &&
+	  clock::now() - last >= std::chrono::seconds(opts::checkpoint)) {
+	if (!rdb.flush())
+	  throw std::runtime_error("error writing " + rdbfile);
+	if (opts::telemetry && !tel.flush())
+	  throw std::runtime_error("error writing " + telfile);
+	lab::save_checkpoint(ckptfile, ckpt);
+	last = clock::now();
+      }
+    }
+
+    rdb.close();
+    if (!rdb)
+      throw std::runtime_error("error writing " + rdbfile);
+    if (opts::telemetry) {
+      tel.close();
+      if (!tel)
+	throw std::runtime_error("error writing " + telfile);
+    }
+    std::remove(ckptfile.c_str());
+
+    cerr << " done\n";
+    if (opts::telemetry)
+      telemetry.summary(cerr);
+  }
+
+  // read up to maxsize subtaps from each of the input files, which
+  // must list the same subtaps in the same order
+  bool read_block(vector<std::unique_ptr<lab::binfile_input> >& in,
+		  vector<subtap>& block, std::size_t maxsize)
+  {
+    block.resize(maxsize);
+
+    vector<int> x;
+    std::size_t n = 0;
+    for ( ; n<maxsize; ++n) {
+      subtap& s = block[n];
+      int y1, y2, x1, x2;
+
+      if (!in[0]->next_subtap(s.ytap, s.ysubtap, s.xtap, s.xsubtap,
+			      y1, y2, x1, x2, x, s.y[0]))
+	break;
+
+      for (int i=1; i<ntypes; ++i) {
+	int ytap, ysubtap, xtap, xsubtap;
+	if (!in[i]->next_subtap(ytap, ysubtap, xtap, xsubtap,
+				y1, y2, x1, x2, x, s.y[i])
+	    || ytap != s.ytap || ysubtap != s.ysubtap
+	    || xtap != s.xtap || xsubtap != s.xsubtap)
+	  throw lab::binfile_error(string("subtap mismatch in ") + types[i] + " file");
+      }
+
+      s.n = std::accumulate(s.y[0].begin(), s.y[0].end(), 0L);
+    }
+
+    block.resize(n);
+    return n;
+  }
+
+  // Fits of one type for the subtaps fits[lo, hi), lm_lanes at a time,
+  // each started from the fit of the same subtap in another test, a
+  // converged neighbor's or, with cold true or neither to be had,
+  // genstats.pl's initial guesses
+  void fit_chunk(const vector<subtap*>& fits, int type,
+		 std::size_t lo, std::size_t hi,
+		 const warm_start& ws, bool cold)
+  {
+    static thread_local lab::arena scratch;
+    scratch.reset();
+
+    const std::size_t nf = hi - lo;
+    const std::size_t n = fits[lo]->y[type].size();
+    double* xx = scratch.alloc<double>(n);
+    for (std::size_t j=0; j<n; ++j)
+      xx[j] = j;
+
+    const double** yy = scratch.alloc<const double*>(nf);
+    double** par = scratch.alloc<double*>(nf);
+    for (std::size_t f=0; f<nf; ++f) {
+      subtap& s = *fits[lo+f];
+      const vector<int>& y = s.y[type];
+      double* yf = scratch.alloc<double>(n);
+      std::copy(y.begin(), y.end(), yf);
+      yy[f] = yf;
+      par[f] = s.par[type];
+
+      const long gy = long(s.ytap) * ws.subtaps + s.ysubtap;
+      const long gx = long(s.xtap) * ws.subtaps + s.xsubtap;
+      if (!cold && !ws.test.empty() && ws.test[type].seed(gy, gx, s.n, false, par[f]))
+	s.seed[type] = lab::seed_test;
+      else if (!cold && opts::warm && ws.near[type].seed(gy, gx, s.n, true, par[f]))
+	s.seed[type] = lab::seed_neighbor;
+      else {
+	const double norm = std::accumulate(yf, yf+n, 0.);
+	lab::gauss_init(norm, lab::hist_median(y), opts::twogauss, par[f]);
+	if (opts::tail)
+	  par[f][opts::twogauss ? 6 : 3] = 2;
+	if (!cold)
+	  s.seed[type] = lab::seed_cold;
+      }
+    }
+
+    vector<lab::lm_result> r(nf);
+    if (opts::tail) {
+      // the tail must fall off below the peak
+      double amin[maxpar], amax[maxpar];
+      std::fill(amin, amin+maxpar, -HUGE_VAL);
+      std::fill(amax, amax+maxpar, HUGE_VAL);
+      amin[opts::twogauss ? 6 : 3] = 0.1;
+      lab::lm_options opt;
+      opt.lo = amin;
+      opt.hi = amax;
+
+      if (opts::twogauss)
+	lab::lmfit_batch(lab::normal_gauss_tail(), xx, n, yy, 0, par, r.data(), nf, scratch, opt);
+      else
+	lab::lmfit_batch(lab::gauss_tail(), xx, n, yy, 0, par, r.data(), nf, scratch, opt);
+    }
+    else if (opts::twogauss)
+      lab::lmfit_batch(lab::two_normals(), xx, n, yy, 0, par, r.data(), nf, scratch);
+    else
+      lab::lmfit_batch(lab::one_normal(), xx, n, yy, 0, par, r.data(), nf, scratch);
+
+    for (std::size_t f=0; f<nf; ++f)
+      fits[lo+f]->res[type] = r[f];
+  }
+
+  // fits of all types of the subtaps given, each type in chunks of a
+  // few lmfit_batch lane groups over the pool
+  void fit_subtaps(const vector<subtap*> fits[ntypes], lab::thread_pool& pool,
+		   const warm_start& ws, bool cold)
+  {
+    const std::size_t chunk = 8 * lab::lm_lanes;
+    vector<std::pair<int, std::size_t> > tasks;
+    for (int t=0; t<ntypes; ++t)
+      for (std::size_t lo=0; lo<fits[t].size(); lo+=chunk)
+	tasks.push_back(std::make_pair(t, lo));
+
+    lab::parallel_for(pool, tasks.size(),
+		      [&](std::size_t k) {
+			const int t = tasks[k].first;
+			const std::size_t lo = tasks[k].second;
+			fit_chunk(fits[t], t, lo, std::min(lo + chunk, fits[t].size()),
+				  ws, cold);
+		      }, 1);
+  }
+
+  // The subtaps of a block with enough counts to be fitted. With
+  // --warm they are fitted in the passes of lab::fit_pass, each pass
+  // from the converged fits of those before it and of earlier blocks.
+  // A warm started fit which does not converge is done again cold and
+  // the better of the two kept.
+  void fit_block(vector<subtap>& block, lab::thread_pool& pool, warm_start& ws)
+  {
+    const int npasses = opts::warm ? lab::nfit_passes : 1;
+    for (int p=0; p<npasses; ++p) {
+
+      vector<subtap*> fits[ntypes];
+      for (vector<subtap>::size_type i=0; i<block.size(); ++i) {
+	subtap& s = block[i];
+	if (s.n < opts::fitcnts)
+	  continue;
+	if (opts::warm && lab::fit_pass(long(s.ytap) * ws.subtaps + s.ysubtap,
+					long(s.xtap) * ws.subtaps + s.xsubtap) != p)
+	  continue;
+	for (int t=0; t<ntypes; ++t) {
+	  fits[t].push_back(&s);
+	  s.seed[t] = lab::seed_cold;
+	  s.retried[t] = false;
+	}
+      }
+      fit_subtaps(fits, pool, ws, false);
+
+      // warm starts gone wrong, which hold on to their first results
+      // while they are fitted again
+      vector<subtap*> retry[ntypes];
+      vector<double> par[ntypes];
+      vector<lab::lm_result> res[ntypes];
+      for (int t=0; t<ntypes; ++t)
+	for (std::size_t f=0; f<fits[t].size(); ++f) {
+	  subtap& s = *fits[t][f];
+	  if (s.seed[t] == lab::seed_cold || s.res[t].converged)
+	    continue;
+	  retry[t].push_back(&s);
+	  par[t].insert(par[t].end(), s.par[t], s.par[t] + maxpar);
+	  res[t].push_back(s.res[t]);
+	}
+      fit_subtaps(retry, pool, ws, true);
+
+      for (int t=0; t<ntypes; ++t)
+	for (std::size_t f=0; f<retry[t].size(); ++f) {
+	  subtap& s = *retry[t][f];
+	  const lab::lm_result& warm = res[t][f];
+	  lab::lm_result& r = s.res[t];
+	  s.retried[t] = true;
+	  r.niter += warm.niter;
+	  r.nfev += warm.nfev;
+	  r.seconds += warm.seconds;
+	  if (!(r.chisq < warm.chisq)) {
+	    r.chisq = warm.chisq;
+	    r.converged = warm.converged;
+	    std::copy(&par[t][f * maxpar], &par[t][f * maxpar] + maxpar,
+		      s.par[t]);
+	  }
+	}
+
+      if (opts::warm)
+	for (int t=0; t<ntypes; ++t)
+	  for (std::size_t f=0; f<fits[t].size(); ++f) {
+	    const subtap& s = *fits[t][f];
+	    if (s.res[t].converged)
+	      ws.near[t].add(long(s.ytap) * ws.subtaps + s.ysubtap,
+			     long(s.xtap) * ws.subtaps + s.xsubtap,
+			     s.n, s.par[t]);
+	  }
+    }
+  }
+
+  int version() {
+    cout << opts::version_string << '\n';
+    return 0;
+  }
+
+  int help() {
+    const char* help_text = "\
+=head1 NAME\n\
+\n\
+gaussfit - fit Gaussians to the subtap histograms of genstats BIN files\n\
+\n\
+=head1 SYNOPSIS\n\
+\n\
+gaussfit [options] base ...\n\
+\n\
+=head1 DESCRIPTION\n\
+\n\
+A native replacement for the I<--fit> option of F<genstats.pl>. For\n\
+each test basename given (e.g., p197061024), reads the PHA, SAMP,\n\
+SPIMEAN and SPIMED BIN files written by F<genstats.pl> and fits a\n\
+single (or, with I<--twogauss>, double) normal distribution to the\n\
+histogram of each subtap using the Levenberg-Marquardt method with\n\
+analytic partial derivatives. Initial parameters are those used by\n\
+F<genstats.pl>: the histogram sum, a sigma of 15 and the median.\n\
+Subtaps are fitted in parallel, and several at a time on each thread\n\
+with the fits in vector lanes.\n\
+\n\
+Output is an RDB file per test with columns crsv, vsub, crsu, usub,\n\
+n and the F<genstats.pl> fit columns (pha_gnorm, pha_gsigma,\n\
+pha_gmean, ...).\n\
+\n\
+=head1 OPTIONS\n\
+\n\
+=over 4\n\
+\n\
+=item --help\n\
+\n\
+Print this help text and exit.\n\
+\n\
+=item --version\n\
+\n\
+Print the program version and exit.\n\
+\n\
+=item --bindir=s\n\
+\n\
+Location of the BIN files. The default is\n\
+F</data/legs/rpete/data/hrcs_lab/analysis>.\n\
+\n\
+=item --binext=s\n\
+\n\
+Extension of the BIN files. The default is F<.bin>.\n\
+\n\
+=item --outdir=s\n\
+\n\
+Where to put the output files. The default is the current directory.\n\
+\n\
+=item --rdbext=s\n\
+\n\
+Extension of the output RDB files. The default is F<_lmfit.rdb>, or\n\
+F<_lmfit2.rdb> with I<--twogauss>, with F<_tail> before F<.rdb> for\n\
+I<--tail>.\n\
+\n\
+=item --twogauss\n\
+\n\
+Fit double Gaussians instead of single.\n\
+\n\
+=item --tail\n\
+\n\
+Give the Gaussian, or the second, main, Gaussian with I<--twogauss>,\n\
+an exponential low-energy tail, the model of the tail studies of\n\
+F<low_e_stats.pl>: below I<k> sigma under the mean the normal\n\
+distribution turns into an exponential falling off with slope I<k> /\n\
+sigma, the model and its slope being continuous. I<k> starts at 2, is\n\
+held above 0.1 and is written to the column I<type>_gtail (or\n\
+_gtail2), the norm remaining the area of the normal part.\n\
+\n\
+=item --fitcnts=i\n\
+\n\
+Minimum number of PHA counts a subtap must have to be fitted. The\n\
+default value is 50.\n\
+\n\
+=item --warm\n\
+\n\
+Start each fit from the parameters of a converged neighboring subtap,\n\
+that with the most counts of the eight, norms scaled by the ratio of\n\
+counts. Subtaps are fitted in four passes over a checkerboard of 2x2\n\
+subtap cells, so that every subtap has neighbors fitted before it\n\
+while the subtaps of each pass are fitted in parallel. A subtap with\n\
+no converged neighbor starts from the usual initial parameters.\n\
+\n\
+=item --seedfile=s\n\
+\n\
+Start the fit of each subtap from its fit in RDB file I<s>, the output\n\
+of F<gaussfit> with the same I<--twogauss> for another test of the\n\
+same anode, in preference to any neighbor's.\n\
+\n\
+Warm started fits which do not converge are fitted again from the\n\
+usual initial parameters and the one with the lower chi-square kept.\n\
+\n\
+=item --telemetry\n\
+\n\
+Write the number of iterations, model evaluations, time in\n\
+microseconds, convergence and chi-square of every fit, with where its\n\
+initial parameters came from, to the output RDB file with\n\
+F<_telemetry> before F<.rdb>, e.g., F<base_lmfit_telemetry.rdb>, and\n\
+a summary of them, with histograms, to stderr. Times are a fit's share\n\
+of those of the lanes it was fitted in.\n\
+\n\
+=item --threads=i\n\
+\n\
+Number of fitting threads. The default is one per processor core.\n\
+\n\
+=item --checkpoint=i\n\
+\n\
+Interval in seconds between checkpoints of a fit, the default being\n\
+300. The RDB file is flushed and the number of subtaps done recorded\n\
+in a F<.ckpt> file alongside it, so that rerunning an interrupted fit\n\
+of unchanged BIN files continues from the last checkpoint rather\n\
+than starting over. Zero disables checkpointing and resuming.\n\
+\n\
+=back\n\
+\n\
+=head1 AUTHOR\n\
+\n\
+Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt>\n\
+\n\
+=head1 SEE ALSO\n\
+\n\
+genstats.pl\n\
+\n\
+=cut\n\
+";
+
+    const char* pager = std::getenv("PAGER");
+    if (!pager) pager = "more";
+
+    FILE* pd = popen((std::string("pod2text -c | ")+pager).c_str(), "w");
+    if (!pd) {
+      std::perror("error starting pod2text");
+      return EXIT_FAILURE;
+    }
+
+    int n = 0;
+    int len = std::strlen(help_text);
+    while (n < len) {
+      int written = std::fwrite(help_text, 1, len-n, pd);
+      if (!written) {
+	std::perror("error writing help");
+	return EXIT_FAILURE;
+      }
+      n+=written;
+    }
+
+    if (pclose(pd) == -1) {
+      std::perror("error writing help");
+      return EXIT_FAILURE;
+    }
+
+    return 0;
+  }
+
+}
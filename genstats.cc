@@ -0,0 +1,1493 @@
+#include <vector>
+#include <string>
+#include <map>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <cmath>
+#include <getopt.h>
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <numeric>
+#include <memory>
+#include <sstream>
+#include <mutex>
+#include <chrono>
+#include <set>
+#include <cpputil/ss_cast.hh>
+#include "lab.hh"
+#include "evtfile.hh"
+#include "subtap.hh"
+#include "stats.hh"
+#include "bgcube.hh"
+#include "lmfit.hh"
+#include "lmbatch.hh"
+#include "thread_pool.hh"
+#include "cache.hh"
+#include "evtbands.hh"
+#include "bootstrap.hh"
+
+using std::cout;
+using std::cerr;
+using std::vector;
+using std::string;
+using std::map;
+
+namespace {
+
+  namespace opts {
+    string config = "hrcs_lab.rdb";
+    string filtdir = lab::analdir;
+    string outdir = ".";
+    string bgfile = string(lab::analdir) + "/merged_bg_evt1_filt_spi.fits";
+    string rdbext;
+    string binext;
+    int subtaps = 3;
+    int subext = 1;
+    int three_by_three = 0;
+    int bgsubtract = 0;
+    int bgfulltap = 0;
+    int bincnts = 1;
+    int fit = 0;
+    int twogauss = 0;
+    int fitcnts = 50;
+    int rdb = 1;
+    int bin = 1;
+    int threads = 0;
+    int cache = 1;
+    int zorder = 0;
+    int maxmem = 0;
+    int shard = 0, nshards = 0;
+    int reduce = 0;
+    int checkpoint = 300;
+    int bootstrap = 0;
+    long seed = 1;
+    double trim = 0.05;
+    vector<string> variants;
+
+    const char* version_string = "0.1";
+    int help = 0;
+    int version = 0;
+    option lopts[] = {
+      { "help",       no_argument, &help, 1 },
+      { "version",    no_argument, &version, 1 },
+      { "subext",     no_argument, &subext, 1 },
+      { "nosubext",   no_argument, &subext, 0 },
+      { "3x3",        no_argument, &three_by_three, 1 },
+      { "bgsubtract", no_argument, &bgsubtract, 1 },
+      { "bgfulltap",  no_argument, &bgfulltap, 1 },
+      { "fit",        no_argument, &fit, 1 },
+      { "twogauss",   no_argument, &twogauss, 1 },
+      { "rdb",        no_argument, &rdb, 1 },
+      { "nordb",      no_argument, &rdb, 0 },
+      { "bin",        no_argument, &bin, 1 },
+      { "nobin",      no_argument, &bin, 0 },
+      { "cache",      no_argument, &cache, 1 },
+      { "nocache",    no_argument, &cache, 0 },
+      { "zorder",     no_argument, &zorder, 1 },
+      { "config",     required_argument, 0, 'c' },
+      { "filtdir",    required_argument, 0, 'f' },
+      { "outdir",     required_argument, 0, 'o' },
+      { "bgfile",     required_argument, 0, 'g' },
+      { "rdbext",     required_argument, 0, 'R' },
+      { "binext",     required_argument, 0, 'B' },
+      { "subtaps",    required_argument, 0, 's' },
+      { "bincnts",    required_argument, 0, 'b' },
+      { "fitcnts",    required_argument, 0, 'F' },
+      { "threads",    required_argument, 0, 't' },
+      { "variant",    required_argument, 0, 'V' },
+      { "maxmem",     required_argument, 0, 'M' },
+      { "shard",      required_argument, 0, 'S' },
+      { "reduce",     required_argument, 0, 'r' },
+      { "checkpoint", required_argument, 0, 'C' },
+      { "bootstrap",  required_argument, 0, 'N' },
+      { "seed",       required_argument, 0, 'e' },
+      { 0, 0, 0, 0 }
+    };
+  }
+
+  // everything genstats reports for a single subtap
+  struct subtap_result {
+    int ytap, ysubtap, xtap, xsubtap;
+    long y1, y2, x1, x2;
+    const char* subs;
+    long n, norig, pha_lt_3, pha255;
+    double nnet;
+    lab::col_stats st[lab::ndata_cols];
+    lab::col_stats se[lab::ndata_cols];  // bootstrap standard errors
+    double par[lab::ndata_cols][lab::two_normals::npar];
+    vector<double> vals[lab::ndata_cols]; // for BIN output, reused row to row
+    vector<double> hist[lab::ndata_cols]; // to be fitted, reused row to row
+  };
+
+  // The options which may differ between the runs of a batch, c.f.
+  // --variant. Each run writes its own RDB/BIN files.
+  struct variant {
+    int subext, three_by_three, bgsubtract, bgfulltap;
+    int rdb, bin, fit, twogauss, bincnts, fitcnts, bootstrap;
+    string rdbext, binext;
+    vector<string> tests;  // empty for the tests on the command line
+  };
+
+  // A variant as run for one test, with rdb/bin cleared for outputs
+  // which are current or are overwritten later in the batch. digest
+  // is that of the inputs the outputs are made from.
+  struct job {
+    variant v;
+    string digest;
+  };
+
+  // the open output files of a job
+  struct outputs {
+    vector<string> files;  // as written, c.f. written_files()
+    std::ofstream rdb;
+    vector< std::shared_ptr<lab::binfile_output> > bin;
+  };
+
+  // data shared by all subtaps of a test
+  struct test_context {
+    const lab::subtap_grid& grid;
+    const lab::events& src;
+    const lab::partition& part;
+    const lab::bgcube* bg;
+    double exptime;
+  };
+
+  variant default_variant();
+  variant parse_variant(const string& spec);
+  vector<string> resolve_tests(const vector<string>& args);
+  string rdb_file(const string& base, const variant& v);
+  string bin_file(const string& base, const variant& v, int col);
+  string inputs_digest(const string& base, const variant& v);
+  vector<job> plan(const string& base, const vector<const variant*>& vars,
+		   lab::result_cache* cache);
+  void genstats(const string& base, const vector<job>& jobs,
+		const lab::subtap_grid& grid, const lab::bgcube* bg,
+		lab::thread_pool* pool, lab::result_cache* cache);
+  vector<string> output_files(const string& base, const variant& v);
+  string part_file(const string& file, const job& j, int shard, int nshards);
+  void shard_rows(const lab::subtap_grid& grid, int shard, int nshards,
+		  std::size_t& y1, std::size_t& y2);
+  void reduce(const string& base, const vector<job>& jobs, int nshards,
+	      lab::result_cache* cache);
+  vector<string> written_files(const string& base, const job& j);
+  void open_outputs(const string& base, const job& j, outputs& out,
+		    bool append);
+  void flush_outputs(outputs& out);
+  void close_outputs(const string& base, const job& j, outputs& out);
+  void write_row(const test_context& ctx, const variant& v, std::size_t y,
+		 lab::thread_pool* pool, vector<subtap_result>& results,
+		 outputs& out);
+  void process_subtap(const test_context& ctx, const variant& v,
+		      std::size_t i, subtap_result& r);
+  bool fitted(const variant& v, const subtap_result& r);
+  void fit_row(const variant& v, vector<subtap_result>& results,
+	       lab::thread_pool* pool);
+  vector<string> rdb_colnames(const variant& v, vector<string>& types);
+  void print_rdb(std::ostream& out, const variant& v, const subtap_result& r);
+  void note(const string& s);
+
+  int help();
+  int version();
+}
+
+int main(int argc, char** argv) {
+
+  int c;
+  while ((c=getopt_long_only(argc, argv, "", opts::lopts, 0))!=-1) {
+    switch (c) {
+    // a flag was set/unset on our behalf, nothing more to do
+    case 0:
+      break;
+    case 'c':
+      opts::config = optarg;
+      break;
+    case 'f':
+      opts::filtdir = optarg;
+      break;
+    case 'o':
+      opts::outdir = optarg;
+      break;
+    case 'g':
+      opts::bgfile = optarg;
+      break;
+    case 'R':
+      opts::rdbext = optarg;
+      break;
+    case 'B':
+      opts::binext = optarg;
+      break;
+    case 's':
+      opts::subtaps = util::ss_cast<int>(optarg);
+      break;
+    case 'b':
+      opts::bincnts = util::ss_cast<int>(optarg);
+      break;
+    case 'F':
+      opts::fitcnts = util::ss_cast<int>(optarg);
+      break;
+    case 't':
+      opts::threads = util::ss_cast<int>(optarg);
+      break;
+    case 'V':
+      opts::variants.push_back(optarg);
+      break;
+    case 'M':
+      opts::maxmem = util::ss_cast<int>(optarg);
+      break;
+    case 'S':
+      {
+	// k/n, zero-based
+	string s = optarg;
+	string::size_type slash = s.find('/');
+	if (slash != string::npos) {
+	  opts::shard = util::ss_cast<int>(s.substr(0, slash));
+	  opts::nshards = util::ss_cast<int>(s.substr(slash+1));
+	}
+	if (opts::nshards < 1 || opts::shard < 0 || opts::shard >= opts::nshards) {
+	  cerr << argv[0] << ": invalid shard '" << optarg << "'\n";
+	  return EXIT_FAILURE;
+	}
+      }
+      break;
+    case 'r':
+      opts::reduce = util::ss_cast<int>(optarg);
+      break;
+    case 'C':
+      opts::checkpoint = util::ss_cast<int>(optarg);
+      break;
+    case 'N':
+      opts::bootstrap = util::ss_cast<int>(optarg);
+      break;
+    case 'e':
+      opts::seed = util::ss_cast<long>(optarg);
+      break;
+    // problem occurred
+    case '?':
+    case ':':
+      cerr << "Try `--help' for more information.\n";
+      return EXIT_FAILURE;
+    // didn't handle all of our specified options
+    default:
+      cerr << "programmer error, unhandled option = "; cerr.put(c); cerr << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opts::help) return help();
+  if (opts::version) return version();
+
+  try {
+    // a plain run is a batch of one
+    vector<variant> vars;
+    if (opts::variants.empty())
+      vars.push_back(default_variant());
+    for (vector<string>::size_type i=0; i<opts::variants.size(); ++i)
+      vars.push_back(parse_variant(opts::variants[i]));
+
+    // tests to process, and the variants to run for each
+    vector<string> base;
+    map<string, vector<const variant*> > test_vars;
+    for (vector<variant>::size_type i=0; i<vars.size(); ++i) {
+      vector<string> args = vars[i].tests;
+      if (args.empty())
+	args.assign(argv+optind, argv+argc);
+      vector<string> b = resolve_tests(args);
+      for (vector<string>::size_type j=0; j<b.size(); ++j) {
+	if (!test_vars.count(b[j]))
+	  base.push_back(b[j]);
+	test_vars[b[j]].push_back(&vars[i]);
+      }
+    }
+
+    std::unique_ptr<lab::result_cache> cache;
+    if (opts::cache)
+      cache.reset(new lab::result_cache(opts::outdir));
+
+    // tests with outputs left to make, and what to make for each
+    vector<string> todo;
+    map<string, vector<job> > test_jobs;
+    bool need_bg = false;
+    for (vector<string>::size_type i=0; i<base.size(); ++i) {
+      vector<job> jobs = plan(base[i], test_vars[base[i]], cache.get());
+      if (jobs.empty()) {
+	note("outputs of " + base[i] + " are current");
+	continue;
+      }
+      for (vector<job>::size_type j=0; j<jobs.size(); ++j)
+	need_bg = need_bg || (jobs[j].v.bgsubtract && !opts::reduce);
+      todo.push_back(base[i]);
+      test_jobs[base[i]].swap(jobs);
+    }
+
+    // the outputs of sharded runs need only be put together
+    if (opts::reduce) {
+      for (vector<string>::size_type i=0; i<todo.size(); ++i)
+	reduce(todo[i], test_jobs[todo[i]], opts::reduce, cache.get());
+      return 0;
+    }
+
+    lab::subtap_grid grid(opts::subtaps, opts::zorder);
+    lab::thread_pool pool(opts::threads);
+
+    // the background is histogrammed once, for all tests and variants
+    std::unique_ptr<lab::bgcube> bg;
+    if (need_bg) {
+      note("reading " + opts::bgfile);
+      bg.reset(new lab::bgcube(grid, lab::merged_bg_exptimes(opts::config)));
+      lab::event_reader in(opts::bgfile, true);
+      lab::events chunk;
+      while (in.read(chunk, 1L << 20))
+	bg->add(chunk);
+    }
+
+    // with enough tests to keep every thread busy, whole tests are
+    // spread over the pool, otherwise the subtaps of each test are
+    if (todo.size() > 1 && todo.size() >= pool.size()) {
+      const lab::bgcube* bgp = bg.get();
+      lab::result_cache* cp = cache.get();
+      for (vector<string>::size_type i=0; i<todo.size(); ++i) {
+	const string& b = todo[i];
+	const vector<job>& j = test_jobs[b];
+	pool.submit([&b, &j, &grid, bgp, cp]() { genstats(b, j, grid, bgp, 0, cp); });
+      }
+      pool.wait();
+    }
+    else
+      for (vector<string>::size_type i=0; i<todo.size(); ++i)
+	genstats(todo[i], test_jobs[todo[i]], grid, bg.get(), &pool, cache.get());
+  }
+  catch (std::exception& e) {
+    cerr << argv[0] << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+
+} // main
+
+namespace {
+
+  variant default_variant()
+  {
+    variant v;
+    v.subext = opts::subext;
+    v.three_by_three = opts::three_by_three;
+    v.bgsubtract = opts::bgsubtract;
+    v.bgfulltap = opts::bgfulltap;
+    v.rdb = opts::rdb;
+    v.bin = opts::bin;
+    v.fit = opts::fit;
+    v.twogauss = opts::twogauss;
+    v.bincnts = opts::bincnts;
+    v.fitcnts = opts::fitcnts;
+    v.bootstrap = opts::bootstrap;
+    v.rdbext = opts::rdbext;
+    v.binext = opts::binext;
+    if (v.rdbext.empty())
+      v.rdbext = v.three_by_three ? "_3x3.rdb" : ".rdb";
+    if (v.binext.empty())
+      v.binext = v.three_by_three ? "_3x3.bin" : ".bin";
+    return v;
+  }
+
+  // A variant is given as genstats.pl arguments, e.g., "--3x3 --nobin
+  // --bgsubtract B-Ka", which apply on top of the global options.
+  // Non-option arguments restrict the variant to those tests.
+  variant parse_variant(const string& spec)
+  {
+    variant v = default_variant();
+    string rdbext = opts::rdbext, binext = opts::binext;
+
+    std::istringstream in(spec);
+    string tok;
+    while (in >> tok) {
+      if (tok.compare(0, 2, "--")) {
+	v.tests.push_back(tok);
+	continue;
+      }
+
+      string name = tok.substr(2), value;
+      string::size_type eq = name.find('=');
+      if (eq != string::npos) {
+	value = name.substr(eq+1);
+	name.erase(eq);
+      }
+
+      if (name == "subext") v.subext = 1;
+      else if (name == "nosubext") v.subext = 0;
+      else if (name == "3x3") v.three_by_three = 1;
+      else if (name == "bgsubtract") v.bgsubtract = 1;
+      else if (name == "bgfulltap") v.bgfulltap = 1;
+      else if (name == "fit") v.fit = 1;
+      else if (name == "twogauss") v.twogauss = 1;
+      else if (name == "rdb") v.rdb = 1;
+      else if (name == "nordb") v.rdb = 0;
+      else if (name == "bin") v.bin = 1;
+      else if (name == "nobin") v.bin = 0;
+      else if (name == "bincnts" && !value.empty())
+	v.bincnts = util::ss_cast<int>(value);
+      else if (name == "fitcnts" && !value.empty())
+	v.fitcnts = util::ss_cast<int>(value);
+      else if (name == "bootstrap" && !value.empty())
+	v.bootstrap = util::ss_cast<int>(value);
+      else if (name == "rdbext" && !value.empty())
+	rdbext = value;
+      else if (name == "binext" && !value.empty())
+	binext = value;
+      else
+	throw std::invalid_argument("unrecognized variant option '" + tok + "'");
+    }
+
+    v.rdbext = !rdbext.empty() ? rdbext : v.three_by_three ? "_3x3.rdb" : ".rdb";
+    v.binext = !binext.empty() ? binext : v.three_by_three ? "_3x3.bin" : ".bin";
+
+    return v;
+  }
+
+  // test basenames from the command line, where anode names (e.g.,
+  // B-Ka) expand to all of their tests and no arguments means all
+  vector<string> resolve_tests(const vector<string>& args)
+  {
+    vector<string> line, hrc_file, bg_hrc_file;
+    vector<int> energy, mcp, time, bg_time;
+    lab::test_data(opts::config, vector<string>(), line, energy, mcp, time,
+		   hrc_file, bg_time, bg_hrc_file);
+
+    vector<string> base;
+    if (args.empty())
+      base = hrc_file;
+
+    for (vector<string>::size_type i=0; i<args.size(); ++i) {
+      const string& b = args[i];
+      if (find(line.begin(), line.end(), b) != line.end()) {
+	for (vector<string>::size_type j=0; j<line.size(); ++j)
+	  if (line[j] == b)
+	    base.push_back(hrc_file[j]);
+      }
+      else
+	base.push_back(b);
+    }
+
+    for (vector<string>::size_type i=0; i<base.size(); ++i) {
+      string evt1 = opts::filtdir + '/' + base[i] + "_evt1_filt_spi.fits";
+      if (!std::ifstream(evt1.c_str()))
+	throw std::runtime_error("could not find file '" + evt1 + "'");
+    }
+
+    return base;
+  }
+
+  string rdb_file(const string& base, const variant& v)
+  {
+    return opts::outdir + '/' + base + v.rdbext;
+  }
+
+  string bin_file(const string& base, const variant& v, int col)
+  {
+    return opts::outdir + '/' + base + '_' + lab::data_col_names[col] + v.binext;
+  }
+
+  // Digest of everything the outputs of a variant depend on. Only the
+  // test's own row of the configuration file is included, so editing
+  // the entries of one anode leaves the outputs of the others current.
+  string inputs_digest(const string& base, const variant& v)
+  {
+    lab::digest d;
+    d.add(string(opts::version_string));
+    d.add_file(opts::filtdir + '/' + base + "_evt1_filt_spi.fits");
+
+    vector<string> line, hrc_file, bg_hrc_file;
+    vector<int> energy, mcp, time, bg_time;
+    lab::test_data(opts::config, vector<string>(), line, energy, mcp, time,
+		   hrc_file, bg_time, bg_hrc_file);
+    for (vector<string>::size_type i=0; i<hrc_file.size(); ++i)
+      if (hrc_file[i] == base)
+	d.add(line[i]).add(long(energy[i])).add(long(mcp[i])).add(long(time[i]))
+	  .add(long(bg_time[i])).add(bg_hrc_file[i]);
+
+    d.add(opts::trim).add(long(opts::subtaps));
+    d.add(long(v.subext)).add(long(v.three_by_three));
+    d.add(long(v.bgsubtract)).add(long(v.bgfulltap));
+    d.add(long(v.fit)).add(long(v.twogauss));
+    d.add(long(v.bincnts)).add(long(v.fitcnts));
+    if (v.bootstrap)
+      d.add(long(v.bootstrap)).add(opts::seed);
+
+    // the background exposure times depend on the whole configuration
+    if (v.bgsubtract) {
+      d.add_file(opts::bgfile);
+      map<int, double> bgtimes = lab::merged_bg_exptimes(opts::config);
+      for (map<int, double>::const_iterator it=bgtimes.begin(); it!=bgtimes.end(); ++it)
+	d.add(long(it->first)).add(it->second);
+    }
+
+    return d.hex();
+  }
+
+  // The variants left to run for a test. Later variants are visited
+  // first so that an output written by several of them is only made by
+  // the last, as its file is what remains after the batch.
+  vector<job> plan(const string& base, const vector<const variant*>& vars,
+		   lab::result_cache* cache)
+  {
+    vector<job> jobs;
+    std::set<string> claimed;
+
+    for (vector<const variant*>::size_type i=vars.size(); i-->0; ) {
+      job j = { *vars[i], inputs_digest(base, *vars[i]) };
+
+      if (j.v.rdb) {
+	string f = rdb_file(base, j.v);
+	j.v.rdb = claimed.insert(f).second && !(cache && cache->current(f, j.digest));
+      }
+
+      if (j.v.bin) {
+	bool current = cache != 0;
+	for (int c=0; c<lab::ndata_cols && current; ++c)
+	  current = cache->current(bin_file(base, j.v, c), j.digest);
+	j.v.bin = claimed.insert(bin_file(base, j.v, 0)).second && !current;
+      }
+
+      if (j.v.rdb || j.v.bin)
+	jobs.insert(jobs.begin(), j);
+    }
+
+    return jobs;
+  }
+
+  // The events of a test are read and partitioned once, and every
+  // variant is produced from them. Subtaps are spread over the pool,
+  // if there is one. With --maxmem, an event list too large for the
+  // limit is spilled into bands of tap rows which are then processed
+  // one at a time. With --shard, only the shard's tap rows are done.
+  //
+  // Every --checkpoint seconds the outputs are flushed and the rows
+  // done recorded, so that a rerun after an interruption resumes there.
+  void genstats(const string& base, const vector<job>& jobs,
+		const lab::subtap_grid& grid, const lab::bgcube* bg,
+		lab::thread_pool* pool, lab::result_cache* cache)
+  {
+    double exptime = 0;
+    for (vector<job>::size_type i=0; i<jobs.size(); ++i)
+      if (jobs[i].v.bgsubtract) {
+	exptime = lab::test_exptime(opts::config, base);
+	break;
+      }
+
+    string evt1 = opts::filtdir + '/' + base + "_evt1_filt_spi.fits";
+    note("reading " + evt1);
+    lab::event_reader in(evt1);
+
+    // memory per event: its values and its place in the partition
+    const double evtsize = sizeof(lab::packed_event)
+      + (lab::ndata_cols-1) * sizeof(float) + sizeof(std::size_t);
+
+    std::size_t sy1 = 0, sy2 = grid.ny();
+    if (opts::nshards)
+      shard_rows(grid, opts::shard, opts::nshards, sy1, sy2);
+
+    long chunk = 1L << 20;
+    std::unique_ptr<lab::event_bands> bands;
+    if (opts::maxmem > 0) {
+      const double maxmem = opts::maxmem * 1048576.;
+      const double rows = double(in.rows()) * (sy2 - sy1) / grid.ny();
+      const std::size_t nbands = std::ceil(rows * evtsize / maxmem);
+      chunk = std::max(1L, long(maxmem / evtsize / 4));
+      if (nbands > 1) {
+	bands.reset(new lab::event_bands(grid, in, nbands, chunk, sy1, sy2));
+	note("split " + evt1 + " into " + util::ss_cast<string>(bands->size()) + " bands");
+      }
+    }
+
+    // a checkpoint of the same outputs from the same inputs
+    string ckptfile = opts::outdir + '/' + base;
+    if (opts::nshards)
+      ckptfile += ".part" + util::ss_cast<string>(opts::shard)
+	+ "of" + util::ss_cast<string>(opts::nshards);
+    ckptfile += ".ckpt";
+
+    lab::checkpoint ckpt;
+    for (vector<job>::size_type i=0; i<jobs.size(); ++i) {
+      vector<string> files = written_files(base, jobs[i]);
+      ckpt.files.insert(ckpt.files.end(), files.begin(), files.end());
+      ckpt.digests.insert(ckpt.digests.end(), files.size(), jobs[i].digest);
+    }
+
+    const bool resumed = opts::checkpoint > 0 && lab::resume_checkpoint(ckptfile, ckpt);
+    if (resumed)
+      note("resuming " + base + " at subtap row " + util::ss_cast<string>(ckpt.done));
+
+    vector<outputs> out(jobs.size());
+    for (vector<job>::size_type i=0; i<jobs.size(); ++i)
+      open_outputs(base, jobs[i], out[i], resumed);
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point last = clock::now();
+
+    vector<subtap_result> results(grid.subtaps() * grid.nx());
+    lab::events src;
+    lab::partition part;
+
+    const std::size_t nbands = bands ? bands->size() : 1;
+    for (std::size_t b=0; b<nbands; ++b) {
+      std::size_t y1 = sy1, y2 = sy2;
+      if (bands) {
+	bands->rows(b, y1, y2);
+	if (y2 <= ckpt.done)
+	  continue;
+	bands->read(b, src);
+      }
+      else if (opts::nshards)
+	lab::read_rows(grid, in, chunk, y1, y2, src);
+      else
+	in.read(src, in.rows());
+
+      lab::partition_events(grid, src.packed, part);
+
+      // a row of taps at a time for all jobs, so that they can be
+      // checkpointed together
+      for (std::size_t y=std::max(y1, ckpt.done); y<y2; y+=grid.subtaps()) {
+	for (vector<job>::size_type i=0; i<jobs.size(); ++i) {
+	  const variant& v = jobs[i].v;
+	  test_context ctx = { grid, src, part, v.bgsubtract ? bg : 0, exptime };
+	  write_row(ctx, v, y, pool, results, out[i]);
+	}
+	ckpt.done = y + grid.subtaps();
+
+	if (opts::checkpoint > 0 &&
+	    clock::now() - last >= std::chrono::seconds(opts::checkpoint)) {
+	  for (vector<job>::size_type i=0; i<jobs.size(); ++i)
+	    flush_outputs(out[i]);
+	  lab::save_checkpoint(ckptfile, ckpt);
+	  last = clock::now();
+	}
+      }
+    }
+
+    for (vector<job>::size_type i=0; i<jobs.size(); ++i)
+      close_outputs(base, jobs[i], out[i]);
+    std::remove(ckptfile.c_str());
+
+    for (vector<job>::size_type i=0; i<jobs.size(); ++i) {
+
+      // partial outputs become current once reduced
+      if (!cache || opts::nshards)
+	continue;
+      vector<string> files = output_files(base, jobs[i].v);
+      for (vector<string>::size_type j=0; j<files.size(); ++j)
+	cache->update(files[j], jobs[i].digest);
+    }
+  }
+
+  // the RDB file, if any, then the BIN files, if any
+  vector<string> output_files(const string& base, const variant& v)
+  {
+    vector<string> files;
+    if (v.rdb)
+      files.push_back(rdb_file(base, v));
+    if (v.bin)
+      for (int c=0; c<lab::ndata_cols; ++c)
+	files.push_back(bin_file(base, v, c));
+    return files;
+  }
+
+  // Shard k of n of an output file. The digest of the inputs is part
+  // of the name, so that shards made from different inputs are never
+  // put together.
+  string part_file(const string& file, const job& j, int shard, int nshards)
+  {
+    return file + '.' + j.digest + ".part"
+      + util::ss_cast<string>(shard) + "of" + util::ss_cast<string>(nshards);
+  }
+
+  // the subtap rows of a shard, whole tap rows split evenly
+  void shard_rows(const lab::subtap_grid& grid, int shard, int nshards,
+		  std::size_t& y1, std::size_t& y2)
+  {
+    const std::size_t taprows = grid.ny() / grid.subtaps();
+    const std::size_t n = (taprows + nshards - 1) / nshards;
+    y1 = std::min(taprows, shard * n) * grid.subtaps();
+    y2 = std::min(taprows, (shard+1) * n) * grid.subtaps();
+  }
+
+  // Concatenate the shards of each output. RDB and BIN records of a
+  // shard are complete, and only the first shard has an RDB header,
+  // so outputs are identical to those of an unsharded run.
+  void reduce(const string& base, const vector<job>& jobs, int nshards,
+	      lab::result_cache* cache)
+  {
+    for (vector<job>::size_type i=0; i<jobs.size(); ++i) {
+      vector<string> files = output_files(base, jobs[i].v);
+
+      for (vector<string>::size_type j=0; j<files.size(); ++j) {
+	vector<string> parts;
+	for (int k=0; k<nshards; ++k) {
+	  parts.push_back(part_file(files[j], jobs[i], k, nshards));
+	  if (!std::ifstream(parts.back().c_str()))
+	    throw std::runtime_error("missing shard " + parts.back());
+	}
+
+	note("creating " + files[j]);
+	string tmp = files[j] + ".tmp";
+	{
+	  std::ofstream out(tmp.c_str(), std::ios_base::binary);
+	  for (vector<string>::size_type k=0; k<parts.size(); ++k) {
+	    std::ifstream in(parts[k].c_str(), std::ios_base::binary);
+	    if (in.peek() != std::ifstream::traits_type::eof())
+	      out << in.rdbuf();
+	  }
+	  out.close();
+	  if (!out || std::rename(tmp.c_str(), files[j].c_str()))
+	    throw std::runtime_error("error writing " + files[j]);
+	}
+
+	for (vector<string>::size_type k=0; k<parts.size(); ++k)
+	  std::remove(parts[k].c_str());
+
+	if (cache)
+	  cache->update(files[j], jobs[i].digest);
+      }
+    }
+  }
+
+  // The files the outputs of a job are written to. With --shard,
+  // outputs are written aside and renamed once complete, so a shard's
+  // files exist only if the shard finished.
+  vector<string> written_files(const string& base, const job& j)
+  {
+    vector<string> files = output_files(base, j.v);
+    if (opts::nshards)
+      for (vector<string>::size_type i=0; i<files.size(); ++i)
+	files[i] = part_file(files[i], j, opts::shard, opts::nshards) + ".tmp";
+    return files;
+  }
+
+  // with append, the files are those of a resumed run
+  void open_outputs(const string& base, const job& j, outputs& out,
+		    bool append)
+  {
+    const variant& v = j.v;
+    out.files = written_files(base, j);
+    for (vector<string>::size_type i=0; i<out.files.size(); ++i)
+      note((append ? "appending to " : "creating ") + out.files[i]);
+
+    if (v.rdb) {
+      out.rdb.open(out.files[0].c_str(), append ? std::ios_base::app : std::ios_base::trunc);
+      if (!out.rdb)
+	throw std::runtime_error("could not open " + out.files[0]);
+      if (!opts::shard && !append) {
+	vector<string> types, cols = rdb_colnames(v, types);
+	for (vector<string>::size_type i=0; i<cols.size(); ++i)
+	  out.rdb << cols[i] << (i+1<cols.size() ? '\t' : '\n');
+	for (vector<string>::size_type i=0; i<types.size(); ++i)
+	  out.rdb << types[i] << (i+1<types.size() ? '\t' : '\n');
+      }
+    }
+
+    if (v.bin) {
+      const vector<string>::size_type first = out.files.size() - lab::ndata_cols;
+      for (int i=0; i<lab::ndata_cols; ++i)
+	out.bin.push_back(std::make_shared<lab::binfile_output>(out.files[first+i], lab::data_col_names[i], append));
+    }
+  }
+
+  void flush_outputs(outputs& out)
+  {
+    if (out.rdb.is_open() && !out.rdb.flush())
+      throw std::runtime_error("error writing " + out.files[0]);
+    for (vector< std::shared_ptr<lab::binfile_output> >::size_type i=0; i<out.bin.size(); ++i)
+      out.bin[i]->flush();
+  }
+
+  void close_outputs(const string& base, const job& j, outputs& out)
+  {
+    out.bin.clear();
+
+    if (j.v.rdb) {
+      out.rdb.close();
+      if (!out.rdb)
+	throw std::runtime_error("error writing " + out.files[0]);
+    }
+
+    if (opts::nshards) {
+      vector<string> files = output_files(base, j.v);
+      for (vector<string>::size_type i=0; i<files.size(); ++i) {
+	string part = part_file(files[i], j, opts::shard, opts::nshards);
+	if (std::rename(out.files[i].c_str(), part.c_str()))
+	  throw std::runtime_error("could not rename " + out.files[i]);
+      }
+    }
+  }
+
+  // The subtaps of the row of taps starting at subtap row y are
+  // processed in parallel and written in genstats.pl's order. results
+  // holds a row of taps.
+  void write_row(const test_context& ctx, const variant& v, std::size_t y,
+		 lab::thread_pool* pool, vector<subtap_result>& results,
+		 outputs& out)
+  {
+    const std::size_t row = results.size();
+    const std::size_t lo = y * ctx.grid.nx();
+
+    if (pool)
+      lab::parallel_for(*pool, row, [&ctx, &v, &results, lo](std::size_t i) {
+	  process_subtap(ctx, v, lo+i, results[i]);
+	});
+    else
+      for (std::size_t i=0; i<row; ++i)
+	process_subtap(ctx, v, lo+i, results[i]);
+
+    fit_row(v, results, pool);
+
+    for (std::size_t i=0; i<row; ++i) {
+      subtap_result& r = results[i];
+
+      if (v.bin && r.n >= v.bincnts)
+	for (int j=0; j<lab::ndata_cols; ++j)
+	  out.bin[j]->add_subtap(r.ytap, r.ysubtap, r.xtap, r.xsubtap,
+				 r.y1, r.y2, r.x1, r.x2, r.vals[j]);
+
+      if (v.rdb)
+	print_rdb(out.rdb, v, r);
+    }
+  }
+
+  void process_subtap(const test_context& ctx, const variant& v,
+		      std::size_t i, subtap_result& r)
+  {
+    const lab::subtap_grid& grid = ctx.grid;
+    const long nsub = grid.subtaps();
+    const long gy = i / grid.nx(), gx = i % grid.nx();
+
+    r.ytap = gy / nsub;
+    r.ysubtap = gy % nsub;
+    r.xtap = gx / nsub;
+    r.xsubtap = gx % nsub;
+
+    grid.range(gy, r.y1, r.y2);
+    grid.range(gx, r.x1, r.x2);
+
+    r.norig = ctx.part.count(grid.slot(gx, gy));
+    r.subs = "1x1";
+
+    // neighboring subtaps to include for low counts
+    long dy = 0, dx = 0;
+    if (v.subext || v.three_by_three) {
+      if (r.norig < 100 || v.three_by_three) {
+	r.subs = "3x3";
+	dy = dx = 1;
+      }
+      else if (r.norig < 150) {
+	r.subs = "3x1";
+	dy = 1;
+      }
+    }
+
+    long y1, y2, x1, x2;
+    grid.range(gy-dy, y1, y2);
+    r.y1 = std::max(y1, lab::subtap_grid::rawy_min);
+    grid.range(gy+dy, y1, y2);
+    r.y2 = std::min(y2, lab::subtap_grid::rawy_max);
+    grid.range(gx-dx, x1, x2);
+    r.x1 = std::max(x1, lab::subtap_grid::rawx_min);
+    grid.range(gx+dx, x1, x2);
+    r.x2 = std::min(x2, lab::subtap_grid::rawx_max);
+
+    // Working storage comes from a per-thread arena, so that once the
+    // densest subtap has been seen no heap allocations are made
+    static thread_local lab::arena scratch;
+    scratch.reset();
+
+    const lab::subtap_window win(grid, gx-dx, gx+dx, gy-dy, gy+dy);
+    std::size_t* region = scratch.alloc<std::size_t>(win.size());
+    std::size_t nregion = 0, nevt = 0;
+    for (std::size_t s : win) {
+      region[nregion++] = s;
+      nevt += ctx.part.count(s);
+    }
+
+    // events of the region, in file order
+    std::size_t* evt = scratch.alloc<std::size_t>(nevt);
+    for (std::size_t j=0, k=0; j<nregion; ++j)
+      for (std::size_t l=ctx.part.offset[region[j]]; l<ctx.part.offset[region[j]+1]; ++l)
+	evt[k++] = ctx.part.order[l];
+    if (nregion > 1)
+      std::sort(evt, evt+nevt);
+
+    r.n = nevt;
+    r.nnet = r.n;
+    r.pha_lt_3 = r.pha255 = 0;
+
+    for (int c=0; c<lab::ndata_cols; ++c) {
+      r.st[c] = r.se[c] = lab::col_stats();
+      std::fill(r.par[c], r.par[c]+lab::two_normals::npar, 0.);
+      r.vals[c].resize(r.n);
+      if (c == lab::pha_col)
+	for (long j=0; j<r.n; ++j)
+	  r.vals[c][j] = ctx.src.packed[evt[j]].pha();
+      else
+	for (long j=0; j<r.n; ++j)
+	  r.vals[c][j] = ctx.src.data[c][evt[j]];
+    }
+
+    for (long j=0; j<r.n; ++j) {
+      if (r.vals[lab::pha_col][j] < 3)
+	++r.pha_lt_3;
+      if (r.vals[lab::pha_col][j] == 255)
+	++r.pha255;
+    }
+
+    if (!r.n)
+      return;
+
+    // histograms of the events, bin centers are 0 .. nbins-1
+    double* hist[lab::ndata_cols];
+    std::size_t nbins[lab::ndata_cols];
+    for (int c=0; c<lab::ndata_cols; ++c) {
+      nbins[c] = lab::nbins(lab::data_col_names[c]);
+      hist[c] = scratch.alloc<double>(nbins[c]);
+      std::fill(hist[c], hist[c]+nbins[c], 0.);
+      for (long j=0; j<r.n; ++j) {
+	double d = r.vals[c][j] + 0.5;
+	if (d < 0)
+	  continue;
+	std::size_t k = static_cast<std::size_t>(d);
+	if (k < nbins[c])
+	  ++hist[c][k];
+      }
+    }
+
+    // background subtraction uses the full tap, scaled by area, with
+    // --bgfulltap and the same region as the source otherwise
+    std::size_t* bgregion = region;
+    std::size_t nbgregion = 0;
+    double bgscale = ctx.exptime;
+    if (ctx.bg) {
+      if (v.bgfulltap) {
+	const lab::subtap_window tap(grid, r.xtap*nsub, (r.xtap+1)*nsub-1,
+				     r.ytap*nsub, (r.ytap+1)*nsub-1);
+	bgregion = scratch.alloc<std::size_t>(tap.size());
+	for (std::size_t s : tap)
+	  bgregion[nbgregion++] = s;
+	bgscale *= double(r.x2-r.x1+1) * (r.y2-r.y1+1) / lab::tapsize / lab::tapsize;
+      }
+      else
+	nbgregion = nregion;
+    }
+
+    long nbg = 0;
+    for (std::size_t j=0; j<nbgregion; ++j)
+      nbg += ctx.bg->count(bgregion[j]);
+
+    // the background histograms subtracted, for the bootstrap
+    double* bgspec[lab::ndata_cols] = { 0 };
+
+    if (nbg) {
+      for (int c=0; c<lab::ndata_cols; ++c) {
+	double* spec = scratch.alloc<double>(nbins[c]);
+	std::copy(hist[c], hist[c]+nbins[c], spec);
+	double bgrate = ctx.bg->subtract(bgregion, nbgregion, bgscale, c, spec);
+	if (c == lab::pha_col)
+	  r.nnet -= bgrate;
+	lab::hist_stats(spec, nbins[c], opts::trim, r.st[c], scratch);
+
+	if (v.bootstrap) {
+	  bgspec[c] = scratch.alloc<double>(nbins[c]);
+	  for (std::size_t j=0; j<nbins[c]; ++j)
+	    bgspec[c][j] = hist[c][j] - spec[j];
+	}
+      }
+    }
+
+    // simple statistics if no background subtraction
+    else {
+      double* data = scratch.alloc<double>(r.n);
+      for (int c=0; c<lab::ndata_cols; ++c) {
+	std::copy(r.vals[c].begin(), r.vals[c].end(), data);
+	lab::data_stats(data, r.n, opts::trim, r.st[c]);
+      }
+    }
+
+    // Standard errors from resampling, each subtap drawing from its own
+    // stream so that they do not depend on the threads or the order
+    // subtaps are done in. The statistics of each replicate are made
+    // as those reported were: from the background subtracted
+    // histogram, or else from the events themselves.
+    if (v.bootstrap) {
+      lab::counter_rng rng(opts::seed, i);
+      for (int c=0; c<lab::ndata_cols; ++c)
+	if (nbg)
+	  lab::hist_bootstrap(rng, hist[c], bgspec[c], nbins[c], opts::trim,
+			      v.bootstrap, r.se[c], scratch);
+	else
+	  lab::data_bootstrap(rng, r.vals[c].data(), r.n, opts::trim,
+			      v.bootstrap, r.se[c], scratch);
+    }
+
+    // the source histograms and initial parameters of the Gaussian
+    // fits, which fit_row does for the whole row at once
+    if (fitted(v, r)) {
+      for (int c=0; c<lab::ndata_cols; ++c) {
+	const double* y = hist[c];
+	r.hist[c].assign(y, y+nbins[c]);
+	const double norm = std::accumulate(y, y+nbins[c], 0.);
+	lab::gauss_init(norm, r.st[c].median, v.twogauss, r.par[c]);
+      }
+    }
+  }
+
+  bool fitted(const variant& v, const subtap_result& r)
+  {
+    return v.fit && r.n && r.n >= v.fitcnts;
+  }
+
+  // Gaussian fits of one column for the subtaps fits[lo, hi), c.f.
+  // gaussfit, lm_lanes at a time
+  void fit_chunk(const variant& v, const vector<subtap_result*>& fits,
+		 int c, std::size_t lo, std::size_t hi)
+  {
+    static thread_local lab::arena scratch;
+    scratch.reset();
+
+    const std::size_t nf = hi - lo;
+    const std::size_t n = fits[lo]->hist[c].size();
+    double* x = scratch.alloc<double>(n);
+    for (std::size_t j=0; j<n; ++j)
+      x[j] = j;
+
+    const double** y = scratch.alloc<const double*>(nf);
+    double** par = scratch.alloc<double*>(nf);
+    for (std::size_t f=0; f<nf; ++f) {
+      y[f] = fits[lo+f]->hist[c].data();
+      par[f] = fits[lo+f]->par[c];
+    }
+
+    vector<lab::lm_result> res(nf);
+    if (v.twogauss)
+      lab::lmfit_batch(lab::two_normals(), x, n, y, 0, par, res.data(), nf, scratch);
+    else
+      lab::lmfit_batch(lab::one_normal(), x, n, y, 0, par, res.data(), nf, scratch);
+  }
+
+  // the Gaussian fits of a row, each column in chunks of a few
+  // lmfit_batch lane groups
+  void fit_row(const variant& v, vector<subtap_result>& results,
+	       lab::thread_pool* pool)
+  {
+    vector<subtap_result*> fits;
+    for (vector<subtap_result>::size_type i=0; i<results.size(); ++i)
+      if (fitted(v, results[i]))
+	fits.push_back(&results[i]);
+
+    const std::size_t chunk = 8 * lab::lm_lanes;
+    const std::size_t nchunks = (fits.size() + chunk - 1) / chunk;
+    auto f = [&v, &fits, chunk](std::size_t k) {
+      const std::size_t lo = k / lab::ndata_cols * chunk;
+      fit_chunk(v, fits, k % lab::ndata_cols, lo,
+		std::min(lo + chunk, fits.size()));
+    };
+    if (pool)
+      lab::parallel_for(*pool, nchunks * lab::ndata_cols, f, 1);
+    else
+      for (std::size_t k=0; k<nchunks * lab::ndata_cols; ++k)
+	f(k);
+  }
+
+  // a formatted number for print_rdb, kept off the heap
+  struct number {
+    char buf[64];
+  };
+
+  std::ostream& operator<<(std::ostream& out, const number& n)
+  {
+    return out << n.buf;
+  }
+
+  number fmt(double d, int prec)
+  {
+    number n;
+    std::snprintf(n.buf, sizeof(n.buf), "%.*f", prec, d);
+    return n;
+  }
+
+  // as Perl would stringify a number
+  number fmt(double d)
+  {
+    number n;
+    std::snprintf(n.buf, sizeof(n.buf), "%.15g", d);
+    return n;
+  }
+
+  vector<string> rdb_colnames(const variant& v, vector<string>& types)
+  {
+    const char* cols1[] = { "crsv", "vsub", "crsu", "usub",
+			    "rawy_range", "rawx_range", "subs" };
+    const char* cols_bg[] = { "nnet", "norig", "n", "BG" };
+    const char* cols_nobg[] = { "n", "norig", "pha_lt_3", "pha255" };
+
+    vector<string> cols(cols1, cols1+7);
+    if (v.bgsubtract)
+      cols.insert(cols.end(), cols_bg, cols_bg+4);
+    else
+      cols.insert(cols.end(), cols_nobg, cols_nobg+4);
+
+    const string trim = util::ss_cast<string>(opts::trim * 100);
+    cols.push_back("ptmean" + trim);
+    cols.push_back("prms");
+    cols.push_back("pmed");
+    cols.push_back("stmean" + trim);
+    cols.push_back("srms");
+    cols.push_back("smed");
+    cols.push_back("spimeantmean" + trim);
+    cols.push_back("spimeanrms");
+    cols.push_back("spimeanmed");
+    cols.push_back("spimedtmean" + trim);
+    cols.push_back("spimedrms");
+    cols.push_back("spimedmed");
+    cols.push_back("piqr");
+    cols.push_back("siqr");
+    cols.push_back("spimeaniqr");
+    cols.push_back("spimediqr");
+
+    if (v.fit) {
+      const char* fit_cols[] = { "_gnorm", "_gsigma", "_gmean" };
+      for (int c=0; c<lab::ndata_cols; ++c) {
+	for (int j=0; j<3; ++j)
+	  cols.push_back(string(lab::data_col_names[c]) + fit_cols[j]);
+	if (v.twogauss)
+	  for (int j=0; j<3; ++j)
+	    cols.push_back(string(lab::data_col_names[c]) + fit_cols[j] + '2');
+      }
+    }
+
+    if (v.bootstrap) {
+      const char* prefix[lab::ndata_cols] = { "p", "s", "spimean", "spimed" };
+      for (int c=0; c<lab::ndata_cols; ++c) {
+	cols.push_back(string(prefix[c]) + "tmean" + trim + "_se");
+	cols.push_back(string(prefix[c]) + "med_se");
+	cols.push_back(string(prefix[c]) + "iqr_se");
+      }
+    }
+
+    types.assign(cols.size(), "N");
+    fill(types.begin()+4, types.begin()+7, "S");
+
+    return cols;
+  }
+
+  void print_rdb(std::ostream& out, const variant& v, const subtap_result& r)
+  {
+    out << r.ytap << '\t' << r.ysubtap << '\t'
+	<< r.xtap << '\t' << r.xsubtap << '\t'
+	<< r.y1 << ':' << r.y2 << '\t' << r.x1 << ':' << r.x2 << '\t'
+	<< r.subs << '\t';
+
+    if (v.bgsubtract)
+      out << fmt(r.nnet, 1) << '\t' << r.norig << '\t' << r.n << '\t'
+	  << fmt(r.n - r.nnet, 1);
+    else
+      out << r.n << '\t' << r.norig << '\t' << r.pha_lt_3 << '\t' << r.pha255;
+
+    const lab::col_stats& p = r.st[lab::pha_col];
+    out << '\t' << fmt(p.tmean, 1) << '\t' << fmt(p.rms, 1) << '\t'
+	<< (v.bgsubtract ? fmt(p.median, 1) : fmt(p.median));
+
+    for (int c=lab::samp_col; c<lab::ndata_cols; ++c)
+      out << '\t' << fmt(r.st[c].tmean, 1) << '\t' << fmt(r.st[c].rms, 1)
+	  << '\t' << fmt(r.st[c].median, 1);
+
+    for (int c=0; c<lab::ndata_cols; ++c)
+      out << '\t' << fmt(r.st[c].iqr, 1);
+
+    // genstats.pl prints these before the IQRs, contrary to its header
+    if (v.fit) {
+      const int npar = v.twogauss ? 6 : 3;
+      for (int c=0; c<lab::ndata_cols; ++c)
+	for (int j=0; j<npar; ++j)
+	  out << '\t' << fmt(r.par[c][j], 2);
+    }
+
+    if (v.bootstrap)
+      for (int c=0; c<lab::ndata_cols; ++c)
+	out << '\t' << fmt(r.se[c].tmean, 2) << '\t' << fmt(r.se[c].median, 2)
+	    << '\t' << fmt(r.se[c].iqr, 2);
+
+    out << '\n';
+  }
+
+  // progress messages, which may come from several threads
+  void note(const string& s)
+  {
+    static std::mutex mtx;
+    std::lock_guard<std::mutex> lock(mtx);
+    cerr << s << '\n';
+  }
+
+  int version() {
+    cout << opts::version_string << '\n';
+    return 0;
+  }
+
+  int help() {
+    const char* help_text = "\
+=head1 NAME\n\
+\n\
+genstats - generate per-subtap statistics for HRC-S lab data\n\
+\n\
+=head1 SYNOPSIS\n\
+\n\
+genstats [options] [tests]\n\
+\n\
+=head1 DESCRIPTION\n\
+\n\
+A native implementation of F<genstats.pl>, taking the same options\n\
+and writing RDB and BIN files in the same formats. Tests may be given\n\
+as basenames (e.g., p197061024) or as anode names (e.g., B-Ka); if\n\
+none are given all tests in the configuration file are processed.\n\
+\n\
+Each event list is read once and its events sorted by subtap, after\n\
+which subtaps are processed in parallel. With I<--bgsubtract>, the\n\
+merged background is read once and histogrammed into an\n\
+exposure-normalized cube of per-subtap histograms (each event\n\
+weighted by the inverse exposure time of its chip_id), and each\n\
+subtap's background is the test exposure time times the sum of the\n\
+cube histograms over the subtap's region.\n\
+\n\
+Several runs with different options may be done in one pass with\n\
+I<--variant>, each event list then being read once for all of them.\n\
+When there are at least as many tests as threads, tests rather than\n\
+subtaps are processed in parallel.\n\
+\n\
+The output differs from that of F<genstats.pl> where the latter is\n\
+in error:\n\
+\n\
+=over 4\n\
+\n\
+=item *\n\
+\n\
+With I<--bgsubtract>, each background event is weighted by the\n\
+inverse exposure time of its own chip. F<genstats.pl> histograms all\n\
+of a region's background events once for every chip present in it,\n\
+weighting each pass by that chip's exposure time.\n\
+\n\
+=item *\n\
+\n\
+With I<--bgfulltap>, likewise, each event is scaled by the exposure\n\
+time of its own chip rather than that of chip 1.\n\
+\n\
+=item *\n\
+\n\
+With I<--fit>, the values of each RDB row follow its header, the\n\
+IQRs coming before the fit parameters; F<genstats.pl> writes the fit\n\
+parameters first, so its values and header do not match.\n\
+\n\
+=back\n\
+\n\
+=head1 OPTIONS\n\
+\n\
+=over 4\n\
+\n\
+=item --help\n\
+\n\
+Print this help text and exit.\n\
+\n\
+=item --version\n\
+\n\
+Print the program version and exit.\n\
+\n\
+=item --config=s\n\
+\n\
+Lab data configuration file. The default is F<hrcs_lab.rdb>.\n\
+\n\
+=item --filtdir=s\n\
+\n\
+Location of processed evt1 data for each test. The default is\n\
+F</data/legs/rpete/data/hrcs_lab/analysis>.\n\
+\n\
+=item --subtaps=i\n\
+\n\
+Number of subtap divisions per tap. The default is 3, for which the\n\
+raw to subtap lookup tables are built at compile time; other values\n\
+use tables built at start-up by the same code. F<subtap_coords> with\n\
+the same option lists the resulting subtap ranges.\n\
+\n\
+=item --zorder\n\
+\n\
+Lay out the per-subtap event index and background histograms in\n\
+Z-order (Morton order) over the subtap grid rather than row by row,\n\
+so that the 3x3 and full tap neighborhoods of a subtap are close\n\
+together in memory. Output is the same either way.\n\
+\n\
+=item --nosubext\n\
+\n\
+Do not include events from neighboring subtaps for subtaps with\n\
+fewer than 150 (3x1) or 100 (3x3) counts.\n\
+\n\
+=item --3x3\n\
+\n\
+Include events from surrounding subtaps, always.\n\
+\n\
+=item --bgsubtract\n\
+\n\
+Subtract estimated background histograms for each subtap.\n\
+\n\
+=item --bgfulltap\n\
+\n\
+Use background data from full taps, scaled by area, for subtraction.\n\
+\n\
+=item --bgfile=s\n\
+\n\
+Merged background event list. The default is\n\
+F</data/legs/rpete/data/hrcs_lab/analysis/merged_bg_evt1_filt_spi.fits>.\n\
+\n\
+=item --bincnts=i\n\
+\n\
+Do not write BIN output for subtaps with fewer than this number of\n\
+counts. The default value is 1.\n\
+\n\
+=item --fit, --twogauss, --fitcnts=i\n\
+\n\
+Gaussian fits as in F<genstats.pl>, c.f. F<gaussfit>.\n\
+\n\
+=item --bootstrap=i\n\
+\n\
+Add standard errors of the trimmed mean, median and IQR of every\n\
+column to the RDB output, as columns ptmean5_se, pmed_se, piqr_se\n\
+and so on after all others. They are the standard deviations of the\n\
+statistics over this many replicates of each subtap, the statistics\n\
+of a replicate being computed as the reported ones are. Without\n\
+background subtraction, a replicate is the subtap's events resampled\n\
+with replacement, drawn multinomially over their distinct values.\n\
+With it, a replicate is a histogram resampled multinomially from the\n\
+source histogram, keeping its total, with the same background\n\
+subtracted. The default, 0, is no bootstrap.\n\
+\n\
+=item --seed=i\n\
+\n\
+Seed of the bootstrap. Each subtap draws from its own random stream,\n\
+so the errors are the same whatever the number of threads, bands or\n\
+shards. The default is 1.\n\
+\n\
+=item --outdir=s\n\
+\n\
+Where to put the output files. The default is the current directory.\n\
+\n\
+=item --nordb, --nobin\n\
+\n\
+Do not create RDB, BIN output files.\n\
+\n\
+=item --binext=s, --rdbext=s\n\
+\n\
+Extensions of output BIN and RDB files.\n\
+\n\
+=item --threads=i\n\
+\n\
+Number of worker threads. The default is one per processor core.\n\
+\n\
+=item --maxmem=i\n\
+\n\
+Limit, in MB, on the memory taken by the events of a test. An event\n\
+list larger than this is first split, in a single pass over the file,\n\
+into temporary files holding bands of tap rows (plus the adjacent\n\
+subtap rows, for subtap extension), and the bands are processed one\n\
+at a time. Results are identical to those of an in-memory run. The\n\
+limit applies to each test being processed, so when tests run in\n\
+parallel it should be divided by I<--threads>. The default, 0, is\n\
+no limit. The background list is always read in chunks.\n\
+\n\
+=item --shard=k/n\n\
+\n\
+Process only shard I<k> (zero-based) of I<n>, i.e., the I<k>th of I<n>\n\
+equal ranges of tap rows, so that a run may be spread over several\n\
+processes or machines sharing the output directory. Events outside the\n\
+range (and its adjacent subtap rows) are skipped on reading. Each\n\
+output file F<file> is written as F<file.digest.partkofn>, where digest\n\
+identifies the inputs, and only appears once the shard is complete.\n\
+\n\
+=item --reduce=n\n\
+\n\
+Put together the outputs of I<n> shards, given the same tests and\n\
+options as the shards were, and remove the shard files. No event\n\
+lists are read. The results are identical to those of an unsharded\n\
+run; it is an error for any shard to be missing or to have been made\n\
+from different inputs.\n\
+\n\
+=item --checkpoint=i\n\
+\n\
+Interval in seconds between checkpoints, the default being 300. The\n\
+outputs are flushed and the rows of taps done recorded in a F<.ckpt>\n\
+file in the output directory. When a test is run again with the same\n\
+outputs, options and inputs after an interruption, the outputs are cut\n\
+back to the last checkpoint and appended to from there, so at most one\n\
+interval of work is lost. Zero disables checkpointing and resuming.\n\
+\n\
+=item --nocache\n\
+\n\
+Make all outputs, even those which are current. Normally a manifest\n\
+F<.genstats_cache> in the output directory records a digest of the\n\
+inputs each output was made from: the event list's name, size and\n\
+modification time, the test's row of the configuration file, the\n\
+options affecting the output and, with I<--bgsubtract>, the\n\
+background file and exposure times. Outputs whose digest is unchanged,\n\
+and which were not modified since, are not made again, and a test\n\
+with no outputs to make is not read at all.\n\
+\n\
+=item --variant=s\n\
+\n\
+Add a run to the batch, given as F<genstats.pl> arguments, e.g.,\n\
+\n\
+  --variant='--3x3 --nobin --bgsubtract B-Ka'\n\
+\n\
+Recognized options are I<--subext>, I<--nosubext>, I<--3x3>,\n\
+I<--bgsubtract>, I<--bgfulltap>, I<--fit>, I<--twogauss>, I<--rdb>,\n\
+I<--nordb>, I<--bin>, I<--nobin>, I<--bincnts>, I<--fitcnts>,\n\
+I<--bootstrap>, I<--rdbext> and I<--binext>, which apply on top of the options given\n\
+outside of I<--variant>. Tests or anodes named in the variant restrict\n\
+it to those, otherwise it runs for the tests on the command line. May\n\
+be given any number of times; runs are done in order, so a later\n\
+variant overwrites the files of an earlier one with the same names.\n\
+\n\
+=back\n\
+\n\
+=head1 AUTHOR\n\
+\n\
+Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt>\n\
+\n\
+=head1 SEE ALSO\n\
+\n\
+genstats.pl, gaussfit\n\
+\n\
+=cut\n\
+";
+
+    const char* pager = std::getenv("PAGER");
+    if (!pager) pager = "more";
+
+    FILE* pd = popen((std::string("pod2text -c | ")+pager).c_str(), "w");
+    if (!pd) {
+      std::perror("error starting pod2text");
+      return EXIT_FAILURE;
+    }
+
+    int n = 0;
+    int len = std::strlen(help_text);
+    while (n < len) {
+      int written = std::fwrite(help_text, 1, len-n, pd);
+      if (!written) {
+	std::perror("error writing help");
+	return EXIT_FAILURE;
+      }
+      n+=written;
+    }
+
+    if (pclose(pd) == -1) {
+      std::perror("error writing help");
+      return EXIT_FAILURE;
+    }
+
+    return 0;
+  }
+
+}
@@ -2,8 +2,6 @@
 
 use PDL;
 
-use Inline Pdlpp;
-
 use strict;
 
 =head1 NAME
@@ -84,7 +82,9 @@ counts. The default value is 1.
 =item --fit
 
 Perform Gaussian fits of histograms for data in each subtap. Fitted
-parameters are written to the output RDB file.
+parameters are written to the output RDB file. This is slow; running
+F<gaussfit> on the BIN output gives the same fits in a fraction of the
+time.
 
 =item --twogauss
 
@@ -117,6 +117,9 @@ specified.
 
 =back
 
+The F<genstats> program is a much faster native implementation taking
+the same options.
+
 =head1 AUTHOR
 
 Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt> June 2008
@@ -752,21 +755,12 @@ sub hist_stats {
   my $diff = $x-$mean;
 
   my $y_copy = $y->copy;
-  $y_copy->shift_negs;
+  Lab::shift_negs($y_copy);
   my $i = which ($y_copy >= 0);
   my $rms = $y_copy->index($i)->sum <=1 ?
     0 : sqrt(($y_copy->index($i) *  $diff->index($i) * $diff->index($i))->sum / ($y_copy->index($i)->sum-1));
 
-  my ($median, $lq, $uq) = (0)x3;
-  eval {
-    my $cumu_bounds = zeroes($x->nelem);
-     (my $tmp = $cumu_bounds->slice('0:-2')) .= ($x->slice('0:-2') + $x->slice('1:-1'))/2;
-    $cumu_bounds->set(-1, $x->at(-1)+($x->at(-1)-$x->at(-2))/2);
-    my $cumu = $y->cumusumover / $y_sum;
-    $uq = interpol(0.75, $cumu, $cumu_bounds);
-    $median = interpol(0.5, $cumu, $cumu_bounds);
-    $lq = interpol(0.25, $cumu, $cumu_bounds);
-  };
+  my ($uq, $median, $lq) = Lab::hists_quantiles($y, $x, [0.75, 0.5, 0.25])->list;
 
   my $trimmed_y = Lab::hists_trim($y_copy, $opts{trim});
   my $trimmed_y_sum = $trimmed_y->sum;
@@ -849,12 +843,3 @@ sub rdb_colnames {
 
   return \(@cols, @types);
 }
-
-__DATA__
-
-__Pdlpp__
-
-pp_def('shift_negs',
-	 Pars => 'i(n);',
-       Code => 'int i, n_size; n_size = $SIZE(n); for (i=0; i<n_size-1; ++i) { if ($i(n=>i) < 0) { $i(n=>i+1) += $i(n=>i); $i(n=>i) = 0; } }',
-	);
@@ -0,0 +1,347 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include "hists.hh"
+#include "hists.h"
+#include "stats.hh"
+#include "arena.hh"
+#include "cube_expr.hh"
+
+namespace lab {
+
+  using std::size_t;
+
+  namespace {
+
+    template <class T>
+      double total(const T* h, size_t n)
+    {
+      double sum = 0;
+      for (size_t i=0; i<n; ++i)
+	sum += h[i];
+      return sum;
+    }
+
+    // value of rank k (zero-based) in the rld() values
+    template <class T>
+      double ranked(const T* h, const double* x, size_t n, long k)
+    {
+      long c = 0;
+      for (size_t i=0; i<n; ++i) {
+	c += static_cast<long>(h[i]);
+	if (c > k)
+	  return x[i];
+      }
+      return x[n-1];
+    }
+
+  }
+
+  template <class T>
+    void hist_quantiles(const T* h, const double* x, size_t n,
+			const double* f, size_t nf, double* q)
+  {
+    std::fill(q, q+nf, 0.);
+
+    const double sum = total(h, n);
+    if (!sum || n < 2)
+      return;
+
+    static thread_local arena scratch;
+    scratch.reset();
+
+    // cumulative distribution at the upper bin edges
+    double* cumu = scratch.alloc<double>(n);
+    double* bounds = scratch.alloc<double>(n);
+    double c = 0;
+    for (size_t i=0; i<n; ++i) {
+      c += h[i];
+      cumu[i] = c / sum;
+      bounds[i] = i+1 < n ? (x[i] + x[i+1]) / 2 : x[i] + (x[i] - x[i-1]) / 2;
+    }
+
+    for (size_t j=0; j<nf; ++j)
+      if (!interpol(f[j], cumu, bounds, n, q[j])) {
+	q[j] = 0;
+	break;
+      }
+  }
+
+  template <class T>
+    void hist_pct(const T* h, const double* x, size_t n,
+		  const double* f, size_t nf, double* q)
+  {
+    std::fill(q, q+nf, 0.);
+
+    long nvals = 0;
+    for (size_t i=0; i<n; ++i)
+      nvals += static_cast<long>(h[i]);
+    if (nvals <= 0)
+      return;
+
+    for (size_t j=0; j<nf; ++j) {
+      const double p = f[j] * (nvals-1);
+      const long k1 = std::min(std::max(static_cast<long>(std::floor(p)), 0L), nvals-1);
+      const long k2 = std::min(k1+1, nvals-1);
+      const double v1 = ranked(h, x, n, k1);
+      q[j] = v1 + (p-k1) * (ranked(h, x, n, k2) - v1);
+    }
+  }
+
+  template <class T>
+    double hist_median(const T* h, const double* x, size_t n)
+  {
+    const double half = 0.5;
+    double median;
+    if (std::numeric_limits<T>::is_integer)
+      hist_pct(h, x, n, &half, 1, &median);
+    else
+      hist_quantiles(h, x, n, &half, 1, &median);
+    return median;
+  }
+
+  template <class T>
+    void hist_shift_negs(T* h, size_t n)
+  {
+    for (size_t i=0; i+1<n; ++i) {
+      if (h[i] < 0) {
+	h[i+1] += h[i];
+	h[i] = 0;
+      }
+    }
+  }
+
+  template <class T>
+    void hist_summarize(const T* h, const double* x, size_t n, hist_summary& s)
+  {
+    s = hist_summary();
+
+    const double sum = total(h, n);
+    if (!sum)
+      return;
+
+    double sx = 0;
+    size_t first = n, last = 0;
+    for (size_t i=0; i<n; ++i) {
+      if (!h[i])
+	continue;
+      sx += h[i] * x[i];
+      if (first == n)
+	first = i;
+      last = i;
+    }
+    s.mean = sx / sum;
+    s.min = x[first];
+    s.max = x[last];
+
+    double ss = 0, sa = 0;
+    for (size_t i=first; i<=last; ++i) {
+      const double d = x[i] - s.mean;
+      ss += h[i] * d * d;
+      sa += h[i] * std::fabs(d);
+    }
+    s.rms = std::sqrt(ss / sum);
+    s.prms = sum > 1 ? std::sqrt(ss / (sum-1)) : 0;
+    s.adev = sa / sum;
+    const double half = 0.5;
+    hist_pct(h, x, n, &half, 1, &s.median);
+  }
+
+  template <class T>
+    void hist_trim(T* h, size_t n, double f)
+  {
+    const double sum = total(h, n);
+    double c = 0;
+    for (size_t i=0; i<n; ++i) {
+      c += h[i];
+      const double frac = c / sum;
+      if (frac < f || frac > 1-f)
+	h[i] = 0;
+    }
+  }
+
+  // mean of the values of each histogram
+  template <class T>
+    auto mean_expr(const T* c, const double* x, size_t n)
+  {
+    using namespace cube_expr;
+    return sumover(cube(c, n) * bins(x, n)) / sumover(cube(c, n));
+  }
+
+  template <class T>
+    void hists_mean(thread_pool& pool, const T* c, const double* x,
+		    size_t n, size_t nhists, double* mean)
+  {
+    cube_expr::evaluate(pool, mean, nhists, mean_expr(c, x, n));
+  }
+
+  template <class T>
+    void hists_prms(thread_pool& pool, const T* c, const double* x,
+		    size_t n, size_t nhists, double* prms)
+  {
+    using namespace cube_expr;
+    const auto h = cube(c, n);
+    const auto d = bins(x, n) - mean_expr(c, x, n);
+    evaluate(pool, prms, nhists, sqrt(sumover(h * d * d) / (sumover(h) - 1.)));
+  }
+
+  template <class T>
+    void hists_rms(thread_pool& pool, const T* c, const double* x,
+		   size_t n, size_t nhists, double* rms)
+  {
+    using namespace cube_expr;
+    const auto h = cube(c, n);
+    const auto xv = bins(x, n);
+    const auto mean = mean_expr(c, x, n);
+    evaluate(pool, rms, nhists, sqrt(sumover(xv * xv * h) / sumover(h) - mean * mean));
+  }
+
+  template <class T>
+    void hists_adev(thread_pool& pool, const T* c, const double* x,
+		    size_t n, size_t nhists, double* adev)
+  {
+    using namespace cube_expr;
+    const auto h = cube(c, n);
+    const auto d = bins(x, n) - mean_expr(c, x, n);
+    evaluate(pool, adev, nhists, sumover(abs(d) * h) / sumover(h));
+  }
+
+  template <class T>
+    void hists_prob(thread_pool& pool, const T* c, size_t n, size_t nhists,
+		    double* prob)
+  {
+    using namespace cube_expr;
+    const auto h = cube(c, n);
+    assign(pool, prob, nhists, h / sumover(h));
+  }
+
+  template <class T>
+    void hists_subtract(thread_pool& pool, T* src, const T* bg, double w,
+			size_t n, size_t nhists)
+  {
+    using namespace cube_expr;
+    assign(pool, src, nhists, cube(src, n) - w * cube(bg, n));
+  }
+
+#define LAB_HISTS_INSTANTIATE(T)					\
+  template void hist_quantiles(const T*, const double*, size_t,		\
+			       const double*, size_t, double*);		\
+  template void hist_pct(const T*, const double*, size_t,		\
+			 const double*, size_t, double*);		\
+  template double hist_median(const T*, const double*, size_t);		\
+  template void hist_shift_negs(T*, size_t);				\
+  template void hist_summarize(const T*, const double*, size_t, hist_summary&); \
+  template void hist_trim(T*, size_t, double);				\
+  template void hists_mean(thread_pool&, const T*, const double*,	\
+			   size_t, size_t, double*);			\
+  template void hists_prms(thread_pool&, const T*, const double*,	\
+			   size_t, size_t, double*);			\
+  template void hists_rms(thread_pool&, const T*, const double*,	\
+			  size_t, size_t, double*);			\
+  template void hists_adev(thread_pool&, const T*, const double*,	\
+			   size_t, size_t, double*);			\
+  template void hists_prob(thread_pool&, const T*, size_t, size_t, double*); \
+  template void hists_subtract(thread_pool&, T*, const T*, double, size_t, size_t);
+
+  LAB_HISTS_INSTANTIATE(int)
+  LAB_HISTS_INSTANTIATE(long)
+  LAB_HISTS_INSTANTIATE(float)
+  LAB_HISTS_INSTANTIATE(double)
+
+#undef LAB_HISTS_INSTANTIATE
+
+} // namespace lab
+
+namespace {
+
+  template <class T, void (*F)(lab::thread_pool&, const T*, const double*,
+			       std::size_t, std::size_t, double*)>
+    void c_cube(const T* cube, const double* x, long n, long nhists, double* out)
+  {
+    lab::thread_pool pool;
+    F(pool, cube, x, n, nhists, out);
+  }
+
+  template <class T>
+    void c_stats(const T* h, const double* x, long n, double* summary)
+  {
+    lab::hist_summary s;
+    lab::hist_summarize(h, x, n, s);
+    const double v[] = { s.mean, s.prms, s.median, s.min, s.max, s.adev, s.rms };
+    for (int i=0; i<7; ++i)
+      summary[i] = v[i];
+  }
+
+}
+
+extern "C" {
+
+  void lab_hist_stats_l(const int* h, const double* x, long n, double* summary)
+  { c_stats(h, x, n, summary); }
+  void lab_hist_stats_f(const float* h, const double* x, long n, double* summary)
+  { c_stats(h, x, n, summary); }
+  void lab_hist_stats_d(const double* h, const double* x, long n, double* summary)
+  { c_stats(h, x, n, summary); }
+
+  double lab_hist_median_l(const int* h, const double* x, long n)
+  { return lab::hist_median(h, x, n); }
+  double lab_hist_median_f(const float* h, const double* x, long n)
+  { return lab::hist_median(h, x, n); }
+  double lab_hist_median_d(const double* h, const double* x, long n)
+  { return lab::hist_median(h, x, n); }
+
+  void lab_hist_quantiles_l(const int* h, const double* x, long n,
+			    const double* f, long nf, double* q)
+  { lab::hist_quantiles(h, x, n, f, nf, q); }
+  void lab_hist_quantiles_f(const float* h, const double* x, long n,
+			    const double* f, long nf, double* q)
+  { lab::hist_quantiles(h, x, n, f, nf, q); }
+  void lab_hist_quantiles_d(const double* h, const double* x, long n,
+			    const double* f, long nf, double* q)
+  { lab::hist_quantiles(h, x, n, f, nf, q); }
+
+  void lab_hist_pct_l(const int* h, const double* x, long n,
+		      const double* f, long nf, double* q)
+  { lab::hist_pct(h, x, n, f, nf, q); }
+  void lab_hist_pct_f(const float* h, const double* x, long n,
+		      const double* f, long nf, double* q)
+  { lab::hist_pct(h, x, n, f, nf, q); }
+  void lab_hist_pct_d(const double* h, const double* x, long n,
+		      const double* f, long nf, double* q)
+  { lab::hist_pct(h, x, n, f, nf, q); }
+
+  void lab_hist_shift_negs_l(int* h, long n)
+  { lab::hist_shift_negs(h, n); }
+  void lab_hist_shift_negs_f(float* h, long n)
+  { lab::hist_shift_negs(h, n); }
+  void lab_hist_shift_negs_d(double* h, long n)
+  { lab::hist_shift_negs(h, n); }
+
+#define LAB_HISTS_CUBE_DEF(s, T)					\
+  void lab_hists_mean_##s(const T* cube, const double* x, long n, long nhists, double* out) \
+  { c_cube<T, lab::hists_mean<T> >(cube, x, n, nhists, out); }		\
+  void lab_hists_prms_##s(const T* cube, const double* x, long n, long nhists, double* out) \
+  { c_cube<T, lab::hists_prms<T> >(cube, x, n, nhists, out); }		\
+  void lab_hists_rms_##s(const T* cube, const double* x, long n, long nhists, double* out) \
+  { c_cube<T, lab::hists_rms<T> >(cube, x, n, nhists, out); }		\
+  void lab_hists_adev_##s(const T* cube, const double* x, long n, long nhists, double* out) \
+  { c_cube<T, lab::hists_adev<T> >(cube, x, n, nhists, out); }		\
+  void lab_hists_prob_##s(const T* cube, long n, long nhists, double* out) \
+  { lab::thread_pool pool; lab::hists_prob(pool, cube, n, nhists, out); } \
+  void lab_hists_subtract_##s(T* src, const T* bg, double w, long n, long nhists) \
+  { lab::thread_pool pool; lab::hists_subtract(pool, src, bg, w, n, nhists); }
+
+  LAB_HISTS_CUBE_DEF(l, int)
+  LAB_HISTS_CUBE_DEF(f, float)
+  LAB_HISTS_CUBE_DEF(d, double)
+
+#undef LAB_HISTS_CUBE_DEF
+
+  void lab_hist_trim_l(int* h, long n, double f)
+  { lab::hist_trim(h, n, f); }
+  void lab_hist_trim_f(float* h, long n, double f)
+  { lab::hist_trim(h, n, f); }
+  void lab_hist_trim_d(double* h, long n, double f)
+  { lab::hist_trim(h, n, f); }
+
+}
@@ -0,0 +1,75 @@
+#ifndef HISTS_H
+#define HISTS_H
+
+/*
+ * C entry points to hists.cc and spatial.cc, for the PDL::PP binding
+ * in Lab-Hists.
+ * One function per count type: _l for 32 bit integers (PDL long),
+ * _f for float and _d for double. x has the n bin values, summary
+ * receives mean, prms, median, min, max, adev and rms in the order
+ * of PDL's stats().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void lab_hist_stats_l(const int* h, const double* x, long n, double* summary);
+void lab_hist_stats_f(const float* h, const double* x, long n, double* summary);
+void lab_hist_stats_d(const double* h, const double* x, long n, double* summary);
+
+double lab_hist_median_l(const int* h, const double* x, long n);
+double lab_hist_median_f(const float* h, const double* x, long n);
+double lab_hist_median_d(const double* h, const double* x, long n);
+
+void lab_hist_quantiles_l(const int* h, const double* x, long n,
+			  const double* f, long nf, double* q);
+void lab_hist_quantiles_f(const float* h, const double* x, long n,
+			  const double* f, long nf, double* q);
+void lab_hist_quantiles_d(const double* h, const double* x, long n,
+			  const double* f, long nf, double* q);
+
+void lab_hist_pct_l(const int* h, const double* x, long n,
+		    const double* f, long nf, double* q);
+void lab_hist_pct_f(const float* h, const double* x, long n,
+		    const double* f, long nf, double* q);
+void lab_hist_pct_d(const double* h, const double* x, long n,
+		    const double* f, long nf, double* q);
+
+void lab_hist_shift_negs_l(int* h, long n);
+void lab_hist_shift_negs_f(float* h, long n);
+void lab_hist_shift_negs_d(double* h, long n);
+
+void lab_hist_trim_l(int* h, long n, double f);
+void lab_hist_trim_f(float* h, long n, double f);
+void lab_hist_trim_d(double* h, long n, double f);
+
+/*
+ * Whole (n, nhists) cubes at once, over all cores: hists_mean, prms,
+ * rms and adev give one value per histogram, hists_prob a cube, and
+ * hists_subtract does src -= w*bg in place.
+ */
+#define LAB_HISTS_CUBE_DECL(s, T)					\
+void lab_hists_mean_##s(const T* cube, const double* x, long n, long nhists, double* out); \
+void lab_hists_prms_##s(const T* cube, const double* x, long n, long nhists, double* out); \
+void lab_hists_rms_##s(const T* cube, const double* x, long n, long nhists, double* out); \
+void lab_hists_adev_##s(const T* cube, const double* x, long n, long nhists, double* out); \
+void lab_hists_prob_##s(const T* cube, long n, long nhists, double* out); \
+void lab_hists_subtract_##s(T* src, const T* bg, double w, long n, long nhists);
+
+LAB_HISTS_CUBE_DECL(l, int)
+LAB_HISTS_CUBE_DECL(f, float)
+LAB_HISTS_CUBE_DECL(d, double)
+
+#undef LAB_HISTS_CUBE_DECL
+
+/* box sums over wx by wy subtaps of a (nbins, nx, ny) cube, in place */
+void lab_box_filter_l(int* cube, long nbins, long nx, long ny, long wx, long wy);
+void lab_box_filter_f(float* cube, long nbins, long nx, long ny, long wx, long wy);
+void lab_box_filter_d(double* cube, long nbins, long nx, long ny, long wx, long wy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef HISTS_HH
+#define HISTS_HH
+
+#include <cstddef>
+#include "thread_pool.hh"
+
+namespace lab {
+
+  // Native versions of Lab.pm's hists_* functions. A histogram is n
+  // counts h[] at ascending bin values x[]; a cube is nhists of them
+  // stored one after another, i.e., a PDL of dims (n, nx, ny). The
+  // statistics are those of the values the histogram stands for, each
+  // x[i] repeated h[i] times, which is what Lab.pm means by rld() but
+  // without the zero padding that rld() adds along the first
+  // dimension of a cube. Counts may be any of the types instantiated
+  // in hists.cc: int, long, float and double.
+
+  // What PDL's stats() gives for the values, c.f. Lab::hists_stats.
+  // All zero for an empty histogram. Fractional counts are weights
+  // rather than being truncated by rld(), except for the median, which
+  // is that of stats() whatever the type of the counts, i.e.,
+  // hist_pct() at 0.5 rather than hist_median() below.
+  struct hist_summary {
+    double mean;
+    double prms;     // rms deviation from the mean, normalized by N-1
+    double median;
+    double min, max;
+    double adev;     // mean absolute deviation from the mean
+    double rms;      // rms deviation from the mean, normalized by N
+  };
+
+  template <class T>
+    void hist_summarize(const T* h, const double* x, std::size_t n,
+			hist_summary& s);
+
+  // Median of the values. For integer counts the middle pair are
+  // averaged, as PDL's median does, i.e., hist_pct() at 0.5. Floating
+  // point counts, which may be fractional or negative after background
+  // subtraction, give hist_quantiles() at 0.5 as Lab::hist_median_float
+  // does.
+  template <class T>
+    double hist_median(const T* h, const double* x, std::size_t n);
+
+  // Quantiles f[0 .. nf-1] of a histogram which may hold fractional
+  // or negative counts, interpolated from the cumulative distribution
+  // at the bin edges, c.f. hist_stats in genstats.pl. They are taken
+  // in the order given and, as there, the first one that PDL's
+  // interpol would croak on and all those after it are 0.
+  template <class T>
+    void hist_quantiles(const T* h, const double* x, std::size_t n,
+			const double* f, std::size_t nf, double* q);
+
+  // Percentiles f[0 .. nf-1] of the values, as PDL's pct() gives them
+  // for rld() of a histogram of nonnegative counts, c.f. fractions.pl.
+  // Fractional counts are truncated.
+  template <class T>
+    void hist_pct(const T* h, const double* x, std::size_t n,
+		  const double* f, std::size_t nf, double* q);
+
+  // move negative counts into the next bin, c.f. genstats.pl's
+  // shift_negs
+  template <class T>
+    void hist_shift_negs(T* h, std::size_t n);
+
+  // Zero the bins whose cumulative fraction is below f or above 1-f,
+  // c.f. Lab::hists_trim.
+  template <class T>
+    void hist_trim(T* h, std::size_t n, double f);
+
+  // Lab::hists_mean, hists_prms, hists_rms, hists_adev and hists_prob
+  // of a whole cube, and src -= w*bg as in the background subtraction
+  // of bg_vs_data.pl. These fuse what PDL does as a chain of cube-size
+  // temporaries into a single pass, see cube_expr.hh.
+  template <class T>
+    void hists_mean(thread_pool& pool, const T* cube, const double* x,
+		    std::size_t n, std::size_t nhists, double* mean);
+  template <class T>
+    void hists_prms(thread_pool& pool, const T* cube, const double* x,
+		    std::size_t n, std::size_t nhists, double* prms);
+  template <class T>
+    void hists_rms(thread_pool& pool, const T* cube, const double* x,
+		   std::size_t n, std::size_t nhists, double* rms);
+  template <class T>
+    void hists_adev(thread_pool& pool, const T* cube, const double* x,
+		    std::size_t n, std::size_t nhists, double* adev);
+  template <class T>
+    void hists_prob(thread_pool& pool, const T* cube, std::size_t n,
+		    std::size_t nhists, double* prob);
+  template <class T>
+    void hists_subtract(thread_pool& pool, T* src, const T* bg, double w,
+			std::size_t n, std::size_t nhists);
+
+  // The above for every histogram of a cube, spread over pool.
+  template <class T>
+    void hists_summarize(thread_pool& pool, const T* cube, const double* x,
+			 std::size_t n, std::size_t nhists, hist_summary* s)
+  {
+    parallel_for(pool, nhists, [=](std::size_t i) {
+	hist_summarize(cube + i*n, x, n, s[i]);
+      });
+  }
+
+  template <class T>
+    void hists_median(thread_pool& pool, const T* cube, const double* x,
+		      std::size_t n, std::size_t nhists, double* median)
+  {
+    parallel_for(pool, nhists, [=](std::size_t i) {
+	median[i] = hist_median(cube + i*n, x, n);
+      });
+  }
+
+  // q has nf values per histogram
+  template <class T>
+    void hists_quantiles(thread_pool& pool, const T* cube, const double* x,
+			 std::size_t n, std::size_t nhists,
+			 const double* f, std::size_t nf, double* q)
+  {
+    parallel_for(pool, nhists, [=](std::size_t i) {
+	hist_quantiles(cube + i*n, x, n, f, nf, q + i*nf);
+      });
+  }
+
+  template <class T>
+    void hists_pct(thread_pool& pool, const T* cube, const double* x,
+		   std::size_t n, std::size_t nhists,
+		   const double* f, std::size_t nf, double* q)
+  {
+    parallel_for(pool, nhists, [=](std::size_t i) {
+	hist_pct(cube + i*n, x, n, f, nf, q + i*nf);
+      });
+  }
+
+  template <class T>
+    void hists_shift_negs(thread_pool& pool, T* cube, std::size_t n,
+			  std::size_t nhists)
+  {
+    parallel_for(pool, nhists, [=](std::size_t i) {
+	hist_shift_negs(cube + i*n, n);
+      });
+  }
+
+  template <class T>
+    void hists_trim(thread_pool& pool, T* cube, std::size_t n,
+		    std::size_t nhists, double f)
+  {
+    parallel_for(pool, nhists, [=](std::size_t i) {
+	hist_trim(cube + i*n, n, f);
+      });
+  }
+
+} // namespace lab
+
+#endif
@@ -26,60 +26,109 @@ namespace lab {
 				  int &y1, int &y2,
 				  int &x1, int &x2)
   {
-    util::uint32 yytap, yysubtap, xxtap, xxsubtap, yy1, yy2, xx1, xx2;
+    util::uint32 hdr[11];
 
-    in.read(reinterpret_cast<char*>(&yytap), 4);
+    in.read(reinterpret_cast<char*>(&hdr[0]), 4);
     if (in.eof())
       return false;
-    in.read(reinterpret_cast<char*>(&yysubtap), 4);
-    in.read(reinterpret_cast<char*>(&xxtap), 4);
-    in.read(reinterpret_cast<char*>(&xxsubtap), 4);
-    in.read(reinterpret_cast<char*>(&yy1), 4);
-    in.read(reinterpret_cast<char*>(&yy2), 4);
-    in.read(reinterpret_cast<char*>(&xx1), 4);
-    in.read(reinterpret_cast<char*>(&xx2), 4);
+    in.read(reinterpret_cast<char*>(&hdr[1]), 10 * 4);
 
     if (!in)
       throw binfile_error("file truncated");
 
-    if (!isbigendian()) {
-      bswap(yytap);
-      bswap(yysubtap);
-      bswap(xxtap);
-      bswap(xxsubtap);
-      bswap(yy1);
-      bswap(yy2);
-      bswap(xx1);
-      bswap(xx2);
-    }
+    if (!isbigendian())
+      bswap(hdr, hdr+sizeof(hdr)/sizeof(hdr[0]));
+
+    ytap = hdr[0];
+    ysubtap = hdr[1];
+    xtap = hdr[2];
+    xsubtap = hdr[3];
+    y1 = hdr[4];
+    y2 = hdr[5];
+    x1 = hdr[6];
+    x2 = hdr[7];
 
-    ytap = yytap;
-    ysubtap = yysubtap;
-    xtap = xxtap;
-    xsubtap = xxsubtap;
-    y1 = yy1;
-    y2 = yy2;
-    x1 = xx1;
-    x2 = xx2;
+    sample_type = hdr[8];
+    data_type = hdr[9];
+    data_n = hdr[10];
+
+    if (sample_type != hist_vals && sample_type != data_vals)
+      throw binfile_error("unrecognized sample type "+util::ss_cast<string>(sample_type));
+
+    if (data_type != pdl_short && data_type != pdl_long && data_type != pdl_float)
+      throw binfile_error("unrecognized data type "+util::ss_cast<string>(data_type));
 
     return true;
   }
 
-  void binfile_input::read_data(vector<int> &x, vector<int> &y)
-  {
-    util::uint32 yy[256];
+  namespace {
+    // only 4-byte data are big-endian, see binfile_input
+    template <class T>
+      bool swapped()
+    {
+      return sizeof(T) == 4 && !isbigendian();
+    }
 
-    in.read(reinterpret_cast<char*>(&yy[0]), 256 * 4);
+    template <class T, class U>
+      void read_values(std::fstream& in, int n, vector<T>& buf, vector<U>& vals)
+    {
+      buf.resize(n);
+      if (n)
+	in.read(reinterpret_cast<char*>(&buf[0]), n * sizeof(T));
+      if (!in)
+	throw binfile_error("file truncated");
+      if (swapped<T>())
+	bswap(buf.begin(), buf.end());
+      vals.assign(buf.begin(), buf.end());
+    }
 
-    if (!in)
-      throw binfile_error("file truncated");
+    // bin values as PDL's hist(data, -0.5, nbins-0.5, 1) would
+    void hist_values(const vector<double>& vals, vector<int>& y)
+    {
+      const int nbins = y.size();
+      for (vector<double>::size_type i=0; i!=vals.size(); ++i) {
+	double d = vals[i] + 0.5;
+	if (d < 0)
+	  continue;
+	int j = static_cast<int>(d);
+	if (j < nbins)
+	  ++y[j];
+      }
+    }
+  }
 
-    if (!isbigendian())
-      bswap(yy, yy+sizeof(yy)/sizeof(yy[0]));
+  void binfile_input::read_data(vector<int> &x, vector<int> &y)
+  {
+    switch (data_type) {
+    case pdl_short:
+      read_values(in, data_n, sbuf, vals);
+      break;
+    case pdl_long:
+      read_values(in, data_n, lbuf, vals);
+      break;
+    case pdl_float:
+      read_values(in, data_n, fbuf, vals);
+      break;
+    }
 
-    x.resize(256);
+    x.resize(nbins);
     generate(x.begin(), x.end(), sequence<int>(0,1));
-    y = vector<int>(yy, yy+sizeof(yy)/sizeof(yy[0]));
+
+    if (sample_type == hist_vals) {
+      // e.g., SAMP histogram is in the file, but we weren't told
+      if (vals.size() != nbins)
+	throw binfile_error("histogram size mismatch");
+      y.assign(vals.begin(), vals.end());
+    }
+    else {
+      y.assign(nbins, 0);
+      hist_values(vals, y);
+    }
+  }
+
+  void binfile_input::skip_data()
+  {
+    in.seekg(data_n * (data_type == pdl_short ? 2 : 4), std::ios_base::cur);
   }
 
   bool binfile_input::next_subtap(int &ytap, int &ysubtap,
@@ -89,7 +138,7 @@ namespace lab {
     if (!read_header(ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2))
       return false;
 
-    in.seekg(256 * 4, std::ios_base::cur);
+    skip_data();
 
     if (!in)
       throw binfile_error("file truncated");
@@ -115,6 +164,120 @@ namespace lab {
     return true;
   }
 
+  void binfile_output::write_header(int ytap, int ysubtap,
+				    int xtap, int xsubtap,
+				    int y1, int y2, int x1, int x2,
+				    int sample_type, int data_type, int n)
+  {
+    util::uint32 hdr[11] = {
+      util::uint32(ytap), util::uint32(ysubtap),
+      util::uint32(xtap), util::uint32(xsubtap),
+      util::uint32(y1), util::uint32(y2),
+      util::uint32(x1), util::uint32(x2),
+      util::uint32(sample_type), util::uint32(data_type),
+      util::uint32(n)
+    };
+
+    if (!isbigendian())
+      bswap(hdr, hdr+sizeof(hdr)/sizeof(hdr[0]));
+
+    out.write(reinterpret_cast<const char*>(&hdr[0]), sizeof(hdr));
+  }
+
+  namespace {
+    template <class T>
+      void write_values(std::fstream& out, vector<T>& data)
+    {
+      if (swapped<T>())
+	bswap(data.begin(), data.end());
+      if (!data.empty())
+	out.write(reinterpret_cast<const char*>(&data[0]), data.size() * sizeof(T));
+    }
+  }
+
+  void binfile_output::add_subtap(int ytap, int ysubtap,
+				  int xtap, int xsubtap,
+				  int y1, int y2, int x1, int x2,
+				  const vector<int> &y)
+  {
+    write_header(ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2,
+		 hist_vals, pdl_long, y.size());
+
+    lbuf.assign(y.begin(), y.end());
+    write_values(out, lbuf);
+
+    if (!out)
+      throw binfile_error("error writing subtap record");
+  }
+
+  void binfile_output::add_subtap(int ytap, int ysubtap,
+				  int xtap, int xsubtap,
+				  int y1, int y2, int x1, int x2,
+				  const vector<double> &vals)
+  {
+    const std::size_t n = nbins(type);
+
+    if (vals.size() > n) {
+      hbuf.assign(n, 0);
+      hist_values(vals, hbuf);
+      add_subtap(ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2, hbuf);
+      return;
+    }
+
+    if (type == "pha") {
+      write_header(ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2,
+		   data_vals, pdl_short, vals.size());
+      sbuf.assign(vals.begin(), vals.end());
+      write_values(out, sbuf);
+    }
+    else {
+      write_header(ytap, ysubtap, xtap, xsubtap, y1, y2, x1, x2,
+		   data_vals, pdl_float, vals.size());
+      fbuf.assign(vals.begin(), vals.end());
+      write_values(out, fbuf);
+    }
+
+    if (!out)
+      throw binfile_error("error writing subtap record");
+  }
+
+  double hist_median(const vector<int>& y)
+  {
+    long n = std::accumulate(y.begin(), y.end(), 0L);
+    if (n <= 0)
+      return 0;
+
+    // the two middle values, equal when n is odd
+    long lo = (n-1) / 2, hi = n / 2;
+    int xlo = -1, xhi = -1;
+
+    long cumu = 0;
+    for (vector<int>::size_type i=0; i!=y.size(); ++i) {
+      cumu += y[i];
+      if (xlo < 0 && cumu > lo)
+	xlo = i;
+      if (cumu > hi) {
+	xhi = i;
+	break;
+      }
+    }
+
+    return 0.5 * (xlo + xhi);
+  }
+
+  std::size_t nbins(const string& type)
+  {
+    if (type == "pha")
+      return pha_nbins;
+    if (type == "samp")
+      return samp_nbins;
+    if (type == "spimean")
+      return spimean_nbins;
+    if (type == "spimed")
+      return spimed_nbins;
+    throw std::invalid_argument("unrecognized histogram type '"+type+"'");
+  }
+
   namespace {
     int str2int(const string& s) {
       return util::ss_cast<int, string>(s);
@@ -130,6 +293,21 @@ namespace lab {
 		 vector<int>&         bg_time,
 		 vector<string>& bg_hrc_file
 		 )
+  {
+    test_data(lab::testfile, anodes, line, energy, mcp, time,
+	      hrc_file, bg_time, bg_hrc_file);
+  }
+
+  void test_data(const string& config,
+		 const vector<string>& anodes,
+		 vector<string>& line,
+		 vector<int>&         energy,
+		 vector<int>&         mcp,
+		 vector<int>&         time,
+		 vector<string>& hrc_file,
+		 vector<int>&         bg_time,
+		 vector<string>& bg_hrc_file
+		 )
   {
     map<string, vector<string> > cols;
 
@@ -142,7 +320,7 @@ namespace lab {
 			    "b_HRC_file",
     };
 
-    rdb_read(lab::testfile, cols, vector<string>(names, names+sizeof(names)/sizeof(names[0])));
+    rdb_read(config, cols, vector<string>(names, names+sizeof(names)/sizeof(names[0])));
 
     line        = cols["line"];
     hrc_file    = cols["HRC_file"];
@@ -164,4 +342,73 @@ namespace lab {
 
   }
 
+  int mcp_to_chipid(int mcp)
+  {
+    switch (mcp) {
+    case 1:
+      return 1;
+    case 0:
+      return 2;
+    case -1:
+      return 3;
+    }
+    throw std::invalid_argument("unrecognized MCP == "+util::ss_cast<string>(mcp));
+  }
+
+  void rawy_limits_mcp(int mcp, long& lo, long& hi)
+  {
+    const int id = mcp_to_chipid(mcp);
+    lo = long(chipy_max) * (id - 1);
+    hi = long(chipy_max) * id - 1;
+  }
+
+  int test_exptime(const string& config, const string& hrc_file)
+  {
+    vector<string> line, file, bg_file;
+    vector<int> energy, mcp, time, bg_time;
+
+    test_data(config, vector<string>(), line, energy, mcp, time,
+	      file, bg_time, bg_file);
+
+    vector<string>::iterator it = find(file.begin(), file.end(), hrc_file);
+    if (it == file.end())
+      throw std::invalid_argument("no data found for basename "+hrc_file);
+    if (find(it+1, file.end(), hrc_file) != file.end())
+      throw std::invalid_argument("multiple data found for basename "+hrc_file);
+
+    return time[it-file.begin()];
+  }
+
+  map<int, double> merged_bg_exptimes(const string& config)
+  {
+    // tests left out of the merged background, c.f. Lab::merged_bg_omit
+    const char* omit[] = { "p197061504",
+			   "p197061508",
+			   "p197061512",
+			   "p197061516",
+    };
+    const char** omit_end = omit+sizeof(omit)/sizeof(omit[0]);
+
+    vector<string> line, file, bg_file;
+    vector<int> energy, mcp, time, bg_time;
+
+    test_data(config, vector<string>(), line, energy, mcp, time,
+	      file, bg_time, bg_file);
+
+    map<int, double> times;
+    times[1] = times[2] = times[3] = 0;
+
+    for (vector<int>::size_type i=0; i!=mcp.size(); ++i) {
+      int data_chipid = mcp_to_chipid(mcp[i]);
+      bool omitted = find(omit, omit_end, file[i]) != omit_end;
+      for (int chipid=1; chipid<=3; ++chipid) {
+	times[chipid] += bg_time[i];
+	if (!omitted && chipid != data_chipid)
+	  times[chipid] += time[i];
+      }
+    }
+
+    return times;
+  }
+
 } // namespace lab
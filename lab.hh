@@ -5,6 +5,8 @@
 #include <string>
 #include <stdexcept>
 #include <fstream>
+#include <map>
+#include <cpputil/byte.hh>
 
 namespace lab {
 
@@ -27,6 +29,37 @@ namespace lab {
   const std::size_t tapsize = 256;
   const std::size_t subtaps = 3;
 
+  // number of bins in the various histogram types, c.f. %Lab::NBINS
+  const std::size_t pha_nbins = 256;
+  const std::size_t samp_nbins = 512;
+  const std::size_t spimean_nbins = 512;
+  const std::size_t spimed_nbins = 512;
+
+  std::size_t nbins(const std::string& type);
+
+  // median of the values a histogram represents, i.e., the median of
+  // rld(y, x) with x the bin number
+  double hist_median(const std::vector<int>& y);
+
+  // BIN file record sample types, c.f. Lab::BinFile
+  const int hist_vals = 1;
+  const int data_vals = 2;
+
+  // PDL datatype codes used in BIN file records
+  const int pdl_short = 1;
+  const int pdl_long = 3;
+  const int pdl_float = 5;
+
+  void test_data(const std::string& config,
+		 const std::vector<std::string>& anodes,
+		 std::vector<std::string>& line,
+		 std::vector<int>&         energy,
+		 std::vector<int>&         mcp,
+		 std::vector<int>&         time,
+		 std::vector<std::string>& hrc_file,
+		 std::vector<int>&         bg_time,
+		 std::vector<std::string>& bg_hrc_file);
+
   void test_data(const std::vector<std::string>& anodes,
 		 std::vector<std::string>& line,
 		 std::vector<int>&         energy,
@@ -36,6 +69,18 @@ namespace lab {
 		 std::vector<int>&         bg_time,
 		 std::vector<std::string>& bg_hrc_file);
 
+  int mcp_to_chipid(int mcp);
+
+  // rawy range [lo, hi] of the MCP of a test, c.f. Lab::rawy_limits_mcp
+  void rawy_limits_mcp(int mcp, long& lo, long& hi);
+
+  // exposure time of a single test
+  int test_exptime(const std::string& config, const std::string& hrc_file);
+
+  // total exposure time of the merged background for each chip_id,
+  // c.f. Lab::merged_bg_exptimes
+  std::map<int, double> merged_bg_exptimes(const std::string& config);
+
   class binfile_error : public std::runtime_error
   {
   public:
@@ -44,17 +89,37 @@ namespace lab {
     { }
   };
 
+  // Reads BIN files as written by Lab::OutBinFile. Each record is a
+  // header of eleven big-endian 32 bit words
+  //
+  //   YTAP YSUBTAP XTAP XSUBTAP Y1 Y2 X1 X2 SAMPLE_TYPE DATA_TYPE N
+  //
+  // followed by N values, either a histogram (hist_vals) or the raw
+  // data values (data_vals). 4-byte values are big-endian, but 2-byte
+  // (PHA) values are in the byte order of the host that wrote them,
+  // as bswap4 leaves them alone. Raw data values are binned into a
+  // histogram of nbins on input.
   class binfile_input {
   private:
 
     bool read_header(int&, int&, int&, int&, int&, int&, int&, int&);
     void read_data(std::vector<int>&, std::vector<int>&);
+    void skip_data();
     std::fstream in;
+    std::size_t nbins;
+    int sample_type, data_type, data_n;
+
+    // reused from record to record
+    std::vector<util::int16> sbuf;
+    std::vector<util::int32> lbuf;
+    std::vector<float> fbuf;
+    std::vector<double> vals;
 
   public:
 
-    binfile_input ( const std::string& s )
-      : in(s.c_str(), std::ios_base::binary | std::ios_base::in)
+    binfile_input ( const std::string& s, std::size_t n = pha_nbins )
+      : in(s.c_str(), std::ios_base::binary | std::ios_base::in),
+	nbins(n), sample_type(0), data_type(0), data_n(0)
     {
       if (!in)
 	throw binfile_error("unable to open file "+s);
@@ -75,6 +140,60 @@ namespace lab {
 
   };
 
+  // Writes subtap records in the format read by binfile_input and
+  // Lab::InBinFile. As with Lab::OutBinFile, event values are written
+  // as is (short for PHA, float otherwise) unless there are more of
+  // them than histogram bins, in which case their histogram is
+  // written instead.
+  class binfile_output {
+  private:
+    std::fstream out;
+    std::string type;
+
+    // reused from record to record
+    std::vector<util::int16> sbuf;
+    std::vector<util::int32> lbuf;
+    std::vector<float> fbuf;
+    std::vector<int> hbuf;
+
+    void write_header(int, int, int, int, int, int, int, int, int, int, int);
+
+  public:
+
+    // with append, records are added to an existing file, e.g., when
+    // resuming an interrupted run
+    binfile_output ( const std::string& s, const std::string& t = "pha",
+		     bool append = false )
+      : out(s.c_str(), std::ios_base::binary | std::ios_base::out |
+	    (append ? std::ios_base::app : std::ios_base::trunc)),
+	type(t)
+    {
+      if (!out)
+	throw binfile_error("unable to open file "+s+" for writing");
+    }
+
+    void flush()
+    {
+      if (!out.flush())
+	throw binfile_error("error writing file");
+    }
+
+    // write a histogram
+    void add_subtap( int ytap, int ysubtap,
+		     int xtap, int xsubtap,
+		     int y1, int y2,
+		     int x1, int x2,
+		     const std::vector<int> &y );
+
+    // write event values
+    void add_subtap( int ytap, int ysubtap,
+		     int xtap, int xsubtap,
+		     int y1, int y2,
+		     int x1, int x2,
+		     const std::vector<double> &vals );
+
+  };
+
 
 } // namespace lab
 
@@ -0,0 +1,353 @@
+#ifndef LMBATCH_HH
+#define LMBATCH_HH
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+#include <chrono>
+#include "arena.hh"
+#include "lmfit.hh"
+
+namespace lab {
+
+  // Levenberg-Marquardt fitting of many histograms at once. Fits which
+  // share x and the model are advanced in lockstep, lm_lanes at a time,
+  // with every quantity held as an array over the fits (structure of
+  // arrays) so that model evaluation, the sums of lm_coef and the
+  // solution of the normal equations are loops over fits the compiler
+  // can vectorize. Each fit keeps its own lambda and stops on its own,
+  // as lmfit would, and its lane then takes the next fit. Results agree
+  // with lmfit's to rounding, the normal equations being solved by
+  // Cholesky decomposition rather than Gaussian elimination.
+
+  // fits advanced together, a multiple of the vector width of any
+  // likely target
+  const std::size_t lm_lanes = 8;
+
+  namespace lm_detail {
+
+    const std::size_t L = lm_lanes;
+
+    // lm_coef over L fits: yt and wt (null for unit weights) are
+    // [n][L], a [npar][L], alpha the lower triangle [npar][npar][L],
+    // beta [npar][L] and chisq [L]
+    template <class Model>
+      void coef(const Model& model, const double* x, std::size_t n,
+		const double* yt, const double* wt, const double* a,
+		double* alpha, double* beta, double* chisq)
+    {
+      const std::size_t m = Model::npar;
+
+      std::fill(alpha, alpha+m*m*L, 0.);
+      std::fill(beta, beta+m*L, 0.);
+      std::fill(chisq, chisq+L, 0.);
+
+      double dy[L], d[m][L];
+      for (std::size_t i=0; i<n; ++i) {
+
+	for (std::size_t l=0; l<L; ++l) {
+	  double al[m], dl[m];
+	  for (std::size_t j=0; j<m; ++j)
+	    al[j] = a[j*L+l];
+	  dy[l] = yt[i*L+l] - model(x[i], al, dl);
+	  for (std::size_t j=0; j<m; ++j)
+	    d[j][l] = dl[j];
+	}
+
+	const double* w = wt ? wt + i*L : 0;
+	for (std::size_t l=0; l<L; ++l) {
+	  const double wdy = w ? w[l] * dy[l] : dy[l];
+	  chisq[l] += wdy * dy[l];
+	  dy[l] = wdy;
+	}
+
+	for (std::size_t j=0; j<m; ++j) {
+	  for (std::size_t l=0; l<L; ++l)
+	    beta[j*L+l] += dy[l] * d[j][l];
+	  double wd[L];
+	  for (std::size_t l=0; l<L; ++l)
+	    wd[l] = w ? w[l] * d[j][l] : d[j][l];
+	  for (std::size_t k=0; k<=j; ++k)
+	    for (std::size_t l=0; l<L; ++l)
+	      alpha[(j*m+k)*L+l] += wd[l] * d[k][l];
+	}
+      }
+    }
+
+    // Solve c.x = b over L fits in place, c [m][m][L] symmetric
+    // positive definite with its lower triangle used and b [m][L]
+    // overwritten with x; ok[l] is cleared where c is not.
+    template <std::size_t m>
+      void solve(double* c, double* b, bool* ok)
+    {
+      // Cholesky decomposition, c = g.g' with g left in the lower
+      // triangle of c
+      for (std::size_t j=0; j<m; ++j)
+	for (std::size_t k=0; k<=j; ++k) {
+	  double s[L];
+	  for (std::size_t l=0; l<L; ++l)
+	    s[l] = c[(j*m+k)*L+l];
+	  for (std::size_t p=0; p<k; ++p)
+	    for (std::size_t l=0; l<L; ++l)
+	      s[l] -= c[(j*m+p)*L+l] * c[(k*m+p)*L+l];
+	  if (k < j)
+	    for (std::size_t l=0; l<L; ++l)
+	      c[(j*m+k)*L+l] = s[l] / c[(k*m+k)*L+l];
+	  else
+	    for (std::size_t l=0; l<L; ++l) {
+	      const bool pd = s[l] > 0 && s[l] < HUGE_VAL;
+	      ok[l] = ok[l] && pd;
+	      c[(j*m+j)*L+l] = std::sqrt(pd ? s[l] : 1.);
+	    }
+	}
+
+      // g.z = b, then g'.x = z
+      for (std::size_t j=0; j<m; ++j) {
+	for (std::size_t p=0; p<j; ++p)
+	  for (std::size_t l=0; l<L; ++l)
+	    b[j*L+l] -= c[(j*m+p)*L+l] * b[p*L+l];
+	for (std::size_t l=0; l<L; ++l)
+	  b[j*L+l] /= c[(j*m+j)*L+l];
+      }
+      for (std::size_t j=m; j-- > 0; ) {
+	for (std::size_t p=j+1; p<m; ++p)
+	  for (std::size_t l=0; l<L; ++l)
+	    b[j*L+l] -= c[(p*m+j)*L+l] * b[p*L+l];
+	for (std::size_t l=0; l<L; ++l)
+	  b[j*L+l] /= c[(j*m+j)*L+l];
+      }
+    }
+
+    // State of the L lanes, each holding one fit at a time. A lane
+    // whose fit stops is given the next one waiting, so that lanes
+    // are not left idle until the slowest fit of a group is done.
+    template <std::size_t m>
+      struct lanes {
+	double* yt;            // [n][L]
+	double* wt;            // [n][L], or null
+	double a[m*L], atry[m*L], da[m*L];
+	double alpha[m*m*L], beta[m*L], alpha_try[m*m*L], beta_try[m*L];
+	double cov[m*m*L];
+	double chisq[L], chisq_try[L], lambda[L], seconds[L];
+	std::size_t fit[L];
+	int niter[L], nfev[L];
+	bool live[L], fresh[L], ok[L], converged[L];
+      };
+
+    // start fit f in lane l; its chi-square and curvature are those
+    // of the next evaluation
+    template <std::size_t m>
+      void load(lanes<m>& s, std::size_t l, std::size_t f, std::size_t n,
+		const double* const* y, const double* const* w,
+		double* const* a)
+    {
+      for (std::size_t i=0; i<n; ++i) {
+	s.yt[i*L+l] = y[f][i];
+	if (s.wt)
+	  s.wt[i*L+l] = w[f][i];
+      }
+      for (std::size_t j=0; j<m; ++j)
+	s.a[j*L+l] = a[f][j];
+      s.fit[l] = f;
+      s.lambda[l] = 0.001;
+      s.niter[l] = s.nfev[l] = 0;
+      s.seconds[l] = 0;
+      s.live[l] = s.fresh[l] = true;
+      s.converged[l] = false;
+    }
+
+    template <class Model>
+      void fit_all(const Model& model, const double* x, std::size_t n,
+		   const double* const* y, const double* const* w,
+		   double* const* a, lm_result* r, std::size_t nfit,
+		   const lm_options& opt, double* yt, double* wt)
+    {
+      const std::size_t m = Model::npar;
+      if (!nfit)
+	return;
+
+      // zeroed, as the first step of every lane reads the curvature
+      // and lambda of evaluations it has not yet had, and an idle lane
+      // never has one
+      lanes<m> s = {};
+      s.yt = yt;
+      s.wt = wt;
+
+      // idle lanes evaluate the first fit's model against no counts
+      std::fill(yt, yt+n*L, 0.);
+      if (wt)
+	std::fill(wt, wt+n*L, 0.);
+      for (std::size_t l=0; l<L; ++l) {
+	for (std::size_t j=0; j<m; ++j)
+	  s.a[j*L+l] = a[0][j];
+	s.live[l] = s.fresh[l] = false;
+      }
+
+      std::size_t next = 0;
+      for (std::size_t l=0; l<L && next<nfit; ++l)
+	load(s, l, next++, n, y, w, a);
+
+      typedef std::chrono::steady_clock clock;
+      clock::time_point t0 = clock::now();
+
+      for (;;) {
+	int nlive = 0;
+	for (std::size_t l=0; l<L; ++l)
+	  nlive += s.live[l];
+	if (!nlive)
+	  break;
+
+	// a parameter with no effect on the model is held where it is
+	// by lambda alone, as in lmfit
+	std::copy(s.alpha, s.alpha+m*m*L, s.cov);
+	std::copy(s.beta, s.beta+m*L, s.da);
+	for (std::size_t j=0; j<m; ++j)
+	  for (std::size_t l=0; l<L; ++l) {
+	    const double c = s.cov[(j*m+j)*L+l];
+	    s.cov[(j*m+j)*L+l] = c ? c * (1 + s.lambda[l]) : s.lambda[l];
+	  }
+
+	for (std::size_t l=0; l<L; ++l) {
+	  s.ok[l] = s.live[l] && !s.fresh[l];
+	  s.niter[l] += s.ok[l];
+	}
+	solve<m>(s.cov, s.da, s.ok);
+
+	// steps out of bounds stop at them; a fit just started is
+	// evaluated at its initial parameters
+	for (std::size_t j=0; j<m; ++j)
+	  for (std::size_t l=0; l<L; ++l) {
+	    double t = s.a[j*L+l];
+	    if (s.ok[l]) {
+	      t += s.da[j*L+l];
+	      if (opt.lo && t < opt.lo[j])
+		t = opt.lo[j];
+	      if (opt.hi && t > opt.hi[j])
+		t = opt.hi[j];
+	    }
+	    s.atry[j*L+l] = t;
+	  }
+
+	coef(model, x, n, s.yt, s.wt, s.atry, s.alpha_try, s.beta_try, s.chisq_try);
+
+	// the time of an iteration is shared by the fits taking part
+	const clock::time_point t1 = clock::now();
+	const double dt = std::chrono::duration<double>(t1 - t0).count() / nlive;
+	t0 = t1;
+
+	for (std::size_t l=0; l<L; ++l) {
+	  if (!s.live[l])
+	    continue;
+	  s.nfev[l] += s.ok[l] || s.fresh[l];
+	  s.seconds[l] += dt;
+
+	  bool accept = false, done = false;
+	  if (s.fresh[l]) {
+	    s.fresh[l] = false;
+	    accept = true;
+	    done = opt.maxiter <= 0;
+	  }
+
+	  // a singular system, as when lm_solve fails
+	  else if (!s.ok[l])
+	    s.lambda[l] *= 10;
+
+	  // NaN compares false and is rejected along with any uphill step
+	  else if (s.chisq_try[l] < s.chisq[l]) {
+	    const double decrease = s.chisq[l] - s.chisq_try[l];
+	    s.lambda[l] *= 0.1;
+	    accept = true;
+	    if (decrease <= opt.eps * std::max(1., s.chisq_try[l]))
+	      s.converged[l] = true;
+	  }
+
+	  else {
+	    s.lambda[l] *= 10;
+	    // no downhill direction left, we're at the minimum
+	    if (s.lambda[l] > 1e10)
+	      s.converged[l] = true;
+	  }
+
+	  if (accept) {
+	    s.chisq[l] = s.chisq_try[l];
+	    for (std::size_t j=0; j<m; ++j) {
+	      s.a[j*L+l] = s.atry[j*L+l];
+	      s.beta[j*L+l] = s.beta_try[j*L+l];
+	      for (std::size_t k=0; k<=j; ++k)
+		s.alpha[(j*m+k)*L+l] = s.alpha_try[(j*m+k)*L+l];
+	    }
+	  }
+
+	  if (!(done || s.converged[l] || s.niter[l] >= opt.maxiter))
+	    continue;
+
+	  const std::size_t f = s.fit[l];
+	  for (std::size_t j=0; j<m; ++j)
+	    a[f][j] = s.a[j*L+l];
+	  r[f].niter = s.niter[l];
+	  r[f].nfev = s.nfev[l];
+	  r[f].chisq = s.chisq[l];
+	  r[f].seconds = s.seconds[l];
+	  r[f].converged = s.converged[l];
+
+	  s.live[l] = false;
+	  if (next < nfit)
+	    load(s, l, next++, n, y, w, a);
+	}
+      }
+    }
+
+  } // namespace lm_detail
+
+  // lmfit of nfit histograms y[f][n], with weights w[f][n] or unit
+  // weights if w is null, which all share x[n], the model and the
+  // parameter limits of opt. a[f] holds the initial parameters of each
+  // fit on input and its fitted parameters on output, r[f] its result.
+  template <class Model>
+    void lmfit_batch(const Model& model, const double* x, std::size_t n,
+		     const double* const* y, const double* const* w,
+		     double* const* a, lm_result* r, std::size_t nfit,
+		     arena& scratch, const lm_options& opt = lm_options())
+  {
+    double* yt = scratch.alloc<double>(n*lm_lanes);
+    double* wt = w ? scratch.alloc<double>(n*lm_lanes) : 0;
+    lm_detail::fit_all(model, x, n, y, w, a, r, nfit, opt, yt, wt);
+  }
+
+  // ngauss_fit of nfit histograms y[f][nbins], sharing g1_ampl_max
+  inline void ngauss_fit_batch(const double* const* y, std::size_t nbins,
+			       double* const* a, lm_result* r, std::size_t nfit,
+			       double g1_ampl_max, arena& scratch)
+  {
+    if (nbins < 3) {
+      std::fill(r, r+nfit, lm_result());
+      return;
+    }
+
+    const std::size_t n = nbins - 2;
+    double* x = scratch.alloc<double>(n);
+    for (std::size_t j=0; j<n; ++j)
+      x[j] = j + 1;
+
+    const double** yy = scratch.alloc<const double*>(nfit);
+    const double** ww = scratch.alloc<const double*>(nfit);
+    for (std::size_t f=0; f<nfit; ++f) {
+      double* w = scratch.alloc<double>(n);
+      gehrels_weights(y[f]+1, n, w);
+      yy[f] = y[f]+1;
+      ww[f] = w;
+    }
+
+    const double lo[] = { 1e-3, x[0], 0, 1e-3, x[0], 0 };
+    const double hi[] = { HUGE_VAL, x[n-1], g1_ampl_max,
+			  HUGE_VAL, x[n-1], HUGE_VAL };
+    lm_options opt;
+    opt.lo = lo;
+    opt.hi = hi;
+
+    lmfit_batch(two_ngauss1d(), x, n, yy, ww, a, r, nfit, scratch, opt);
+  }
+
+} // namespace lab
+
+#endif
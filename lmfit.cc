@@ -0,0 +1,92 @@
+#include <cmath>
+#include <algorithm>
+#include "lmfit.hh"
+
+namespace lab {
+
+  using std::size_t;
+
+  bool lm_solve(double* a, double* b, size_t n)
+  {
+    // Gaussian elimination with partial pivoting
+    for (size_t k=0; k<n; ++k) {
+      size_t p = k;
+      for (size_t i=k+1; i<n; ++i)
+	if (std::fabs(a[i*n+k]) > std::fabs(a[p*n+k]))
+	  p = i;
+
+      if (a[p*n+k] == 0 || !std::isfinite(a[p*n+k]))
+	return false;
+
+      if (p != k) {
+	std::swap_ranges(a+k*n, a+k*n+n, a+p*n);
+	std::swap(b[k], b[p]);
+      }
+
+      for (size_t i=k+1; i<n; ++i) {
+	const double f = a[i*n+k] / a[k*n+k];
+	for (size_t j=k; j<n; ++j)
+	  a[i*n+j] -= f * a[k*n+j];
+	b[i] -= f * b[k];
+      }
+    }
+
+    for (size_t k=n; k-- > 0; ) {
+      double s = b[k];
+      for (size_t j=k+1; j<n; ++j)
+	s -= a[k*n+j] * b[j];
+      b[k] = s / a[k*n+k];
+    }
+
+    return true;
+  }
+
+  void gauss_init(double norm, double median, bool twogauss, double* a)
+  {
+    if (twogauss) {
+      a[0] = norm / 5;
+      a[1] = 50;
+      a[2] = median / 2;
+      a[3] = norm;
+      a[4] = 15;
+      a[5] = median;
+    }
+    else {
+      a[0] = norm;
+      a[1] = 15;
+      a[2] = median;
+    }
+  }
+
+  void gehrels_weights(const double* y, size_t n, double* w)
+  {
+    for (size_t i=0; i<n; ++i) {
+      const double s = 1 + std::sqrt(std::max(y[i], 0.) + 0.75);
+      w[i] = 1 / (s * s);
+    }
+  }
+
+  lm_result ngauss_fit(const double* y, size_t nbins, double* a,
+		       double g1_ampl_max, arena& scratch)
+  {
+    if (nbins < 3)
+      return lm_result();
+
+    const size_t n = nbins - 2;
+    double* x = scratch.alloc<double>(n);
+    double* w = scratch.alloc<double>(n);
+    for (size_t j=0; j<n; ++j)
+      x[j] = j + 1;
+    gehrels_weights(y+1, n, w);
+
+    const double lo[] = { 1e-3, x[0], 0, 1e-3, x[0], 0 };
+    const double hi[] = { HUGE_VAL, x[n-1], g1_ampl_max,
+			  HUGE_VAL, x[n-1], HUGE_VAL };
+    lm_options opt;
+    opt.lo = lo;
+    opt.hi = hi;
+
+    return lmfit(two_ngauss1d(), x, y+1, w, n, a, opt);
+  }
+
+} // namespace lab
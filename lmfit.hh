@@ -0,0 +1,177 @@
+#ifndef LMFIT_HH
+#define LMFIT_HH
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include "arena.hh"
+#include "lmmodels.hh"
+
+namespace lab {
+
+  // Levenberg-Marquardt fitting of histograms, a native replacement
+  // for PDL::Fit::LM::lmfit with the one_normal/two_normals callbacks
+  // in genstats.pl. Models, in lmmodels.hh, are functors with a
+  // static npar and an operator() which evaluates the model and its
+  // analytic partials at a single point.
+
+  struct lm_options {
+    int maxiter;
+    double eps;     // relative chi-square decrease taken as convergence
+    const double* lo;  // npar lower and upper parameter limits, or null
+    const double* hi;
+    lm_options() : maxiter(200), eps(1e-4), lo(0), hi(0) { }
+  };
+
+  struct lm_result {
+    int niter;
+    int nfev;        // evaluations of the model over the histogram
+    double chisq;
+    double seconds;  // time taken, by lmfit_batch its share of the lanes'
+    bool converged;
+    lm_result() : niter(0), nfev(0), chisq(0), seconds(0), converged(false) { }
+  };
+
+  // solve a.x = b in place for small dense systems, b is overwritten
+  // with x; returns false if a is singular
+  bool lm_solve(double* a, double* b, std::size_t n);
+
+  // chi-square, curvature matrix alpha and gradient beta, with
+  // weights w[n] (1/sigma^2) or unit weights if w is null
+  template <class Model>
+    double lm_coef(const Model& model,
+		   const double* x, const double* y, const double* w,
+		   std::size_t n,
+		   const double* a, double* alpha, double* beta)
+  {
+    const std::size_t m = Model::npar;
+    double dyda[Model::npar];
+
+    std::fill(alpha, alpha+m*m, 0.);
+    std::fill(beta, beta+m, 0.);
+
+    double chisq = 0;
+    for (std::size_t i=0; i<n; ++i) {
+      const double dy = y[i] - model(x[i], a, dyda);
+      const double wt = w ? w[i] : 1.;
+      chisq += wt * dy * dy;
+      for (std::size_t j=0; j<m; ++j) {
+	const double wd = wt * dyda[j];
+	beta[j] += dy * wd;
+	for (std::size_t k=0; k<=j; ++k)
+	  alpha[j*m+k] += wd * dyda[k];
+      }
+    }
+
+    for (std::size_t j=1; j<m; ++j)
+      for (std::size_t k=0; k<j; ++k)
+	alpha[k*m+j] = alpha[j*m+k];
+
+    return chisq;
+  }
+
+  // Fit model to (x, y) with weights w (null for unit weights), a
+  // holds the initial parameters on input and the fitted parameters on
+  // output.
+  template <class Model>
+    lm_result lmfit(const Model& model,
+		    const double* x, const double* y, const double* w,
+		    std::size_t n,
+		    double* a, const lm_options& opt = lm_options())
+  {
+    const std::size_t m = Model::npar;
+    double alpha[m*m], beta[m], cov[m*m], da[m];
+    double atry[m], alpha_try[m*m], beta_try[m];
+
+    typedef std::chrono::steady_clock clock;
+    const clock::time_point start = clock::now();
+
+    lm_result r;
+    double lambda = 0.001;
+    r.chisq = lm_coef(model, x, y, w, n, a, alpha, beta);
+    r.nfev = 1;
+
+    while (r.niter < opt.maxiter) {
+      ++r.niter;
+
+      std::copy(alpha, alpha+m*m, cov);
+      std::copy(beta, beta+m, da);
+      // a parameter with no effect on the model, e.g., the width of a
+      // component of zero amplitude, is held where it is by lambda
+      // alone rather than making the system singular
+      for (std::size_t j=0; j<m; ++j)
+	cov[j*m+j] = cov[j*m+j] ? cov[j*m+j] * (1 + lambda) : lambda;
+
+      if (!lm_solve(cov, da, m)) {
+	lambda *= 10;
+	continue;
+      }
+
+      // steps out of bounds stop at them, as with Sherpa's hard limits
+      for (std::size_t j=0; j<m; ++j) {
+	atry[j] = a[j] + da[j];
+	if (opt.lo && atry[j] < opt.lo[j])
+	  atry[j] = opt.lo[j];
+	if (opt.hi && atry[j] > opt.hi[j])
+	  atry[j] = opt.hi[j];
+      }
+
+      const double chisq = lm_coef(model, x, y, w, n, atry, alpha_try, beta_try);
+      ++r.nfev;
+
+      // NaN compares false and is rejected along with any uphill step
+      if (chisq < r.chisq) {
+	const double decrease = r.chisq - chisq;
+	lambda *= 0.1;
+	r.chisq = chisq;
+	std::copy(atry, atry+m, a);
+	std::copy(alpha_try, alpha_try+m*m, alpha);
+	std::copy(beta_try, beta_try+m, beta);
+	if (decrease <= opt.eps * std::max(1., chisq)) {
+	  r.converged = true;
+	  break;
+	}
+      }
+      else {
+	lambda *= 10;
+	// no downhill direction left, we're at the minimum
+	if (lambda > 1e10) {
+	  r.converged = true;
+	  break;
+	}
+      }
+    }
+
+    r.seconds = std::chrono::duration<double>(clock::now() - start).count();
+    return r;
+  }
+
+  template <class Model>
+    lm_result lmfit(const Model& model,
+		    const double* x, const double* y, std::size_t n,
+		    double* a, const lm_options& opt = lm_options())
+  {
+    return lmfit(model, x, y, 0, n, a, opt);
+  }
+
+  // genstats.pl initial guesses: (norm, 15, median) for a single
+  // normal, (norm/5, 50, median/2, norm, 15, median) for two
+  void gauss_init(double norm, double median, bool twogauss, double* a);
+
+  // Sherpa's chi gehrels weights, 1/sigma^2 with sigma = 1 +
+  // sqrt(y + 0.75), of n counts y
+  void gehrels_weights(const double* y, std::size_t n, double* w);
+
+  // The ngauss1d[g1]+ngauss1d[g2] fit the fit_hists scripts had Sherpa
+  // do of a histogram y[nbins] at bins 0..nbins-1: chi gehrels, with
+  // the first and last bins ignored, widths and amplitudes positive,
+  // peaks within the data and g1.ampl at most g1_ampl_max. a holds the
+  // initial (fwhm, pos, ampl) of g1 then g2 and receives the fit.
+  lm_result ngauss_fit(const double* y, std::size_t nbins, double* a,
+		       double g1_ampl_max, arena& scratch);
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef LMMODELS_HH
+#define LMMODELS_HH
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace lab {
+
+  // Models for lmfit and lmfit_batch. Each is a functor with a static
+  // npar and an operator()(x, a, dyda) which returns the model at x
+  // for parameters a[npar] and fills dyda[npar] with its analytic
+  // partial derivatives, value and Jacobian row coming from the one
+  // call. Being template arguments of the fitters rather than
+  // objects called through a pointer, models are inlined into the
+  // fitting loops and compound models cost no more than the sum of
+  // their terms.
+
+  const double sqrt_2pi = 2.5066282746310002;
+
+  // exp(x) to within a few units in the last place, written with
+  // only arithmetic and bit operations so that loops calling it, such
+  // as those of lmfit_batch, can be vectorized; std::exp cannot be
+  // without -ffast-math. Below -708 the result is 0 rather than
+  // denormal.
+  inline double lm_exp(double x)
+  {
+    const double log2e = 1.4426950408889634;
+    const double ln2hi = 0.693147180369123816490;
+    const double ln2lo = 1.90821492927058770002e-10;
+    const double round = 6755399441055744.0;  // 1.5 * 2^52
+
+    const double xc = x < -708 ? -708 : x > 709 ? 709 : x;
+
+    // x = k ln2 + r, |r| <= ln2 / 2, with k rounded by adding and
+    // subtracting 1.5 * 2^52, which leaves it in the low bits of kr
+    const double kr = xc * log2e + round;
+    const double k = kr - round;
+    const double r = xc - k * ln2hi - k * ln2lo;
+
+    // Taylor series of exp(r), to r^13 / 13!
+    double p = 1 / 6227020800.;
+    p = p * r + 1 / 479001600.;
+    p = p * r + 1 / 39916800.;
+    p = p * r + 1 / 3628800.;
+    p = p * r + 1 / 362880.;
+    p = p * r + 1 / 40320.;
+    p = p * r + 1 / 5040.;
+    p = p * r + 1 / 720.;
+    p = p * r + 1 / 120.;
+    p = p * r + 1 / 24.;
+    p = p * r + 1 / 6.;
+    p = p * r + 0.5;
+    p = p * r + 1;
+    p = p * r + 1;
+
+    // times 2^k, made directly in the exponent bits, unsigned so that
+    // the bits of kr's own exponent are shifted out without overflow
+    std::uint64_t bits;
+    std::memcpy(&bits, &kr, sizeof bits);
+    bits = (bits + 1023) << 52;
+    double scale;
+    std::memcpy(&scale, &bits, sizeof scale);
+
+    return x < -708 ? 0. : p * scale;
+  }
+
+  // norm, sigma, mean
+  struct one_normal {
+    static const std::size_t npar = 3;
+
+    double operator()(double x, const double* a, double* dyda) const
+    {
+      const double n = a[0], s = a[1], u = a[2];
+      const double z = (x - u) / s;
+      const double e = lm_exp(-0.5 * z * z) / s / sqrt_2pi;
+
+      dyda[0] = e;                           // partial wrt norm
+      dyda[1] = n / s * e * (z * z - 1);     // partial wrt sigma
+      dyda[2] = (x - u) * n / s / s * e;     // partial wrt mean
+
+      return n * e;
+    }
+  };
+
+
+  // Sherpa's ngauss1d, a normal distribution of area ampl: fwhm, pos,
+  // ampl
+  struct ngauss1d {
+    static const std::size_t npar = 3;
+
+    double operator()(double x, const double* a, double* dyda) const
+    {
+      const double c = 2.7725887222397811;    // 4 ln 2
+      const double k = 0.93943727869965132;   // sqrt(4 ln 2 / pi)
+      const double w = a[0], p = a[1], A = a[2];
+      const double z = (x - p) / w;
+      const double e = k / w * lm_exp(-c * z * z);
+
+      dyda[0] = A * e / w * (2 * c * z * z - 1); // partial wrt fwhm
+      dyda[1] = A * e * 2 * c * z / w;           // partial wrt pos
+      dyda[2] = e;                               // partial wrt ampl
+
+      return A * e;
+    }
+  };
+
+  // norm, sigma, mean, k: a normal distribution whose low-energy
+  // side turns, k sigma below the mean, into an exponential tail
+  // falling off with slope k / sigma, the value and first derivative
+  // being continuous where it does. norm is the area of the normal
+  // part; the tail adds norm exp(-k^2/2) / (k sqrt(2 pi)), the excess
+  // low_e_stats.pl measures from the residuals of a normal fit. Large
+  // k leaves one_normal.
+  struct gauss_tail {
+    static const std::size_t npar = 4;
+
+    double operator()(double x, const double* a, double* dyda) const
+    {
+      const double n = a[0], s = a[1], u = a[2], k = a[3];
+      const double z = (x - u) / s;
+
+      // one exponential for either side, so that the branch is a
+      // select
+      const bool tail = z < -k;
+      const double e = lm_exp(tail ? k * (0.5 * k + z) : -0.5 * z * z) / s / sqrt_2pi;
+      const double f = n * e;
+
+      dyda[0] = e;                                     // partial wrt norm
+      dyda[1] = tail ? -f * (1 + k * z) / s :          // partial wrt sigma
+	f / s * (z * z - 1);
+      dyda[2] = tail ? -f * k / s : f * z / s;         // partial wrt mean
+      dyda[3] = tail ? f * (k + z) : 0.;               // partial wrt k
+
+      return f;
+    }
+  };
+
+  // The sum of models, each with its own parameters, which follow one
+  // another in the order given. Composed at compile time, so the value
+  // and partials of every term come from one inlined call with no
+  // dispatch through pointers, e.g.,
+  //
+  //   model_sum<one_normal, gauss_tail>
+  //
+  // for a second component with a low-energy tail.
+  template <class... Models>
+  struct model_sum;
+
+  template <class Model>
+  struct model_sum<Model> {
+    static const std::size_t npar = Model::npar;
+
+    double operator()(double x, const double* a, double* dyda) const
+    {
+      return Model()(x, a, dyda);
+    }
+  };
+
+  template <class Model, class... Rest>
+  struct model_sum<Model, Rest...> {
+    static const std::size_t npar = Model::npar + model_sum<Rest...>::npar;
+
+    double operator()(double x, const double* a, double* dyda) const
+    {
+      return Model()(x, a, dyda) +
+	model_sum<Rest...>()(x, a+Model::npar, dyda+Model::npar);
+    }
+  };
+
+  // norm1, sigma1, mean1, norm2, sigma2, mean2
+  struct two_normals : model_sum<one_normal, one_normal> { };
+
+  // ngauss1d[g1] + ngauss1d[g2], as in fit_hists.pl
+  struct two_ngauss1d : model_sum<ngauss1d, ngauss1d> { };
+
+  // two_normals with a low-energy tail on the second, main, component:
+  // norm1, sigma1, mean1, norm2, sigma2, mean2, k2
+  struct normal_gauss_tail : model_sum<one_normal, gauss_tail> { };
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,300 @@
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <iostream>
+#include <memory>
+#include <cpputil/ss_cast.hh>
+#include "lab.hh"
+#include "subtap.hh"
+#include "count_cube.hh"
+#include "pyramid.hh"
+#include "cache.hh"
+
+using std::cout;
+using std::cerr;
+using std::vector;
+using std::string;
+
+namespace {
+
+  namespace opts {
+    string type = "samp";
+    int subtaps = lab::subtaps;
+    long rawy_lo = -1, rawy_hi = -1;
+    int update = 0;
+    int verbose = 0;
+
+    const char* version_string = "0.1";
+    int help = 0;
+    int version = 0;
+    option lopts[] = {
+      { "help",    no_argument, &help, 1 },
+      { "version", no_argument, &version, 1 },
+      { "verbose", no_argument, &verbose, 1 },
+      { "update",  no_argument, &update, 1 },
+      { "type",    required_argument, 0, 'T' },
+      { "subtaps", required_argument, 0, 's' },
+      { "rawy",    required_argument, 0, 'y' },
+      { 0, 0, 0, 0 }
+    };
+  }
+
+  // a BIN file and the rawy range in effect for it
+  struct source {
+    string file;
+    long rawy_lo, rawy_hi;
+  };
+
+  void parse_rawy(const string& s, long& lo, long& hi);
+  string source_tag(const vector<source>& sources);
+
+  int help();
+  int version();
+}
+
+int main(int argc, char** argv) {
+
+  // --rawy applies to the BIN files after it, so arguments are taken
+  // in order rather than permuted
+  vector<string> args;
+  vector<source> sources;
+
+  int c;
+  while ((c=getopt_long_only(argc, argv, "-", opts::lopts, 0))!=-1) {
+    switch (c) {
+    // a flag was set/unset on our behalf, nothing more to do
+    case 0:
+      break;
+    // cube file or BIN file
+    case 1:
+      if (args.size()) {
+	source s = { optarg, opts::rawy_lo, opts::rawy_hi };
+	sources.push_back(s);
+      }
+      args.push_back(optarg);
+      break;
+    case 'T':
+      opts::type = optarg;
+      break;
+    case 's':
+      opts::subtaps = util::ss_cast<int>(optarg);
+      break;
+    case 'y':
+      try {
+	parse_rawy(optarg, opts::rawy_lo, opts::rawy_hi);
+      }
+      catch (std::exception& e) {
+	cerr << argv[0] << ": " << e.what() << '\n';
+	return EXIT_FAILURE;
+      }
+      break;
+    // problem occurred
+    case '?':
+    case ':':
+      cerr << "Try `--help' for more information.\n";
+      return EXIT_FAILURE;
+    // didn't handle all of our specified options
+    default:
+      cerr << "programmer error, unhandled option = "; cerr.put(c); cerr << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opts::help) return help();
+  if (opts::version) return version();
+
+  if (args.size() < 2) {
+    cerr << "Usage: " << argv[0] << " [options] cubefile [--rawy=lo:hi] binfile...\n";
+    return EXIT_FAILURE;
+  }
+
+  try {
+    const string& cubefile = args[0];
+    const string tag = source_tag(sources);
+
+    string old;
+    if (opts::update && lab::cube_tag(cubefile, old) && old == tag) {
+      if (opts::verbose)
+	cerr << cubefile << " is current\n";
+      return 0;
+    }
+
+    const std::size_t nx = lab::nrawx / lab::tapsize * opts::subtaps;
+    const std::size_t ny = lab::nrawy / lab::tapsize * opts::subtaps;
+    std::unique_ptr<lab::count_cube>
+      cube(new lab::count_cube(lab::nbins(opts::type), nx, ny));
+
+    for (vector<source>::size_type i=0; i<sources.size(); ++i) {
+      const source& s = sources[i];
+      if (opts::verbose)
+	cerr << "reading " << s.file << '\n';
+      lab::add_binfile(*cube, s.file, s.rawy_lo, s.rawy_hi, opts::subtaps);
+    }
+
+    lab::hist_pyramid pyramid(std::move(cube), opts::subtaps);
+    lab::save_cube(cubefile, pyramid, tag);
+
+    if (opts::verbose)
+      cerr << "wrote " << cubefile << ", "
+	   << pyramid.level(lab::hist_pyramid::subtap_level).bytes()
+	   << " bytes of subtap counts\n";
+  }
+  catch (std::exception& e) {
+    cerr << argv[0] << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+}
+
+namespace {
+
+  // lo:hi, or all for no range
+  void parse_rawy(const string& s, long& lo, long& hi)
+  {
+    if (s == "all") {
+      lo = hi = -1;
+      return;
+    }
+    const string::size_type colon = s.find(':');
+    if (colon == string::npos)
+      throw std::invalid_argument("--rawy must be lo:hi");
+    lo = util::ss_cast<long>(s.substr(0, colon));
+    hi = util::ss_cast<long>(s.substr(colon+1));
+    if (lo < 0 || hi < lo)
+      throw std::invalid_argument("invalid --rawy range " + s);
+  }
+
+  // what the cube was made from: the options which shape it, then
+  // each BIN file with its rawy range and identity (name, size and
+  // modification time), one per line, so that a cube made from the
+  // same, unchanged inputs has the same tag
+  string source_tag(const vector<source>& sources)
+  {
+    string tag = "type=" + opts::type
+      + " subtaps=" + util::ss_cast<string>(opts::subtaps) + '\n';
+    for (vector<source>::size_type i=0; i<sources.size(); ++i) {
+      const source& s = sources[i];
+      tag += s.file
+	+ '\t' + util::ss_cast<string>(s.rawy_lo) + ':' + util::ss_cast<string>(s.rawy_hi)
+	+ '\t' + lab::digest().add_file(s.file).hex() + '\n';
+    }
+    return tag;
+  }
+
+  int version() {
+    cout << opts::version_string << '\n';
+    return 0;
+  }
+
+  int help() {
+    const char* help_text = "\
+=head1 NAME\n\
+\n\
+mkcube - save the subtap histograms of BIN files as a cube file\n\
+\n\
+=head1 SYNOPSIS\n\
+\n\
+mkcube [options] cubefile [--rawy=lo:hi] binfile...\n\
+\n\
+=head1 DESCRIPTION\n\
+\n\
+Sums the subtap histograms of one or more BIN files, as\n\
+Lab::add_to_hists does, and writes them to I<cubefile> along with the\n\
+same histograms summed per tap, per chip and over the whole detector.\n\
+The coarser levels are built in a single pass over the subtap\n\
+histograms, so that plots of tap, chip or detector distributions need\n\
+not sum a full cube each time they are made; read any level with\n\
+Lab::read_cube.\n\
+\n\
+Counts are stored with as few bits per histogram as they need, so a\n\
+cube file is typically a small fraction of the size of the float cube\n\
+Lab::zero_hists would hold in memory. The file also records the\n\
+options it was made with and the name, rawy range, size and\n\
+modification time of each BIN file, so that with I<--update> a cube\n\
+is only made again when one of its BIN files has changed. Lab.pm\n\
+keeps cubes of every anode and of the background this way in\n\
+$Lab::CUBEDIR, see Lab::stored_hists.\n\
+\n\
+=head1 OPTIONS\n\
+\n\
+=over 4\n\
+\n\
+=item --help\n\
+\n\
+Print this help text and exit.\n\
+\n\
+=item --version\n\
+\n\
+Print the program version and exit.\n\
+\n\
+=item --type=s\n\
+\n\
+Histogram type of the BIN files, one of pha, samp, spimean or spimed.\n\
+The default is samp, as for $Lab::TYPE.\n\
+\n\
+=item --subtaps=i\n\
+\n\
+Number of subtaps along each axis of a tap in the BIN files. The\n\
+default is 3.\n\
+\n\
+=item --rawy=lo:hi\n\
+\n\
+Only add subtaps of the BIN files which follow lying entirely within\n\
+this rawy range, e.g., those of Lab::rawy_limits_mcp for the MCP of\n\
+each test. --rawy=all adds every subtap, as is the default.\n\
+\n\
+=item --update\n\
+\n\
+Leave I<cubefile> as it is if it was made from the same BIN files, as\n\
+they are now, with the same options.\n\
+\n\
+=item --verbose\n\
+\n\
+Report progress on stderr.\n\
+\n\
+=back\n\
+\n\
+=head1 AUTHOR\n\
+\n\
+Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt>\n\
+\n\
+=head1 SEE ALSO\n\
+\n\
+Lab.pm\n\
+\n\
+=cut\n\
+";
+
+    const char* pager = std::getenv("PAGER");
+    if (!pager) pager = "more";
+
+    FILE* pd = popen((std::string("pod2text -c | ")+pager).c_str(), "w");
+    if (!pd) {
+      std::perror("error starting pod2text");
+      return EXIT_FAILURE;
+    }
+
+    int n = 0;
+    int len = std::strlen(help_text);
+    while (n < len) {
+      int written = std::fwrite(help_text, 1, len-n, pd);
+      if (!written) {
+	std::perror("error writing help");
+	return EXIT_FAILURE;
+      }
+      n+=written;
+    }
+
+    if (pclose(pd) == -1) {
+      std::perror("error writing help");
+      return EXIT_FAILURE;
+    }
+
+    return 0;
+  }
+
+}
@@ -0,0 +1,146 @@
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include "pyramid.hh"
+#include "subtap.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::string;
+  using std::uint32_t;
+
+  namespace {
+
+    const char magic[] = "hrcs_gain cube 1\n";
+    const uint32_t byte_order = 0x01020304;
+
+    const size_t nchips = 3;
+
+    // sum the histograms of fine into coarse, histogram (gx, gy) of
+    // fine going to (gx / fx, gy / fy)
+    void sum_into(const count_cube& fine, count_cube& coarse, size_t fx, size_t fy)
+    {
+      std::vector<uint32_t> y(fine.nbins());
+      for (size_t gy=0; gy<fine.ny(); ++gy)
+	for (size_t gx=0; gx<fine.nx(); ++gx) {
+	  const size_t h = gy * fine.nx() + gx;
+	  if (!fine.width(h))
+	    continue;
+	  fine.hist(h, y.data());
+	  coarse.add((gy / fy) * coarse.nx() + gx / fx, y.data());
+	}
+    }
+
+    void read_word(std::istream& in, uint32_t& w)
+    {
+      if (!in.read(reinterpret_cast<char*>(&w), sizeof(w)))
+	throw std::runtime_error("truncated cube file");
+    }
+
+    // the header of a cube file up to the pyramid, false if it is not one
+    bool read_header(std::istream& in, string& tag)
+    {
+      char buf[sizeof(magic)-1];
+      if (!in.read(buf, sizeof(buf)) || string(buf, sizeof(buf)) != magic)
+	return false;
+
+      uint32_t len, order;
+      read_word(in, len);
+      tag.resize(len);
+      if (len && !in.read(&tag[0], len))
+	throw std::runtime_error("truncated cube file");
+
+      read_word(in, order);
+      if (order != byte_order)
+	throw std::runtime_error("cube file written on a host of other byte order");
+      return true;
+    }
+
+  }
+
+  hist_pyramid::hist_pyramid(std::unique_ptr<count_cube> base, size_t subtaps)
+  {
+    const count_cube& c = *base;
+    if (c.nx() % subtaps || c.ny() % (subtaps * nchips))
+      throw std::invalid_argument("cube is not whole taps and chips");
+
+    const size_t ntx = c.nx() / subtaps, nty = c.ny() / subtaps;
+    levels[tap_level].reset(new count_cube(c.nbins(), ntx, nty, 16));
+    levels[chip_level].reset(new count_cube(c.nbins(), 1, nchips, 16));
+    levels[detector_level].reset(new count_cube(c.nbins(), 1, 1, 16));
+
+    // one pass over the subtaps, the rest over far fewer histograms
+    sum_into(c, *levels[tap_level], subtaps, subtaps);
+    sum_into(*levels[tap_level], *levels[chip_level], ntx, nty / nchips);
+    sum_into(*levels[chip_level], *levels[detector_level], 1, nchips);
+
+    levels[subtap_level] = std::move(base);
+  }
+
+  hist_pyramid::hist_pyramid(std::istream& in)
+  {
+    uint32_t n;
+    read_word(in, n);
+    if (n != nlevels)
+      throw std::runtime_error("corrupt cube file");
+    for (int l=0; l<nlevels; ++l)
+      levels[l].reset(new count_cube(in));
+  }
+
+  void hist_pyramid::write(std::ostream& out) const
+  {
+    const uint32_t n = nlevels;
+    out.write(reinterpret_cast<const char*>(&n), sizeof(n));
+    for (int l=0; l<nlevels; ++l)
+      levels[l]->write(out);
+  }
+
+  void save_cube(const string& file, const hist_pyramid& p, const string& tag)
+  {
+    const string tmp = file + ".tmp";
+    std::ofstream out(tmp.c_str(), std::ios_base::binary);
+
+    const uint32_t len = tag.size();
+    out.write(magic, sizeof(magic)-1);
+    out.write(reinterpret_cast<const char*>(&len), sizeof(len));
+    out.write(tag.data(), len);
+    out.write(reinterpret_cast<const char*>(&byte_order), sizeof(byte_order));
+    p.write(out);
+    out.close();
+
+    if (!out || std::rename(tmp.c_str(), file.c_str())) {
+      std::remove(tmp.c_str());
+      throw std::runtime_error("error writing " + file);
+    }
+  }
+
+  bool cube_tag(const string& file, string& tag)
+  {
+    std::ifstream in(file.c_str(), std::ios_base::binary);
+    try {
+      return in && read_header(in, tag);
+    }
+    catch (std::runtime_error&) {
+      return false;
+    }
+  }
+
+  std::unique_ptr<hist_pyramid> load_cube(const string& file, string& tag)
+  {
+    std::ifstream in(file.c_str(), std::ios_base::binary);
+    if (!in)
+      throw std::runtime_error("could not open " + file);
+    if (!read_header(in, tag))
+      throw std::runtime_error(file + " is not a cube file");
+    try {
+      return std::unique_ptr<hist_pyramid>(new hist_pyramid(in));
+    }
+    catch (std::runtime_error& e) {
+      throw std::runtime_error(file + ": " + e.what());
+    }
+  }
+
+} // namespace lab
@@ -0,0 +1,80 @@
+#ifndef PYRAMID_HH
+#define PYRAMID_HH
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <iosfwd>
+#include "count_cube.hh"
+
+namespace lab {
+
+  // The histograms of a subtap cube summed at every scale our analyses
+  // look at: per subtap (genstats), per tap (--bgfulltap), per chip
+  // (rawy_limits_chipid) and over the whole detector (the
+  // *_dists_at_strongest_median plots). The coarser levels are built
+  // in one pass over the subtap cube, after which the histogram of any
+  // subtap, tap, chip or the detector is a copy of nbins counts.
+  //
+  // Level l is a count_cube of its own, with histogram gy * nx + gx:
+  // subtap_level is the cube given, tap_level has one histogram per
+  // tap, chip_level one per chip (nx = 1, ny = 3, in rawy order) and
+  // detector_level a single one.
+  class hist_pyramid {
+  public:
+
+    enum { subtap_level, tap_level, chip_level, detector_level, nlevels };
+
+  private:
+    std::unique_ptr<count_cube> levels[nlevels];
+
+    hist_pyramid(const hist_pyramid&);
+    hist_pyramid& operator=(const hist_pyramid&);
+
+  public:
+
+    // build the coarser levels of base, which has subtaps subtaps to
+    // a tap along each axis
+    explicit hist_pyramid(std::unique_ptr<count_cube> base,
+			  std::size_t subtaps = lab::subtaps);
+
+    // a pyramid as written by write()
+    explicit hist_pyramid(std::istream& in);
+
+    const count_cube& level(int l) const { return *levels[l]; }
+
+    // histogram (gx, gy) of level l into out[nbins]
+    template <class T>
+      void hist(int l, std::size_t gx, std::size_t gy, T* out) const
+    {
+      const count_cube& c = *levels[l];
+      c.hist(gy * c.nx() + gx, out);
+    }
+
+    // the levels from finest to coarsest, c.f. count_cube::write
+    void write(std::ostream& out) const;
+  };
+
+  // Cube files hold a pyramid along with a tag identifying what it was
+  // made from (see mkcube), as
+  //
+  //   "hrcs_gain cube 1\n"
+  //   32 bit tag length, the tag
+  //   32 bit 0x01020304, to reject files from hosts of other byte order
+  //   hist_pyramid::write()
+  //
+  // save_cube() writes aside and renames, so that readers never see a
+  // partial file.
+  void save_cube(const std::string& file, const hist_pyramid& p,
+		 const std::string& tag);
+
+  // the tag of a cube file without reading the rest, false if file
+  // cannot be read or is not a cube file
+  bool cube_tag(const std::string& file, std::string& tag);
+
+  std::unique_ptr<hist_pyramid> load_cube(const std::string& file,
+					  std::string& tag);
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include "spatial.hh"
+#include "arena.hh"
+#include "hists.h"
+
+namespace lab {
+
+  using std::size_t;
+  using std::string;
+
+  namespace {
+
+    // box sums along a line of n histograms, the i-th at p + i*stride
+    template <class T>
+      void box_line(T* p, size_t nbins, size_t n, size_t stride, size_t w)
+    {
+      static thread_local arena scratch;
+      scratch.reset();
+
+      T* line = scratch.alloc<T>(n * nbins);
+      double* sum = scratch.alloc<double>(nbins);
+      for (size_t i=0; i<n; ++i)
+	std::copy(p + i*stride, p + i*stride + nbins, line + i*nbins);
+      std::fill(sum, sum+nbins, 0.);
+
+      const size_t before = w / 2, after = (w-1) / 2;
+      for (size_t j=0; j<std::min(after, n); ++j)
+	for (size_t k=0; k<nbins; ++k)
+	  sum[k] += line[j*nbins + k];
+
+      for (size_t i=0; i<n; ++i) {
+	if (i + after < n) {
+	  const T* in = line + (i+after) * nbins;
+	  for (size_t k=0; k<nbins; ++k)
+	    sum[k] += in[k];
+	}
+	T* out = p + i*stride;
+	for (size_t k=0; k<nbins; ++k)
+	  out[k] = static_cast<T>(sum[k]);
+	if (i >= before) {
+	  const T* in = line + (i-before) * nbins;
+	  for (size_t k=0; k<nbins; ++k)
+	    sum[k] -= in[k];
+	}
+      }
+    }
+
+  }
+
+  template <class T>
+    void box_filter(thread_pool& pool, T* cube, size_t nbins,
+		    size_t nx, size_t ny, size_t wx, size_t wy)
+  {
+    if (wx > 1)
+      parallel_for(pool, ny, [=](size_t gy) {
+	  box_line(cube + gy*nx*nbins, nbins, nx, nbins, wx);
+	});
+    if (wy > 1)
+      parallel_for(pool, nx, [=](size_t gx) {
+	  box_line(cube + gx*nbins, nbins, ny, nx*nbins, wy);
+	});
+  }
+
+  template void box_filter(thread_pool&, int*, size_t, size_t, size_t, size_t, size_t);
+  template void box_filter(thread_pool&, long*, size_t, size_t, size_t, size_t, size_t);
+  template void box_filter(thread_pool&, float*, size_t, size_t, size_t, size_t, size_t);
+  template void box_filter(thread_pool&, double*, size_t, size_t, size_t, size_t, size_t);
+
+  void parse_subtap_range(const string& s, size_t subtaps, long& lo, long& hi)
+  {
+    long g[2];
+    const char* p = s.c_str();
+    for (int i=0; i<2; ++i) {
+      char* end;
+      const long tap = std::strtol(p, &end, 10);
+      const long sub = *end - 'a';
+      if (end == p || tap < 0 || sub < 0 || sub >= long(subtaps)
+	  || (i == 0 ? end[1] != ':' : end[1] != '\0'))
+	throw std::runtime_error("invalid subtap range '" + s + "'");
+      g[i] = tap * subtaps + sub;
+      p = end + 2;
+    }
+    lo = g[0];
+    hi = g[1];
+  }
+
+  subtap_mask::subtap_mask(const subtap_grid& grid)
+    : nsub(grid.subtaps()), nxsub(grid.nx()), nysub(grid.ny()),
+      m(nxsub * nysub, 0)
+  { }
+
+  void subtap_mask::add(const string& u, const string& v)
+  {
+    long x1, x2, y1, y2;
+    parse_subtap_range(u, nsub, x1, x2);
+    parse_subtap_range(v, nsub, y1, y2);
+    if (x2 >= long(nxsub) || y2 >= long(nysub))
+      throw std::runtime_error("subtap range " + u + ", " + v + " is off the detector");
+    for (long gy=y1; gy<=y2; ++gy)
+      for (long gx=x1; gx<=x2; ++gx)
+	m[gy * nxsub + gx] = 1;
+  }
+
+  void subtap_mask::invert()
+  {
+    for (size_t i=0; i<m.size(); ++i)
+      m[i] = !m[i];
+  }
+
+  namespace {
+
+    /*
+      chip	crsu	crsv		no iffy crsv
+      ----	----	----		------------
+      1		4b:13b	6b:63c		6b:63c
+      2		4c:13b	66b:125c	66b:125b
+      3		5b:13b	128b:186a	129a:186a
+
+      BG	2b:13b	see above	see above
+    */
+    const char* usrc[] = { "4b:13b", "4c:13b", "5b:13b" };
+    const char* ubg[] = { "2b:13b", "2b:13b", "2b:13b" };
+    const char* viffy[] = { "6b:63c", "66b:125c", "128b:186a" };
+    const char* vnoiffy[] = { "6b:63c", "66b:125b", "129a:186a" };
+
+    subtap_mask active_mask(const subtap_grid& grid, const char** u, const char** v)
+    {
+      subtap_mask mask(grid);
+      for (int i=0; i<3; ++i)
+	mask.add(u[i], v[i]);
+      return mask;
+    }
+
+  }
+
+  subtap_mask active_mask_src(const subtap_grid& grid, bool iffy)
+  {
+    return active_mask(grid, usrc, iffy ? viffy : vnoiffy);
+  }
+
+  subtap_mask active_mask_bg(const subtap_grid& grid, bool iffy)
+  {
+    return active_mask(grid, ubg, iffy ? viffy : vnoiffy);
+  }
+
+} // namespace lab
+
+namespace {
+
+  template <class T>
+    void c_box_filter(T* cube, long nbins, long nx, long ny, long wx, long wy)
+  {
+    lab::thread_pool pool;
+    lab::box_filter(pool, cube, nbins, nx, ny, wx, wy);
+  }
+
+}
+
+extern "C" {
+
+  void lab_box_filter_l(int* cube, long nbins, long nx, long ny, long wx, long wy)
+  { c_box_filter(cube, nbins, nx, ny, wx, wy); }
+  void lab_box_filter_f(float* cube, long nbins, long nx, long ny, long wx, long wy)
+  { c_box_filter(cube, nbins, nx, ny, wx, wy); }
+  void lab_box_filter_d(double* cube, long nbins, long nx, long ny, long wx, long wy)
+  { c_box_filter(cube, nbins, nx, ny, wx, wy); }
+
+}
@@ -0,0 +1,101 @@
+#ifndef SPATIAL_HH
+#define SPATIAL_HH
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "subtap.hh"
+#include "thread_pool.hh"
+
+namespace lab {
+
+  // Spatial operations on a histogram cube of nbins bins by nx by ny
+  // subtaps, i.e., a PDL of dims (nbins, nx, ny) as Lab.pm keeps them.
+  // Each works in place, and on whole histograms at a time so that the
+  // inner loops run over the contiguous bins.
+
+  // Replace every histogram with the sum of those in the wx by wy box
+  // of subtaps around it, boxes being clipped at the edges of the
+  // cube, i.e., conv2d() with a ones(wx, wy) kernel and Truncate
+  // boundaries over each bin, c.f. Lab::three_by_three. The box about
+  // subtap i along an axis is [i - w/2, i + (w-1)/2]. Done as two
+  // running sums, so the cost does not depend on the box size.
+  // Counts may be int, long, float or double.
+  template <class T>
+    void box_filter(thread_pool& pool, T* cube, std::size_t nbins,
+		    std::size_t nx, std::size_t ny, std::size_t wx, std::size_t wy);
+
+  // A range of subtaps along one axis in Brad's notation, e.g.,
+  // "4b:13b" for subtap b of tap 4 through subtap b of tap 13, as
+  // global subtaps lo and hi, c.f. Lab::bradto2d. Throws
+  // std::runtime_error on anything else.
+  void parse_subtap_range(const std::string& s, std::size_t subtaps,
+			  long& lo, long& hi);
+
+  // A selection of the subtaps of a grid, indexed by gy * nx + gx.
+  class subtap_mask {
+  private:
+    std::size_t nsub, nxsub, nysub;
+    std::vector<unsigned char> m;
+
+  public:
+
+    explicit subtap_mask(const subtap_grid& grid);
+
+    std::size_t nx() const { return nxsub; }
+    std::size_t ny() const { return nysub; }
+
+    bool operator()(std::size_t gx, std::size_t gy) const
+    { return m[gy * nxsub + gx]; }
+
+    // add the subtaps in ranges u (along x) and v (along y), e.g.,
+    // add("4b:13b", "6b:63c"), c.f. Lab::active_mask_uv
+    void add(const std::string& u, const std::string& v);
+
+    void invert();
+  };
+
+  // Subtaps of the three chips which see the lab source, or the
+  // background, optionally leaving out the iffy rows of crsv, as
+  // Lab::active_mask_src and friends.
+  subtap_mask active_mask_src(const subtap_grid& grid, bool iffy = true);
+  subtap_mask active_mask_bg(const subtap_grid& grid, bool iffy = true);
+
+  // The histograms of a cube at the subtaps of a mask, in place of
+  // Lab::hists_indexND: nothing is copied, h[k] points into the cube.
+  template <class T>
+    class masked_hists {
+    private:
+      T* cube;
+      std::size_t nbins;
+      std::vector<std::size_t> sel;   // gy * nx + gx of each
+
+    public:
+
+      masked_hists(T* c, std::size_t n, const subtap_mask& mask)
+	: cube(c), nbins(n)
+      {
+	for (std::size_t gy=0; gy<mask.ny(); ++gy)
+	  for (std::size_t gx=0; gx<mask.nx(); ++gx)
+	    if (mask(gx, gy))
+	      sel.push_back(gy * mask.nx() + gx);
+      }
+
+      std::size_t size() const { return sel.size(); }
+      T* operator[](std::size_t k) const { return cube + sel[k] * nbins; }
+
+      // set every bin of every selected histogram to v, e.g., to zero
+      // the subtaps outside the active area with an inverted mask
+      void fill(thread_pool& pool, T v)
+      {
+	parallel_for(pool, sel.size(), [=](std::size_t k) {
+	    T* h = (*this)[k];
+	    for (std::size_t i=0; i<nbins; ++i)
+	      h[i] = v;
+	  });
+      }
+    };
+
+} // namespace lab
+
+#endif
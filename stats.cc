@@ -0,0 +1,169 @@
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include "stats.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::vector;
+
+  double quantile(const vector<double>& data, double f)
+  {
+    return quantile(data.empty() ? 0 : &data[0], data.size(), f);
+  }
+
+  double quantile(const double* data, size_t n, double f)
+  {
+    const long i = long(std::rint((n-1) * f));
+    const double delta = (n-1) * f - i;
+    const double ii = size_t(i+1) < n ? data[i+1] : data[i];
+    return (1-delta) * data[i] + delta * ii;
+  }
+
+  void data_stats(vector<double>& vals, double trim, col_stats& s)
+  {
+    data_stats(vals.empty() ? 0 : &vals[0], vals.size(), trim, s);
+  }
+
+  void data_stats(double* vals, size_t n, double trim, col_stats& s)
+  {
+    s = col_stats();
+    if (!n)
+      return;
+
+    std::sort(vals, vals+n);
+
+    s.mean = std::accumulate(vals, vals+n, 0.) / n;
+
+    double ss = 0;
+    for (size_t i=0; i<n; ++i)
+      ss += (vals[i] - s.mean) * (vals[i] - s.mean);
+    s.rms = std::sqrt(ss / (n-1.));
+
+    s.median = n % 2 ? vals[n/2] : 0.5 * (vals[n/2-1] + vals[n/2]);
+
+    const size_t i = size_t(trim * n);
+    s.tmean = std::accumulate(vals+i, vals+n-i, 0.) / (n - 2*i);
+
+    if (n > 3)
+      s.iqr = quantile(vals, n, 0.75) - quantile(vals, n, 0.25);
+  }
+
+  void shift_negs(double* y, size_t n)
+  {
+    for (size_t i=0; i+1<n; ++i) {
+      if (y[i] < 0) {
+	y[i+1] += y[i];
+	y[i] = 0;
+      }
+    }
+  }
+
+  bool interpol(double xi, const double* x, const double* y, size_t n,
+		double& yi)
+  {
+    if (n < 2)
+      return false;
+
+    const size_t n1 = n-1;
+    const bool up = x[n1] > x[0];
+    bool extrapolated = false;
+
+    long jl = -1, jh = n;
+    while (jh-jl > 1) {
+      long m = (jh+jl) >> 1;
+      if ((xi > x[m]) == up)
+	jl = m;
+      else
+	jh = m;
+    }
+
+    if (jl == -1) {
+      if (xi != x[0])
+	extrapolated = true;
+      jl = 0;
+    }
+    else if (jh == long(n)) {
+      if (xi != x[n1])
+	extrapolated = true;
+      jl = n1-1;
+    }
+    jh = jl+1;
+
+    double d = x[jh] - x[jl];
+    if (d == 0 || extrapolated)
+      return false;
+
+    d = (x[jh] - xi) / d;
+    yi = d * y[jl] + (1-d) * y[jh];
+    return true;
+  }
+
+  void hist_stats(const double* y, size_t n, double trim, col_stats& s)
+  {
+    arena scratch;
+    hist_stats(y, n, trim, s, scratch);
+  }
+
+  void hist_stats(const double* y, size_t n, double trim, col_stats& s,
+		  arena& scratch)
+  {
+    s = col_stats();
+
+    const double y_sum = std::accumulate(y, y+n, 0.);
+    if (!(y_sum > 0))
+      return;
+
+    double xy = 0;
+    for (size_t i=0; i<n; ++i)
+      xy += i * y[i];
+    s.mean = xy / y_sum;
+
+    double* y_copy = scratch.alloc<double>(n);
+    std::copy(y, y+n, y_copy);
+    shift_negs(y_copy, n);
+
+    double w = 0, wd2 = 0;
+    for (size_t i=0; i<n; ++i) {
+      if (y_copy[i] >= 0) {
+	const double diff = i - s.mean;
+	w += y_copy[i];
+	wd2 += y_copy[i] * diff * diff;
+      }
+    }
+    s.rms = w <= 1 ? 0 : std::sqrt(wd2 / (w-1));
+
+    // cumulative distribution at the upper bin edges, quantiles stop
+    // at the first one PDL's interpol would croak on
+    double* cumu = scratch.alloc<double>(n);
+    double* bounds = scratch.alloc<double>(n);
+    double c = 0;
+    for (size_t i=0; i<n; ++i) {
+      c += y[i];
+      cumu[i] = c / y_sum;
+      bounds[i] = i + 0.5;
+    }
+
+    double uq = 0, lq = 0;
+    if (interpol(0.75, cumu, bounds, n, uq)
+	&& interpol(0.5, cumu, bounds, n, s.median))
+      interpol(0.25, cumu, bounds, n, lq);
+    s.iqr = uq - lq;
+
+    // c.f. Lab::hists_trim
+    const double trimmed_sum = std::accumulate(y_copy, y_copy+n, 0.);
+    double tw = 0, txy = 0;
+    c = 0;
+    for (size_t i=0; i<n; ++i) {
+      c += y_copy[i];
+      const double frac = c / trimmed_sum;
+      if (frac < trim || frac > 1-trim)
+	continue;
+      tw += y_copy[i];
+      txy += i * y_copy[i];
+    }
+    s.tmean = tw > 0 ? txy / tw : 0;
+  }
+
+} // namespace lab
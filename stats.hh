@@ -0,0 +1,48 @@
+#ifndef STATS_HH
+#define STATS_HH
+
+#include <cstddef>
+#include <vector>
+#include "arena.hh"
+
+namespace lab {
+
+  // per-column statistics reported by genstats
+  struct col_stats {
+    double mean, tmean, rms, median, iqr;
+    col_stats() : mean(0), tmean(0), rms(0), median(0), iqr(0) { }
+  };
+
+  // c.f. Lab::quantile, data must be sorted
+  double quantile(const std::vector<double>& sorted, double f);
+  double quantile(const double* sorted, std::size_t n, double f);
+
+  // Statistics of event values as genstats.pl computes them without
+  // background subtraction: PDL's stats (rms with n-1 normalization,
+  // median averaging the middle pair), Lab::trim and Lab::iqr. vals
+  // is sorted in place.
+  void data_stats(std::vector<double>& vals, double trim, col_stats& s);
+  void data_stats(double* vals, std::size_t n, double trim, col_stats& s);
+
+  // move negative counts into the next bin, c.f. genstats.pl's
+  // shift_negs
+  void shift_negs(double* y, std::size_t n);
+
+  // PDL's interpol: linear interpolation of yi at xi on the tabulated
+  // function (x, y). Returns false where PDL would croak, i.e., if xi
+  // has to be extrapolated or x has identical abscissas.
+  bool interpol(double xi, const double* x, const double* y, std::size_t n,
+		double& yi);
+
+  // Statistics of a histogram with bin centers 0 .. n-1 which may
+  // hold fractional or negative (background-subtracted) counts, c.f.
+  // hist_stats in genstats.pl.
+  void hist_stats(const double* y, std::size_t n, double trim, col_stats& s);
+
+  // the same, with its working storage taken from scratch
+  void hist_stats(const double* y, std::size_t n, double trim, col_stats& s,
+		  arena& scratch);
+
+} // namespace lab
+
+#endif
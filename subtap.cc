@@ -0,0 +1,137 @@
+#include <stdexcept>
+#include <algorithm>
+#include <utility>
+#include "lab.hh"
+#include "subtap.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::vector;
+
+  namespace {
+
+    // x's bits spread to the even bits of the result
+    std::uint64_t spread_bits(std::uint32_t x)
+    {
+      std::uint64_t r = 0;
+      for (int b=0; b<32; ++b)
+	r |= std::uint64_t((x >> b) & 1) << (2*b);
+      return r;
+    }
+
+  }
+
+  subtap_grid::subtap_grid(size_t subtaps, bool zorder)
+    : nsub(subtaps),
+      nxsub(nrawx / tapsize * subtaps),
+      nysub(nrawy / tapsize * subtaps)
+  {
+    if (!nsub || nsub > tapsize)
+      throw std::invalid_argument("invalid number of subtaps");
+
+    // The grid is not square, nor a power of two on a side, so the
+    // Z-order indices are the ranks of the subtaps' Morton codes,
+    // which keeps them dense.
+    if (zorder) {
+      vector< std::pair<std::uint64_t, std::uint32_t> > code(size());
+      for (size_t gy=0; gy<nysub; ++gy)
+	for (size_t gx=0; gx<nxsub; ++gx) {
+	  const size_t i = gy * nxsub + gx;
+	  code[i] = std::make_pair(spread_bits(gx) | spread_bits(gy) << 1, i);
+	}
+      std::sort(code.begin(), code.end());
+
+      zslot.resize(size());
+      for (size_t s=0; s<code.size(); ++s)
+	zslot[code[s].second] = s;
+    }
+
+    if (nsub == default_geometry::subtaps) {
+      xlut = default_geometry::xlut.data();
+      ylut = default_geometry::ylut.data();
+      return;
+    }
+
+    xbuf.resize(nrawx);
+    ybuf.resize(nrawy);
+    for (size_t i=0; i<ybuf.size(); ++i) {
+      ybuf[i] = (i / tapsize) * nsub + subtap_at(tapsize, nsub, i % tapsize);
+      if (i < xbuf.size())
+	xbuf[i] = ybuf[i];
+    }
+    xlut = &xbuf[0];
+    ylut = &ybuf[0];
+  }
+
+  void subtap_grid::offsets(long subtap, long& o1, long& o2) const
+  {
+    long s = subtap < 0 ? subtap + nsub : subtap;
+
+    o1 = subtap_offset(tapsize, nsub, s);
+    o2 = subtap_offset(tapsize, nsub, s+1) - 1;
+
+    if (subtap < 0) {
+      o1 -= tapsize;
+      o2 -= tapsize;
+    }
+  }
+
+  void subtap_grid::tap_range(long tap, long& c1, long& c2) const
+  {
+    c1 = tap * long(tapsize) + rawx_min; // rawx_min == rawy_min
+    c2 = c1 + tapsize - 1;
+  }
+
+  void subtap_grid::range(long tap, long subtap, long& c1, long& c2) const
+  {
+    long tc1, tc2, o1, o2;
+    tap_range(tap, tc1, tc2);
+    offsets(subtap, o1, o2);
+    c1 = tc1 + o1;
+    c2 = tc1 + o2;
+  }
+
+  void subtap_grid::index(const packed_event* evt, long* out, size_t n) const
+  {
+    for (size_t i=0; i<n; ++i) {
+      // negative coordinates wrap to large unsigned values
+      const unsigned long x = evt[i].rawx() - rawx_min, y = evt[i].rawy() - rawy_min;
+      const bool on = x < unsigned(nrawx) && y < unsigned(nrawy);
+      const long g = long(ylut[on ? y : 0]) * nxsub + xlut[on ? x : 0];
+      out[i] = on ? g : -1;
+    }
+
+    if (zorder())
+      for (size_t i=0; i<n; ++i)
+	if (out[i] >= 0)
+	  out[i] = zslot[out[i]];
+  }
+
+  void partition_events(const subtap_grid& grid,
+			const vector<packed_event>& evt,
+			partition& p)
+  {
+    const size_t n = evt.size();
+    const size_t nsubtaps = grid.size();
+
+    vector<long> index(n);
+    if (n)
+      grid.index(&evt[0], &index[0], n);
+
+    p.offset.assign(nsubtaps+1, 0);
+    for (size_t i=0; i<n; ++i)
+      if (index[i] >= 0)
+	++p.offset[index[i]+1];
+
+    for (size_t i=0; i<nsubtaps; ++i)
+      p.offset[i+1] += p.offset[i];
+
+    p.order.resize(p.offset[nsubtaps]);
+    vector<size_t> next(p.offset.begin(), p.offset.end()-1);
+    for (size_t i=0; i<n; ++i)
+      if (index[i] >= 0)
+	p.order[next[index[i]]++] = i;
+  }
+
+} // namespace lab
@@ -0,0 +1,229 @@
+#ifndef SUBTAP_HH
+#define SUBTAP_HH
+
+#include <cstddef>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "lab.hh"
+#include "evtfile.hh"
+
+namespace lab {
+
+  // number of raw coordinates along each axis
+  const long nrawx = 4096;
+  const long nrawy = 3 * 16384;
+
+  // rint(n/d) for n >= 0, d > 0, with rint's rounding of halves to even
+  constexpr long rint_div(long n, long d)
+  {
+    return 2*(n%d) > d || (2*(n%d) == d && (n/d)%2) ? n/d + 1 : n/d;
+  }
+
+  // first offset of subtap s (0 <= s <= subtaps) within a tap, c.f.
+  // subtap_offsets() in genstats.pl. For three subtaps of 256 this is
+  // the 85/86/85 split of addspi's rawto2d.
+  constexpr long subtap_offset(long tapsize, long subtaps, long s)
+  {
+    return rint_div(tapsize * s, subtaps);
+  }
+
+  // the subtap containing offset o of a tap
+  constexpr long subtap_at(long tapsize, long subtaps, long o)
+  {
+    long s = 0;
+    while (s+1 < subtaps && subtap_offset(tapsize, subtaps, s+1) <= o)
+      ++s;
+    return s;
+  }
+
+  template <class T, std::size_t N>
+    struct lookup_table {
+      T v[N];
+      constexpr T operator[](std::size_t i) const { return v[i]; }
+      constexpr const T* data() const { return v; }
+    };
+
+  // global subtap, tap*subtaps + subtap, of each of n raw coordinates
+  template <long TapSize, long Subtaps, std::size_t N>
+    constexpr lookup_table<std::uint16_t, N> make_subtap_lut()
+  {
+    lookup_table<std::uint16_t, N> t = { };
+    for (std::size_t i=0; i<N; ++i)
+      t.v[i] = (i / TapSize) * Subtaps + subtap_at(TapSize, Subtaps, i % TapSize);
+    return t;
+  }
+
+  // Subtap geometry fixed at compile time, with the raw to subtap
+  // lookup tables built by the compiler.
+  template <long TapSize, long Subtaps>
+    struct subtap_geometry {
+      static_assert(Subtaps > 0 && Subtaps <= TapSize, "invalid number of subtaps");
+      static_assert(nrawx % TapSize == 0 && nrawy % TapSize == 0, "invalid tap size");
+
+      static constexpr long tapsize = TapSize;
+      static constexpr long subtaps = Subtaps;
+      static constexpr long nx = nrawx / TapSize * Subtaps;
+      static constexpr long ny = nrawy / TapSize * Subtaps;
+
+      static constexpr lookup_table<std::uint16_t, nrawx> xlut =
+	make_subtap_lut<TapSize, Subtaps, nrawx>();
+      static constexpr lookup_table<std::uint16_t, nrawy> ylut =
+	make_subtap_lut<TapSize, Subtaps, nrawy>();
+    };
+
+  template <long TapSize, long Subtaps>
+    constexpr lookup_table<std::uint16_t, nrawx> subtap_geometry<TapSize, Subtaps>::xlut;
+  template <long TapSize, long Subtaps>
+    constexpr lookup_table<std::uint16_t, nrawy> subtap_geometry<TapSize, Subtaps>::ylut;
+
+  // the geometry all our tools use by default
+  typedef subtap_geometry<long(tapsize), long(subtaps)> default_geometry;
+
+  // Subtap geometry as used by genstats.pl. Each tap is divided into
+  // subtaps x subtaps regions, subtap boundaries within a tap are at
+  // rint(tapsize*i/subtaps). Raw coordinates are zero-based here, as
+  // in Lab.pm. The tables of default_geometry are used when the number
+  // of subtaps is the default, other numbers get tables built at run
+  // time from the same functions.
+  //
+  // Subtaps are numbered globally along each axis, g = tap*subtaps +
+  // subtap, and the 2d index of a subtap is gy * nx() + gx, which is
+  // also the order in which genstats.pl visits them. With zorder, the
+  // 2d index instead follows the Z-order (Morton) curve over (gx, gy),
+  // so that subtaps near each other on the detector are near each
+  // other in anything indexed by subtap, e.g., a partition or a
+  // bgcube. Code which goes through index(), slot() and subtap_window
+  // works with either layout.
+  class subtap_grid {
+  private:
+    std::size_t nsub, nxsub, nysub;
+    std::vector<std::uint16_t> xbuf, ybuf;
+    const std::uint16_t* xlut;      // raw coordinate -> global subtap
+    const std::uint16_t* ylut;
+    std::vector<std::uint32_t> zslot; // gy * nx + gx -> 2d index, if zorder
+
+    subtap_grid(const subtap_grid&);
+    subtap_grid& operator=(const subtap_grid&);
+
+  public:
+
+    static const long rawx_min = 0;
+    static const long rawx_max = nrawx - 1;
+    static const long rawy_min = 0;
+    static const long rawy_max = nrawy - 1;
+
+    explicit subtap_grid(std::size_t subtaps = lab::subtaps, bool zorder = false);
+
+    std::size_t subtaps() const { return nsub; }
+    std::size_t nx() const { return nxsub; }
+    std::size_t ny() const { return nysub; }
+    std::size_t size() const { return nxsub * nysub; }
+
+    // offsets of subtap within its tap, subtap may be negative or
+    // >= subtaps to refer to neighboring taps, c.f. subtap_offsets()
+    void offsets(long subtap, long& o1, long& o2) const;
+
+    // raw coordinate range of a tap / subtap along either axis
+    void tap_range(long tap, long& c1, long& c2) const;
+    void range(long tap, long subtap, long& c1, long& c2) const;
+
+    // raw coordinate range of global subtap g along either axis
+    void range(long g, long& c1, long& c2) const
+    { range(g / long(nsub), g % long(nsub), c1, c2); }
+
+    // global subtap along each axis, -1 if out of range
+    int xindex(long rawx) const
+    { return (rawx < rawx_min || rawx > rawx_max) ? -1 : xlut[rawx-rawx_min]; }
+    int yindex(long rawy) const
+    { return (rawy < rawy_min || rawy > rawy_max) ? -1 : ylut[rawy-rawy_min]; }
+
+    bool zorder() const { return !zslot.empty(); }
+
+    // 2d index of global subtaps (gx, gy), which must be on the grid
+    std::size_t slot(long gx, long gy) const
+    {
+      const std::size_t i = std::size_t(gy) * nxsub + gx;
+      return zslot.empty() ? i : zslot[i];
+    }
+
+    // 2d index of the subtap containing (rawx, rawy), -1 if none
+    long index(long rawx, long rawy) const
+    {
+      int gx = xindex(rawx), gy = yindex(rawy);
+      return (gx < 0 || gy < 0) ? -1 : long(slot(gx, gy));
+    }
+
+    // index() of n events at once, written without branches so that
+    // the compiler can vectorize it
+    void index(const packed_event* evt, long* out, std::size_t n) const;
+
+  };
+
+  // The 2d indices of the subtaps in [gx1, gx2] x [gy1, gy2], clipped
+  // to the grid, visited row by row whatever the grid's layout, e.g.,
+  //
+  //   for (std::size_t s : subtap_window(grid, gx-1, gx+1, gy-1, gy+1))
+  class subtap_window {
+  private:
+    const subtap_grid& grid;
+    long x1, x2, y1, y2;
+
+  public:
+
+    class iterator {
+    private:
+      const subtap_window* w;
+      long x, y;
+
+    public:
+      iterator(const subtap_window* win, long gx, long gy) : w(win), x(gx), y(gy) { }
+
+      std::size_t operator*() const { return w->grid.slot(x, y); }
+
+      iterator& operator++()
+      {
+	if (++x > w->x2) {
+	  x = w->x1;
+	  ++y;
+	}
+	return *this;
+      }
+
+      bool operator!=(const iterator& o) const { return x != o.x || y != o.y; }
+    };
+
+    subtap_window(const subtap_grid& g, long gx1, long gx2, long gy1, long gy2)
+      : grid(g),
+	x1(std::max(gx1, 0L)), x2(std::min(gx2, long(g.nx())-1)),
+	y1(std::max(gy1, 0L)), y2(std::min(gy2, long(g.ny())-1))
+    {
+      if (x1 > x2)
+	y2 = y1-1;
+    }
+
+    iterator begin() const { return iterator(this, x1, y1); }
+    iterator end() const { return iterator(this, x1, std::max(y1, y2+1)); }
+
+    std::size_t size() const
+    { return y2 < y1 ? 0 : std::size_t(x2-x1+1) * (y2-y1+1); }
+  };
+
+  // Event indices grouped by subtap. The events of subtap i are
+  // order[offset[i]] .. order[offset[i+1]-1], in their original
+  // (file) order.
+  struct partition {
+    std::vector<std::size_t> offset;
+    std::vector<std::size_t> order;
+
+    std::size_t count(std::size_t i) const { return offset[i+1] - offset[i]; }
+  };
+
+  // counting sort of events by subtap, events off the grid are dropped
+  void partition_events(const subtap_grid& grid,
+			const std::vector<packed_event>& evt,
+			partition& p);
+
+} // namespace lab
+
+#endif
@@ -0,0 +1,172 @@
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <getopt.h>
+#include <iostream>
+#include <cpputil/ss_cast.hh>
+#include "subtap.hh"
+
+using std::cout;
+using std::cerr;
+
+namespace {
+
+  namespace opts {
+    int subtaps = lab::subtaps;
+
+    const char* version_string = "0.1";
+    int help = 0;
+    int version = 0;
+    option lopts[] = {
+      { "help",    no_argument, &help, 1 },
+      { "version", no_argument, &version, 1 },
+      { "subtaps", required_argument, 0, 's' },
+      { 0, 0, 0, 0 }
+    };
+  }
+
+  int help();
+  int version();
+}
+
+int main(int argc, char** argv) {
+
+  int c;
+  while ((c=getopt_long_only(argc, argv, "", opts::lopts, 0))!=-1) {
+    switch (c) {
+    // a flag was set/unset on our behalf, nothing more to do
+    case 0:
+      break;
+    case 's':
+      opts::subtaps = util::ss_cast<int>(optarg);
+      break;
+    // problem occurred
+    case '?':
+    case ':':
+      cerr << "Try `--help' for more information.\n";
+      return EXIT_FAILURE;
+    // didn't handle all of our specified options
+    default:
+      cerr << "programmer error, unhandled option = "; cerr.put(c); cerr << '\n';
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (opts::help) return help();
+  if (opts::version) return version();
+
+  try {
+    lab::subtap_grid grid(opts::subtaps);
+    const long nsub = grid.subtaps();
+
+    // one-based, as in the old tap_coords file
+    for (std::size_t gy=0; gy<grid.ny(); ++gy) {
+      long y1, y2;
+      grid.range(gy, y1, y2);
+      for (std::size_t gx=0; gx<grid.nx(); ++gx) {
+	long x1, x2;
+	grid.range(gx, x1, x2);
+	cout << gy/nsub+1 << ' ' << gy%nsub+1 << ' '
+	     << gx/nsub+1 << ' ' << gx%nsub+1 << ' '
+	     << y1+1 << ' ' << y2+1 << ' ' << x1+1 << ' ' << x2+1 << " \n";
+      }
+    }
+  }
+  catch (std::exception& e) {
+    cerr << argv[0] << ": " << e.what() << '\n';
+    return EXIT_FAILURE;
+  }
+
+  return 0;
+
+} // main
+
+namespace {
+
+  int version() {
+    cout << opts::version_string << '\n';
+    return 0;
+  }
+
+  int help() {
+    const char* help_text = "\
+=head1 NAME\n\
+\n\
+subtap_coords - print the raw coordinate ranges of all subtaps\n\
+\n\
+=head1 SYNOPSIS\n\
+\n\
+subtap_coords [options]\n\
+\n\
+=head1 DESCRIPTION\n\
+\n\
+Prints one line per subtap, in the order F<genstats.pl> visits them,\n\
+with columns\n\
+\n\
+  YTAP YSUBTAP XTAP XSUBTAP Y1 Y2 X1 X2\n\
+\n\
+Taps, subtaps and coordinates are one-based. This replaces the\n\
+generated F<tap_coords> file, whose boundaries within a tap (85/85/86\n\
+pixels) did not agree with those of F<genstats.pl> and F<addspi>\n\
+(85/86/85). The ranges come from the same geometry code the native\n\
+programs use.\n\
+\n\
+=head1 OPTIONS\n\
+\n\
+=over 4\n\
+\n\
+=item --help\n\
+\n\
+Print this help text and exit.\n\
+\n\
+=item --version\n\
+\n\
+Print the program version and exit.\n\
+\n\
+=item --subtaps=i\n\
+\n\
+Number of subtaps along each axis of a tap. The default is 3.\n\
+\n\
+=back\n\
+\n\
+=head1 AUTHOR\n\
+\n\
+Pete Ratzlaff E<lt>pratzlaff@cfa.harvard.eduE<gt>\n\
+\n\
+=head1 SEE ALSO\n\
+\n\
+genstats.pl\n\
+\n\
+=cut\n\
+";
+
+    const char* pager = std::getenv("PAGER");
+    if (!pager) pager = "more";
+
+    FILE* pd = popen((std::string("pod2text -c | ")+pager).c_str(), "w");
+    if (!pd) {
+      std::perror("error starting pod2text");
+      return EXIT_FAILURE;
+    }
+
+    int n = 0;
+    int len = std::strlen(help_text);
+    while (n < len) {
+      int written = std::fwrite(help_text, 1, len-n, pd);
+      if (!written) {
+	std::perror("error writing help");
+	return EXIT_FAILURE;
+      }
+      n+=written;
+    }
+
+    if (pclose(pd) == -1) {
+      std::perror("error writing help");
+      return EXIT_FAILURE;
+    }
+
+    return 0;
+  }
+
+}
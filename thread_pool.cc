@@ -0,0 +1,109 @@
+#include <algorithm>
+#include "thread_pool.hh"
+
+namespace lab {
+
+  using std::size_t;
+  using std::function;
+  using std::unique_lock;
+  using std::mutex;
+
+  thread_pool::thread_pool(size_t nthreads)
+    : active(0), stopping(false)
+  {
+    if (!nthreads)
+      nthreads = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t i=0; i<nthreads; ++i)
+      workers.push_back(std::thread(&thread_pool::work, this));
+  }
+
+  thread_pool::~thread_pool()
+  {
+    {
+      unique_lock<mutex> lock(mtx);
+      stopping = true;
+    }
+    task_ready.notify_all();
+    for (size_t i=0; i<workers.size(); ++i)
+      workers[i].join();
+  }
+
+  void thread_pool::submit(const function<void()>& task)
+  {
+    {
+      unique_lock<mutex> lock(mtx);
+      tasks.push_back(task);
+    }
+    task_ready.notify_one();
+  }
+
+  void thread_pool::wait()
+  {
+    unique_lock<mutex> lock(mtx);
+    while (!tasks.empty() || active)
+      all_done.wait(lock);
+
+    if (error) {
+      std::exception_ptr e = error;
+      error = std::exception_ptr();
+      std::rethrow_exception(e);
+    }
+  }
+
+  void thread_pool::work()
+  {
+    for (;;) {
+      function<void()> task;
+      {
+	unique_lock<mutex> lock(mtx);
+	while (!stopping && tasks.empty())
+	  task_ready.wait(lock);
+	if (stopping && tasks.empty())
+	  return;
+	task = tasks.front();
+	tasks.pop_front();
+	++active;
+      }
+
+      try {
+	task();
+      }
+      catch (...) {
+	unique_lock<mutex> lock(mtx);
+	if (!error)
+	  error = std::current_exception();
+      }
+
+      {
+	unique_lock<mutex> lock(mtx);
+	--active;
+	if (tasks.empty() && !active)
+	  all_done.notify_all();
+      }
+    }
+  }
+
+  void parallel_for(thread_pool& pool, size_t n,
+		    const function<void(size_t)>& f, size_t chunk)
+  {
+    if (!n)
+      return;
+
+    // a few chunks per thread keeps the load balanced when some
+    // indices (e.g., dense subtaps) cost much more than others
+    if (!chunk)
+      chunk = std::max<size_t>(1, n / (pool.size() * 8));
+
+    for (size_t lo=0; lo<n; lo+=chunk) {
+      size_t hi = std::min(n, lo+chunk);
+      pool.submit([lo, hi, &f]() {
+	  for (size_t i=lo; i<hi; ++i)
+	    f(i);
+	});
+    }
+
+    pool.wait();
+  }
+
+} // namespace lab
@@ -0,0 +1,57 @@
+#ifndef THREAD_POOL_HH
+#define THREAD_POOL_HH
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+
+namespace lab {
+
+  // A fixed set of worker threads pulling tasks from a shared queue.
+  // The first exception thrown by a task is rethrown from wait().
+  class thread_pool {
+  private:
+
+    std::vector<std::thread> workers;
+    std::deque< std::function<void()> > tasks;
+    std::mutex mtx;
+    std::condition_variable task_ready;
+    std::condition_variable all_done;
+    std::size_t active;
+    bool stopping;
+    std::exception_ptr error;
+
+    void work();
+
+    thread_pool(const thread_pool&);
+    thread_pool& operator=(const thread_pool&);
+
+  public:
+
+    // nthreads == 0 uses one thread per hardware core
+    explicit thread_pool(std::size_t nthreads = 0);
+    ~thread_pool();
+
+    std::size_t size() const { return workers.size(); }
+
+    void submit(const std::function<void()>& task);
+
+    // block until the queue is drained and no task is running
+    void wait();
+
+  };
+
+  // Call f(i) for i in [0,n), spread over the pool in chunks of
+  // roughly chunk indices each. Returns once all calls complete.
+  void parallel_for(thread_pool& pool, std::size_t n,
+		    const std::function<void(std::size_t)>& f,
+		    std::size_t chunk = 0);
+
+} // namespace lab
+
+#endif